@@ -64,6 +64,15 @@ namespace Plugin {
                 _controller->Register(&_dialogueNotification);
                 Exchange::JAVSController::Register(*this, _controller);
             }
+
+            _keywordDetector = _AVSClient->QueryInterface<IKeywordDetector>();
+            _streamExport = _AVSClient->QueryInterface<IStreamExport>();
+            _blackBox = _AVSClient->QueryInterface<IBlackBox>();
+            if ((_keywordDetector != nullptr) || (_streamExport != nullptr) || (_blackBox != nullptr)) {
+                RegisterAll();
+            } else {
+                TRACE_L1(_T("Keyword detection, stream export and black box methods are only available with the AVSClient in process"));
+            }
         }
 
         if (message.empty() == true) {
@@ -87,6 +96,22 @@ namespace Plugin {
                 Exchange::JAVSController::Unregister(*this);
             }
 
+            if ((_keywordDetector != nullptr) || (_streamExport != nullptr) || (_blackBox != nullptr)) {
+                UnregisterAll();
+            }
+            if (_keywordDetector != nullptr) {
+                _keywordDetector->Release();
+                _keywordDetector = nullptr;
+            }
+            if (_streamExport != nullptr) {
+                _streamExport->Release();
+                _streamExport = nullptr;
+            }
+            if (_blackBox != nullptr) {
+                _blackBox->Release();
+                _blackBox = nullptr;
+            }
+
             if (_AVSClient->Deinitialize() == false) {
                 TRACE_L1(_T("AVSClient deinitialize failed!"));
             }
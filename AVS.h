@@ -26,6 +26,11 @@
 
 #include <AVS/SampleApp/SampleApplicationReturnCodes.h>
 
+#include "IBlackBox.h"
+#include "IKeywordDetector.h"
+#include "IStreamExport.h"
+#include "ThreadScheduling.h"
+
 #if defined(ENABLE_SMART_SCREEN_SUPPORT)
 #include "SmartScreen/SmartScreen.h"
 #endif
@@ -102,7 +107,7 @@ namespace Plugin {
                     return;
                 }
 
-                if (service->Callsign() == _parent._audiosourceName) {
+                if (_parent.IsAudiosource(service->Callsign()) == true) {
                     if (_parent._AVSClient) {
                         _parent._AVSClient->StateChange(service);
                     }
@@ -157,6 +162,27 @@ namespace Plugin {
                 , KWDModelsPath()
                 , EnableSmartScreen()
                 , EnableKWD()
+                , KWDEngine()
+                , KWDLocales()
+                , KWDLockModels()
+                , KWDScheduling()
+                , VoiceJitterWindow()
+                , VoiceConcealment()
+                , VoiceCodec()
+                , UplinkCodec()
+                , VoiceBatch()
+                , VoiceTransport()
+                , VoiceSharedBuffer()
+                , VoiceMixing()
+                , VoiceScheduling()
+                , VoiceRecording()
+                , StreamDuration()
+                , StreamReaders()
+                , StreamBudget()
+                , StreamExport()
+                , BlackBoxDuration()
+                , BlackBoxFiles()
+                , BlackBoxSize()
             {
                 Add(_T("audiosource"), &Audiosource);
                 Add(_T("alexaclientconfig"), &AlexaClientConfig);
@@ -165,6 +191,27 @@ namespace Plugin {
                 Add(_T("kwdmodelspath"), &KWDModelsPath);
                 Add(_T("enablesmartscreen"), &EnableSmartScreen);
                 Add(_T("enablekwd"), &EnableKWD);
+                Add(_T("kwdengine"), &KWDEngine);
+                Add(_T("kwdlocales"), &KWDLocales);
+                Add(_T("kwdlockmodels"), &KWDLockModels);
+                Add(_T("kwdscheduling"), &KWDScheduling);
+                Add(_T("voicejitterwindow"), &VoiceJitterWindow);
+                Add(_T("voiceconcealment"), &VoiceConcealment);
+                Add(_T("voicecodec"), &VoiceCodec);
+                Add(_T("uplinkcodec"), &UplinkCodec);
+                Add(_T("voicebatch"), &VoiceBatch);
+                Add(_T("voicetransport"), &VoiceTransport);
+                Add(_T("voicesharedbuffer"), &VoiceSharedBuffer);
+                Add(_T("voicemixing"), &VoiceMixing);
+                Add(_T("voicescheduling"), &VoiceScheduling);
+                Add(_T("voicerecording"), &VoiceRecording);
+                Add(_T("streamduration"), &StreamDuration);
+                Add(_T("streamreaders"), &StreamReaders);
+                Add(_T("streambudget"), &StreamBudget);
+                Add(_T("streamexport"), &StreamExport);
+                Add(_T("blackboxduration"), &BlackBoxDuration);
+                Add(_T("blackboxfiles"), &BlackBoxFiles);
+                Add(_T("blackboxsize"), &BlackBoxSize);
             }
 
             ~Config() = default;
@@ -177,6 +224,256 @@ namespace Plugin {
             Core::JSON::String KWDModelsPath;
             Core::JSON::Boolean EnableSmartScreen;
             Core::JSON::Boolean EnableKWD;
+            Core::JSON::String KWDEngine;
+            Core::JSON::String KWDLocales;
+            Core::JSON::Boolean KWDLockModels;
+            ThreadScheduling::Config KWDScheduling;
+            Core::JSON::DecUInt8 VoiceJitterWindow;
+            Core::JSON::String VoiceConcealment;
+            Core::JSON::String VoiceCodec;
+            Core::JSON::String UplinkCodec;
+            Core::JSON::DecUInt8 VoiceBatch;
+            Core::JSON::String VoiceTransport;
+            Core::JSON::String VoiceSharedBuffer;
+            Core::JSON::String VoiceMixing;
+            ThreadScheduling::Config VoiceScheduling;
+            Core::JSON::String VoiceRecording;
+            Core::JSON::DecUInt8 StreamDuration;
+            Core::JSON::DecUInt8 StreamReaders;
+            Core::JSON::DecUInt32 StreamBudget;
+            Core::JSON::String StreamExport;
+            Core::JSON::DecUInt8 BlackBoxDuration;
+            Core::JSON::DecUInt16 BlackBoxFiles;
+            Core::JSON::DecUInt32 BlackBoxSize;
+        };
+
+        class KeywordModelsParams : public Core::JSON::Container {
+        public:
+            KeywordModelsParams(const KeywordModelsParams&) = delete;
+            KeywordModelsParams& operator=(const KeywordModelsParams&) = delete;
+
+        public:
+            KeywordModelsParams()
+                : Core::JSON::Container()
+                , Locales()
+            {
+                Add(_T("locales"), &Locales);
+            }
+
+            ~KeywordModelsParams() = default;
+
+        public:
+            Core::JSON::String Locales;
+        };
+
+        class KeywordThresholdParams : public Core::JSON::Container {
+        public:
+            KeywordThresholdParams(const KeywordThresholdParams&) = delete;
+            KeywordThresholdParams& operator=(const KeywordThresholdParams&) = delete;
+
+        public:
+            KeywordThresholdParams()
+                : Core::JSON::Container()
+                , Keyword()
+                , Threshold()
+            {
+                Add(_T("keyword"), &Keyword);
+                Add(_T("threshold"), &Threshold);
+            }
+
+            ~KeywordThresholdParams() = default;
+
+        public:
+            Core::JSON::String Keyword;
+            Core::JSON::DecUInt32 Threshold;
+        };
+
+        class KeywordTelemetryData : public Core::JSON::Container {
+        public:
+            class DetectionData : public Core::JSON::Container {
+            public:
+                DetectionData()
+                    : Core::JSON::Container()
+                    , Timestamp()
+                    , Keyword()
+                    , Locale()
+                    , Confidence()
+                    , Begin()
+                    , End()
+                    , Lag()
+                    , Latency()
+                    , Reported()
+                {
+                    Init();
+                }
+
+                // Copied into the detections array
+                DetectionData(const DetectionData& copy)
+                    : Core::JSON::Container()
+                    , Timestamp(copy.Timestamp)
+                    , Keyword(copy.Keyword)
+                    , Locale(copy.Locale)
+                    , Confidence(copy.Confidence)
+                    , Begin(copy.Begin)
+                    , End(copy.End)
+                    , Lag(copy.Lag)
+                    , Latency(copy.Latency)
+                    , Reported(copy.Reported)
+                {
+                    Init();
+                }
+
+                DetectionData& operator=(const DetectionData& rhs)
+                {
+                    Timestamp = rhs.Timestamp;
+                    Keyword = rhs.Keyword;
+                    Locale = rhs.Locale;
+                    Confidence = rhs.Confidence;
+                    Begin = rhs.Begin;
+                    End = rhs.End;
+                    Lag = rhs.Lag;
+                    Latency = rhs.Latency;
+                    Reported = rhs.Reported;
+                    return (*this);
+                }
+
+                ~DetectionData() = default;
+
+            private:
+                void Init()
+                {
+                    Add(_T("timestamp"), &Timestamp);
+                    Add(_T("keyword"), &Keyword);
+                    Add(_T("locale"), &Locale);
+                    Add(_T("confidence"), &Confidence);
+                    Add(_T("begin"), &Begin);
+                    Add(_T("end"), &End);
+                    Add(_T("lag"), &Lag);
+                    Add(_T("latency"), &Latency);
+                    Add(_T("reported"), &Reported);
+                }
+
+            public:
+                Core::JSON::DecUInt64 Timestamp;
+                Core::JSON::String Keyword;
+                Core::JSON::String Locale;
+                Core::JSON::DecSInt32 Confidence;
+                Core::JSON::DecUInt64 Begin;
+                Core::JSON::DecUInt64 End;
+                Core::JSON::DecUInt32 Lag;
+                Core::JSON::DecUInt32 Latency;
+                Core::JSON::Boolean Reported;
+            };
+
+            class HistogramData : public Core::JSON::Container {
+            public:
+                HistogramData()
+                    : Core::JSON::Container()
+                    , Locale()
+                    , Counts()
+                {
+                    Init();
+                }
+
+                // Copied into the histograms array
+                HistogramData(const HistogramData& copy)
+                    : Core::JSON::Container()
+                    , Locale(copy.Locale)
+                    , Counts(copy.Counts)
+                {
+                    Init();
+                }
+
+                HistogramData& operator=(const HistogramData& rhs)
+                {
+                    Locale = rhs.Locale;
+                    Counts = rhs.Counts;
+                    return (*this);
+                }
+
+                ~HistogramData() = default;
+
+            private:
+                void Init()
+                {
+                    Add(_T("locale"), &Locale);
+                    Add(_T("counts"), &Counts);
+                }
+
+            public:
+                Core::JSON::String Locale;
+                Core::JSON::ArrayType<Core::JSON::DecUInt32> Counts;
+            };
+
+        public:
+            KeywordTelemetryData(const KeywordTelemetryData&) = delete;
+            KeywordTelemetryData& operator=(const KeywordTelemetryData&) = delete;
+
+        public:
+            KeywordTelemetryData()
+                : Core::JSON::Container()
+                , Recorded()
+                , BucketWidth()
+                , Detections()
+                , Histograms()
+            {
+                Add(_T("recorded"), &Recorded);
+                Add(_T("bucketwidth"), &BucketWidth);
+                Add(_T("detections"), &Detections);
+                Add(_T("histograms"), &Histograms);
+            }
+
+            ~KeywordTelemetryData() = default;
+
+        public:
+            Core::JSON::DecUInt64 Recorded;
+            Core::JSON::DecUInt16 BucketWidth;
+            Core::JSON::ArrayType<DetectionData> Detections;
+            Core::JSON::ArrayType<HistogramData> Histograms;
+        };
+
+        class StreamExportData : public Core::JSON::Container {
+        public:
+            StreamExportData(const StreamExportData&) = delete;
+            StreamExportData& operator=(const StreamExportData&) = delete;
+
+        public:
+            StreamExportData()
+                : Core::JSON::Container()
+                , Path()
+                , Capacity()
+                , Written()
+            {
+                Add(_T("path"), &Path);
+                Add(_T("capacity"), &Capacity);
+                Add(_T("written"), &Written);
+            }
+
+            ~StreamExportData() = default;
+
+        public:
+            Core::JSON::String Path;
+            Core::JSON::DecUInt64 Capacity;
+            Core::JSON::DecUInt64 Written;
+        };
+
+        class BlackBoxParams : public Core::JSON::Container {
+        public:
+            BlackBoxParams(const BlackBoxParams&) = delete;
+            BlackBoxParams& operator=(const BlackBoxParams&) = delete;
+
+        public:
+            BlackBoxParams()
+                : Core::JSON::Container()
+                , Reason()
+            {
+                Add(_T("reason"), &Reason);
+            }
+
+            ~BlackBoxParams() = default;
+
+        public:
+            Core::JSON::String Reason;
         };
 
     public:
@@ -185,6 +482,9 @@ namespace Plugin {
         AVS()
             : _AVSClient(nullptr)
             , _controller(nullptr)
+            , _keywordDetector(nullptr)
+            , _streamExport(nullptr)
+            , _blackBox(nullptr)
             , _service(nullptr)
             , _audiosourceName()
             , _connectionId(0)
@@ -214,8 +514,42 @@ namespace Plugin {
         void Deactivated(RPC::IRemoteConnection* connection);
         const string CreateInstance(const string& name, const Config& config);
 
+        //   JSON-RPC methods of the keyword detection, the stream export and the black box
+        // -------------------------------------------------------------------------------------------------------
+        void RegisterAll();
+        void UnregisterAll();
+        uint32_t endpoint_keywordmodels(const KeywordModelsParams& params);
+        uint32_t endpoint_keywordthreshold(const KeywordThresholdParams& params);
+        uint32_t get_keywordtelemetry(KeywordTelemetryData& response) const;
+        uint32_t get_streamexport(StreamExportData& response) const;
+        uint32_t endpoint_blackbox(const BlackBoxParams& params);
+
+        // The audiosource may list several callsigns, separated by commas
+        bool IsAudiosource(const string& callsign) const
+        {
+            bool result = false;
+            size_t start = 0;
+
+            while ((result == false) && (start <= _audiosourceName.length())) {
+                size_t end = _audiosourceName.find(',', start);
+                if (end == string::npos) {
+                    end = _audiosourceName.length();
+                }
+
+                const size_t first = _audiosourceName.find_first_not_of(_T(" \t"), start);
+                const size_t last = _audiosourceName.find_last_not_of(_T(" \t"), end - 1);
+                result = (first < end) && (last != string::npos) && (last >= first) && (_audiosourceName.compare(first, last - first + 1, callsign) == 0);
+                start = end + 1;
+            }
+
+            return (result);
+        }
+
         Exchange::IAVSClient* _AVSClient;
         Exchange::IAVSController* _controller;
+        IKeywordDetector* _keywordDetector;
+        IStreamExport* _streamExport;
+        IBlackBox* _blackBox;
         PluginHost::IShell* _service;
         string _audiosourceName;
         uint32_t _connectionId;
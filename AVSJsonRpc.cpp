@@ -0,0 +1,159 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "AVS.h"
+
+namespace WPEFramework {
+namespace Plugin {
+
+    void AVS::RegisterAll()
+    {
+        if (_keywordDetector != nullptr) {
+            Register<KeywordModelsParams, void>(_T("keywordmodels"), &AVS::endpoint_keywordmodels, this);
+            Register<KeywordThresholdParams, void>(_T("keywordthreshold"), &AVS::endpoint_keywordthreshold, this);
+            Property<KeywordTelemetryData>(_T("keywordtelemetry"), &AVS::get_keywordtelemetry, nullptr, this);
+        }
+        if (_streamExport != nullptr) {
+            Property<StreamExportData>(_T("streamexport"), &AVS::get_streamexport, nullptr, this);
+        }
+        if (_blackBox != nullptr) {
+            Register<BlackBoxParams, void>(_T("blackbox"), &AVS::endpoint_blackbox, this);
+        }
+    }
+
+    void AVS::UnregisterAll()
+    {
+        if (_blackBox != nullptr) {
+            Unregister(_T("blackbox"));
+        }
+        if (_streamExport != nullptr) {
+            Unregister(_T("streamexport"));
+        }
+        if (_keywordDetector != nullptr) {
+            Unregister(_T("keywordtelemetry"));
+            Unregister(_T("keywordthreshold"));
+            Unregister(_T("keywordmodels"));
+        }
+    }
+
+    // Method: keywordmodels - Loads the keyword models of other locales, detection goes on while they load
+    // Return codes:
+    //  - ERROR_NONE: Success
+    //  - ERROR_GENERAL: The models could not be loaded, detection goes on with the current ones
+    //  - ERROR_UNAVAILABLE: Keyword detection is not enabled
+    uint32_t AVS::endpoint_keywordmodels(const KeywordModelsParams& params)
+    {
+        ASSERT(_keywordDetector != nullptr);
+
+        return (_keywordDetector->Models(params.Locales.Value()));
+    }
+
+    // Method: keywordthreshold - Sets the detection threshold of one keyword, or of all keywords
+    // Return codes:
+    //  - ERROR_NONE: Success
+    //  - ERROR_BAD_REQUEST: The threshold is out of range, or no locale has the keyword
+    //  - ERROR_UNAVAILABLE: Keyword detection is not enabled
+    uint32_t AVS::endpoint_keywordthreshold(const KeywordThresholdParams& params)
+    {
+        ASSERT(_keywordDetector != nullptr);
+
+        uint32_t result = Core::ERROR_BAD_REQUEST;
+        if (params.Threshold.IsSet() == true) {
+            result = _keywordDetector->Threshold(params.Keyword.Value(), params.Threshold.Value());
+        }
+
+        return (result);
+    }
+
+    // Property: keywordtelemetry - Recent keyword detections and the confidence histogram of each locale (r/o)
+    // Return codes:
+    //  - ERROR_NONE: Success
+    //  - ERROR_UNAVAILABLE: Keyword detection is not enabled
+    uint32_t AVS::get_keywordtelemetry(KeywordTelemetryData& response) const
+    {
+        ASSERT(_keywordDetector != nullptr);
+
+        KeywordTelemetry::Snapshot snapshot;
+        const uint32_t result = _keywordDetector->Telemetry(snapshot);
+
+        if (result == Core::ERROR_NONE) {
+            response.Recorded = snapshot.recorded;
+            response.BucketWidth = static_cast<uint16_t>(KeywordTelemetry::BUCKET_WIDTH);
+
+            for (const KeywordTelemetry::Detection& detection : snapshot.detections) {
+                KeywordTelemetryData::DetectionData& entry = response.Detections.Add();
+                entry.Timestamp = detection.timestamp;
+                entry.Keyword = string(detection.keyword);
+                entry.Locale = string(detection.locale);
+                entry.Confidence = detection.confidence;
+                entry.Begin = detection.begin;
+                entry.End = detection.end;
+                entry.Lag = detection.lag;
+                entry.Latency = detection.latency;
+                entry.Reported = detection.reported;
+            }
+
+            for (const KeywordTelemetry::Histogram& histogram : snapshot.histograms) {
+                KeywordTelemetryData::HistogramData& entry = response.Histograms.Add();
+                entry.Locale = histogram.locale;
+                for (uint8_t bucket = 0; bucket < KeywordTelemetry::BUCKETS; bucket++) {
+                    entry.Counts.Add() = histogram.counts[bucket];
+                }
+            }
+        }
+
+        return (result);
+    }
+
+    // Property: streamexport - Shared memory file the microphone stream is exported to (r/o)
+    // Return codes:
+    //  - ERROR_NONE: Success
+    //  - ERROR_UNAVAILABLE: The stream is not exported
+    uint32_t AVS::get_streamexport(StreamExportData& response) const
+    {
+        ASSERT(_streamExport != nullptr);
+
+        string path;
+        uint64_t capacity = 0;
+        uint64_t written = 0;
+        const uint32_t result = _streamExport->Export(path, capacity, written);
+
+        if (result == Core::ERROR_NONE) {
+            response.Path = path;
+            response.Capacity = capacity;
+            response.Written = written;
+        }
+
+        return (result);
+    }
+
+    // Method: blackbox - Saves the audio around now to a WAV file in the persistent path
+    // Return codes:
+    //  - ERROR_NONE: Success
+    //  - ERROR_INPROGRESS: An earlier snapshot is still being taken
+    //  - ERROR_UNAVAILABLE: The black box is not enabled
+    uint32_t AVS::endpoint_blackbox(const BlackBoxParams& params)
+    {
+        ASSERT(_blackBox != nullptr);
+
+        return (_blackBox->Snapshot(params.Reason.Value()));
+    }
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,447 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Feeds a corpus of WAV files through an AudioInputStream into the KeywordDetector, faster than real time.
+//
+//   AVSKeywordDetectorBenchmark --model <path/to/model> [--engine pryon|template] [--push <ms>] [--threshold <value>] [--gate on|off|both] [--labels <file>] [file.wav ...]
+//
+// The model is a model.bin file for the Pryon engine, or a directory of keyword recordings for the template engine,
+// which needs no vendor library.
+//
+// Every line of the labels file names a WAV file, relative to the labels file, optionally followed by the
+// start and end of a keyword in milliseconds. A file may be listed more than once for several keywords;
+// a file without a keyword counts for false accepts only. WAV files of any supported rate and channel
+// count are converted to 16 kHz mono first.
+//
+// By default the corpus runs twice, without and with the energy gate in front of the decoder, to compare
+// the CPU it saves against the keywords it may cost. It then exits with 2 when the gate lowers the recall.
+
+#include "Module.h"
+#include "AudioFormatConverter.h"
+#include "CompatibleAudioFormat.h"
+#include "KeywordDetector.h"
+
+#include <AVSCommon/Utils/Configuration/ConfigurationNode.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using namespace WPEFramework::Plugin;
+using alexaClientSDK::avsCommon::avs::AudioInputStream;
+using alexaClientSDK::avsCommon::utils::AudioFormat;
+
+namespace {
+
+    constexpr uint32_t SAMPLES_PER_MS = AudioFormatCompatibility::SAMPLE_RATE_HZ / 1000;
+    // Silence between two files, so a keyword never runs into the next file
+    constexpr uint32_t GAP_SAMPLES = 500 * SAMPLES_PER_MS;
+    // A detection counts for a keyword when it ends between the keyword start and this long after its end
+    constexpr uint32_t TOLERANCE_SAMPLES = 1000 * SAMPLES_PER_MS;
+    constexpr size_t STREAM_WORDS = 10 * AudioFormatCompatibility::SAMPLE_RATE_HZ;
+    constexpr size_t STREAM_READERS = 2;
+    constexpr size_t WRITE_SAMPLES = 16 * 1024;
+
+    struct Keyword {
+        AudioInputStream::Index start;
+        AudioInputStream::Index end;
+        bool isHit;
+    };
+
+    struct Utterance {
+        std::string path;
+        std::vector<int16_t> samples;
+        std::vector<Keyword> keywords;
+    };
+
+    struct Detection {
+        AudioInputStream::Index begin;
+        AudioInputStream::Index end;
+    };
+
+    struct Result {
+        double wall;
+        double cpu;
+        uint32_t hits;
+        uint32_t falseAccepts;
+        int64_t latencyTotal;
+        int64_t latencyMin;
+        int64_t latencyMax;
+        int64_t gatedMs;
+        // Whether each labelled keyword was detected, in corpus order
+        std::vector<bool> found;
+    };
+
+    class Observer : public alexaClientSDK::avsCommon::sdkInterfaces::KeyWordObserverInterface {
+    public:
+        void onKeyWordDetected(
+            std::shared_ptr<AudioInputStream> stream,
+            std::string keyword,
+            AudioInputStream::Index beginIndex,
+            AudioInputStream::Index endIndex,
+            std::shared_ptr<const std::vector<char>> KWDMetadata) override
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_detections.push_back({ beginIndex, endIndex });
+        }
+
+        std::vector<Detection> Detections()
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            return (m_detections);
+        }
+
+    private:
+        std::mutex m_lock;
+        std::vector<Detection> m_detections;
+    };
+
+    uint32_t Little(const uint8_t data[], const uint8_t size)
+    {
+        uint32_t value = 0;
+        for (uint8_t index = size; index > 0; index--) {
+            value = (value << 8) | data[index - 1];
+        }
+        return (value);
+    }
+
+    // Reads a 16-bit LPCM WAV file and converts it to the SDS format
+    bool Load(const std::string& path, std::vector<int16_t>& samples)
+    {
+        std::ifstream file(path, std::ios::binary);
+        std::vector<uint8_t> content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        AudioFormat format{ AudioFormat::Encoding::LPCM, AudioFormat::Endianness::LITTLE, 0, 0, 0, true };
+        const uint8_t* data = nullptr;
+        uint32_t length = 0;
+
+        if ((content.size() < 12) || (::memcmp(content.data(), "RIFF", 4) != 0) || (::memcmp(&content[8], "WAVE", 4) != 0)) {
+            fprintf(stderr, "%s: not a WAV file\n", path.c_str());
+            return (false);
+        }
+
+        for (size_t offset = 12; (offset + 8) <= content.size();) {
+            const uint32_t size = Little(&content[offset + 4], 4);
+            const size_t body = offset + 8;
+            if ((::memcmp(&content[offset], "fmt ", 4) == 0) && (size >= 16) && ((body + 16) <= content.size())) {
+                format.numChannels = Little(&content[body + 2], 2);
+                format.sampleRateHz = Little(&content[body + 4], 4);
+                format.sampleSizeInBits = Little(&content[body + 14], 2);
+                if (Little(&content[body], 2) != 1) {
+                    // Not LPCM
+                    format.sampleSizeInBits = 0;
+                }
+            } else if (::memcmp(&content[offset], "data", 4) == 0) {
+                data = &content[body];
+                length = static_cast<uint32_t>(std::min<size_t>(size, content.size() - body));
+            }
+            offset = body + size + (size & 1);
+        }
+
+        AudioFormatConverter converter;
+        if ((data == nullptr) || (AudioFormatCompatibility::IsConvertible(format) == false) || (converter.Configure(format, WRITE_SAMPLES) == false)) {
+            fprintf(stderr, "%s: unsupported WAV format\n", path.c_str());
+            return (false);
+        }
+
+        const uint32_t chunk = WRITE_SAMPLES - (WRITE_SAMPLES % converter.FrameSize());
+        std::vector<int16_t> output(converter.MaxOutput(chunk));
+        for (uint32_t offset = 0; offset < length; offset += chunk) {
+            const uint32_t count = converter.Convert(&data[offset], std::min(chunk, length - offset), output.data());
+            samples.insert(samples.end(), output.begin(), output.begin() + count);
+        }
+
+        return (true);
+    }
+
+    // Lines of "file.wav [start-ms end-ms]"
+    bool Labels(const std::string& path, std::vector<Utterance>& corpus)
+    {
+        std::ifstream file(path);
+        const size_t slash = path.find_last_of('/');
+        const std::string directory = ((slash == std::string::npos) ? std::string() : path.substr(0, slash + 1));
+        std::string line;
+
+        if (file.is_open() == false) {
+            fprintf(stderr, "%s: cannot open\n", path.c_str());
+            return (false);
+        }
+
+        while (std::getline(file, line)) {
+            std::istringstream fields(line);
+            std::string name;
+            uint32_t start = 0, end = 0;
+
+            if ((!(fields >> name)) || (name[0] == '#')) {
+                continue;
+            }
+
+            const std::string wav = ((name[0] == '/') ? name : (directory + name));
+            if ((corpus.empty() == true) || (corpus.back().path != wav)) {
+                corpus.push_back({ wav, {}, {} });
+            }
+            if (fields >> start >> end) {
+                corpus.back().keywords.push_back({ start * SAMPLES_PER_MS, end * SAMPLES_PER_MS, false });
+            }
+        }
+
+        return (true);
+    }
+
+    // Writes everything, waiting for the detector whenever the stream is full
+    void Write(AudioInputStream::Writer& writer, StreamSignal& signal, const int16_t samples[], size_t count)
+    {
+        while (count > 0) {
+            const ssize_t written = writer.write(samples, std::min(count, WRITE_SAMPLES));
+            if (written > 0) {
+                signal.Raise();
+                samples += written;
+                count -= written;
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+    double CpuSeconds()
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+        return (now.tv_sec + (now.tv_nsec / 1e9));
+    }
+
+    void Usage(const char name[])
+    {
+        fprintf(stderr, "usage: %s --model <path/to/model> [--engine pryon|template] [--push <ms>] [--threshold <value>] [--gate on|off|both] [--labels <file>] [file.wav ...]\n", name);
+    }
+
+    bool Run(const std::vector<Utterance>& corpus, const std::string& directory, const std::string& engine, const uint32_t pushMs, const uint32_t threshold, const bool energyGate, Result& result)
+    {
+        AudioFormat format{ AudioFormat::Encoding::LPCM, AudioFormat::Endianness::LITTLE, AudioFormatCompatibility::SAMPLE_RATE_HZ, AudioFormatCompatibility::SAMPLE_SIZE_IN_BITS, AudioFormatCompatibility::NUM_CHANNELS, true };
+        const size_t wordSize = AudioFormatCompatibility::SAMPLE_SIZE_IN_BITS / 8;
+        std::shared_ptr<AudioInputStream::Buffer> buffer = std::make_shared<AudioInputStream::Buffer>(AudioInputStream::calculateBufferSize(STREAM_WORDS, wordSize, STREAM_READERS));
+        std::shared_ptr<AudioInputStream> stream = AudioInputStream::create(buffer, wordSize, STREAM_READERS);
+        // Never overruns the detector, the writer waits for it instead
+        std::shared_ptr<AudioInputStream::Writer> writer = stream->createWriter(AudioInputStream::Writer::Policy::NONBLOCKING);
+        std::shared_ptr<Observer> observer = std::make_shared<Observer>();
+        std::shared_ptr<StreamSignal> signal = std::make_shared<StreamSignal>();
+
+        KeywordDetectorSettings settings;
+        settings.engine = engine;
+        std::unique_ptr<KeywordDetector> detector = KeywordDetector::create(stream, signal, format, { observer }, {}, directory, settings, std::chrono::milliseconds(pushMs), threshold, energyGate);
+        if (!detector) {
+            return (false);
+        }
+
+        std::vector<Keyword> keywords;
+        const std::vector<int16_t> gap(GAP_SAMPLES, 0);
+        const auto start = std::chrono::steady_clock::now();
+        const double cpuStart = CpuSeconds();
+
+        for (const Utterance& utterance : corpus) {
+            const AudioInputStream::Index base = writer->tell();
+            for (const Keyword& keyword : utterance.keywords) {
+                keywords.push_back({ keyword.start + base, keyword.end + base, false });
+            }
+            Write(*writer, *signal, utterance.samples.data(), utterance.samples.size());
+            Write(*writer, *signal, gap.data(), gap.size());
+        }
+
+        // Once a whole stream of silence has been taken, the detector has seen all of the corpus
+        const std::vector<int16_t> flush(STREAM_WORDS, 0);
+        Write(*writer, *signal, flush.data(), flush.size());
+
+        result.wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.cpu = CpuSeconds() - cpuStart;
+        result.gatedMs = detector->GatedTime().count();
+
+        detector.reset();
+
+        result.hits = 0;
+        result.falseAccepts = 0;
+        result.latencyTotal = 0;
+        result.latencyMin = INT64_MAX;
+        result.latencyMax = INT64_MIN;
+
+        for (const Detection& detection : observer->Detections()) {
+            Keyword* match = nullptr;
+            for (Keyword& keyword : keywords) {
+                if ((match == nullptr) && (keyword.isHit == false) && (detection.end >= keyword.start) && (detection.end <= (keyword.end + TOLERANCE_SAMPLES))) {
+                    match = &keyword;
+                }
+            }
+
+            if (match == nullptr) {
+                result.falseAccepts++;
+            } else {
+                const int64_t latency = (static_cast<int64_t>(detection.end) - static_cast<int64_t>(match->end)) / SAMPLES_PER_MS;
+                match->isHit = true;
+                result.hits++;
+                result.latencyTotal += latency;
+                result.latencyMin = std::min(result.latencyMin, latency);
+                result.latencyMax = std::max(result.latencyMax, latency);
+            }
+        }
+
+        result.found.clear();
+        for (const Keyword& keyword : keywords) {
+            result.found.push_back(keyword.isHit);
+        }
+
+        return (true);
+    }
+
+    void Report(const Result& result, const bool energyGate, const double seconds, const size_t keywords)
+    {
+        printf("Energy gate:   %s, %.1f%% of the audio held back\n", (energyGate == true ? "on" : "off"), (result.gatedMs / 10.0) / seconds);
+        printf("Real-time:     %.1f s wall clock, real-time factor %.4f\n", result.wall, result.wall / seconds);
+        printf("CPU:           %.2f ms per second of audio\n", (result.cpu * 1000.0) / seconds);
+        printf("Detections:    %u hits, %zu misses, %u false accepts (%.2f per hour)\n", result.hits, keywords - result.hits, result.falseAccepts, (result.falseAccepts * 3600.0) / seconds);
+        if (keywords > 0) {
+            printf("Recall:        %.2f%%\n", (100.0 * result.hits) / keywords);
+        }
+        if (result.hits > 0) {
+            printf("Latency:       %lld ms average, %lld ms min, %lld ms max after the keyword end\n",
+                static_cast<long long>(result.latencyTotal / result.hits), static_cast<long long>(result.latencyMin), static_cast<long long>(result.latencyMax));
+        }
+    }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    std::string model;
+    uint32_t pushMs = 10;
+    std::string engine = KeywordEngine::Default();
+    uint32_t threshold = KeywordDetector::DEFAULT_DETECTION_THRESHOLD;
+    std::vector<bool> gates = { false, true };
+    std::vector<Utterance> corpus;
+
+    for (int index = 1; index < argc; index++) {
+        const std::string option(argv[index]);
+        const bool hasValue = ((index + 1) < argc);
+        if ((option == "--model") && (hasValue == true)) {
+            model = argv[++index];
+        } else if ((option == "--engine") && (hasValue == true)) {
+            engine = argv[++index];
+        } else if ((option == "--push") && (hasValue == true)) {
+            pushMs = std::max(1, atoi(argv[++index]));
+        } else if ((option == "--threshold") && (hasValue == true)) {
+            threshold = atoi(argv[++index]);
+        } else if ((option == "--gate") && (hasValue == true)) {
+            const std::string gate(argv[++index]);
+            if (gate == "on") {
+                gates = { true };
+            } else if (gate == "off") {
+                gates = { false };
+            } else if (gate != "both") {
+                Usage(argv[0]);
+                return (1);
+            }
+        } else if ((option == "--labels") && (hasValue == true)) {
+            if (Labels(argv[++index], corpus) == false) {
+                return (1);
+            }
+        } else if (option[0] != '-') {
+            corpus.push_back({ option, {}, {} });
+        } else {
+            Usage(argv[0]);
+            return (1);
+        }
+    }
+
+    // A Pryon model is named with its extension, a template directory without
+    if ((model.length() > 4) && (model.compare(model.length() - 4, 4, ".bin") == 0)) {
+        model.erase(model.length() - 4);
+    }
+    while ((model.length() > 1) && (model.back() == '/')) {
+        model.pop_back();
+    }
+    const size_t slash = model.find_last_of('/');
+    if ((corpus.empty() == true) || (model.empty() == true) || (KeywordEngine::IsAvailable(engine) == false)) {
+        Usage(argv[0]);
+        return (1);
+    }
+
+    // The detector picks its model through the locale configuration of the SDK
+    const std::string directory = ((slash == std::string::npos) ? std::string(".") : model.substr(0, slash));
+    const std::string name = model.substr((slash == std::string::npos) ? 0 : (slash + 1));
+    std::shared_ptr<std::istream> configuration(new std::stringstream("{\"alexa\":{\"en-US\":[\"" + name + "\"]}}"));
+    alexaClientSDK::avsCommon::utils::configuration::ConfigurationNode::initialize({ configuration });
+
+    size_t keywords = 0;
+    size_t audio = 0;
+    for (Utterance& utterance : corpus) {
+        if (Load(utterance.path, utterance.samples) == false) {
+            return (1);
+        }
+        keywords += utterance.keywords.size();
+        audio += utterance.samples.size() + GAP_SAMPLES;
+    }
+
+    const double seconds = static_cast<double>(audio + STREAM_WORDS) / AudioFormatCompatibility::SAMPLE_RATE_HZ;
+    printf("Corpus:        %zu files, %.1f s of audio, %zu keywords\n", corpus.size(), seconds, keywords);
+    printf("Settings:      %s engine, push %u ms, threshold %u\n", engine.c_str(), pushMs, threshold);
+
+    std::vector<Result> results;
+    for (const bool gate : gates) {
+        Result result;
+        if (Run(corpus, directory, engine, pushMs, threshold, gate, result) == false) {
+            fprintf(stderr, "Failed to create the keyword detector for %s\n", model.c_str());
+            return (1);
+        }
+        Report(result, gate, seconds, keywords);
+        results.push_back(result);
+    }
+
+    int exitCode = 0;
+
+    if (results.size() == 2) {
+        uint32_t lost = 0;
+        uint32_t gained = 0;
+        for (size_t index = 0; index < keywords; index++) {
+            if ((results[0].found[index] == true) && (results[1].found[index] == false)) {
+                lost++;
+            } else if ((results[0].found[index] == false) && (results[1].found[index] == true)) {
+                gained++;
+            }
+        }
+
+        printf("Energy gate:   %.1f%% less CPU, %d fewer false accepts\n",
+            (results[0].cpu > 0 ? (100.0 * (results[0].cpu - results[1].cpu)) / results[0].cpu : 0.0),
+            static_cast<int>(results[0].falseAccepts) - static_cast<int>(results[1].falseAccepts));
+        if (keywords > 0) {
+            printf("Recall change: %+.2f points (%u keywords lost, %u gained)\n",
+                (100.0 * (static_cast<double>(results[1].hits) - static_cast<double>(results[0].hits))) / keywords, lost, gained);
+        }
+
+        if (results[1].hits < results[0].hits) {
+            fprintf(stderr, "The energy gate lowers the recall\n");
+            exitCode = 2;
+        }
+    }
+
+    return (exitCode);
+}
@@ -0,0 +1,235 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the cost of the in-process voice decoding and conversion per 10 ms of audio
+
+#include "Module.h"
+#include "AudioFormatConverter.h"
+#include "VoiceDecoder.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#if defined(VOICE_CODEC_OPUS)
+#include <opus.h>
+#endif
+#if defined(VOICE_CODEC_MSBC)
+#include <sbc/sbc.h>
+#endif
+
+using namespace WPEFramework::Plugin;
+using alexaClientSDK::avsCommon::utils::AudioFormat;
+
+namespace {
+
+    constexpr uint32_t SAMPLE_RATE_HZ = 16000;
+    constexpr uint32_t ITERATIONS = 20000;
+    constexpr uint32_t TEN_MS_IN_US = 10000;
+
+    typedef std::vector<std::vector<uint8_t>> Frames;
+
+    // One second of speech-like test signal
+    std::vector<int16_t> Signal(const uint32_t sampleRate, const uint8_t channels)
+    {
+        std::vector<int16_t> samples(sampleRate * channels);
+        for (uint32_t index = 0; index < sampleRate; index++) {
+            const double t = static_cast<double>(index) / sampleRate;
+            const double value = (6000.0 * std::sin(2.0 * M_PI * 220.0 * t)) + (3000.0 * std::sin(2.0 * M_PI * 1330.0 * t)) + (1000.0 * std::sin(2.0 * M_PI * 3100.0 * t));
+            for (uint8_t channel = 0; channel < channels; channel++) {
+                samples[(index * channels) + channel] = static_cast<int16_t>(value);
+            }
+        }
+        return (samples);
+    }
+
+    // Reference IMA ADPCM encoder, one block per 10 ms frame
+    Frames EncodeADPCM(const std::vector<int16_t>& samples)
+    {
+        static const int16_t steps[89] = {
+            7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+            50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+            337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+            2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+            15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+        };
+        static const int8_t indices[16] = { -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+
+        const uint32_t blockSamples = (SAMPLE_RATE_HZ / 100) + 1;
+        Frames frames;
+        int32_t index = 0;
+
+        for (uint32_t start = 0; (start + blockSamples) <= samples.size(); start += blockSamples) {
+            std::vector<uint8_t> frame(4 + ((blockSamples - 1) / 2));
+            int32_t predictor = samples[start];
+            frame[0] = static_cast<uint8_t>(predictor & 0xFF);
+            frame[1] = static_cast<uint8_t>((predictor >> 8) & 0xFF);
+            frame[2] = static_cast<uint8_t>(index);
+            frame[3] = 0;
+
+            for (uint32_t offset = 1; offset < blockSamples; offset++) {
+                int32_t step = steps[index];
+                int32_t difference = samples[start + offset] - predictor;
+                uint8_t code = 0;
+                if (difference < 0) {
+                    code = 8;
+                    difference = -difference;
+                }
+                int32_t delta = step >> 3;
+                for (uint8_t bit = 4; bit > 0; bit >>= 1) {
+                    if (difference >= step) {
+                        code |= bit;
+                        difference -= step;
+                        delta += step;
+                    }
+                    step >>= 1;
+                }
+                predictor = std::min<int32_t>(std::max<int32_t>((code & 8) ? (predictor - delta) : (predictor + delta), INT16_MIN), INT16_MAX);
+                index = std::min<int32_t>(std::max<int32_t>(index + indices[code], 0), 88);
+                frame[4 + ((offset - 1) / 2)] |= ((offset & 1) ? code : (code << 4));
+            }
+            frames.push_back(frame);
+        }
+        return (frames);
+    }
+
+#if defined(VOICE_CODEC_MSBC)
+    Frames EncodeMSBC(const std::vector<int16_t>& samples)
+    {
+        Frames frames;
+        sbc_t sbc;
+        sbc_init_msbc(&sbc, 0);
+        sbc.endian = SBC_LE;
+
+        const size_t codeSize = sbc_get_codesize(&sbc);
+        const uint8_t* input = reinterpret_cast<const uint8_t*>(samples.data());
+        for (size_t offset = 0; (offset + codeSize) <= (samples.size() * sizeof(int16_t)); offset += codeSize) {
+            std::vector<uint8_t> frame(sbc_get_frame_length(&sbc));
+            ssize_t written = 0;
+            if (sbc_encode(&sbc, &input[offset], codeSize, frame.data(), frame.size(), &written) > 0) {
+                frame.resize(written);
+                frames.push_back(frame);
+            }
+        }
+        sbc_finish(&sbc);
+        return (frames);
+    }
+#endif
+
+#if defined(VOICE_CODEC_OPUS)
+    Frames EncodeOpus(const std::vector<int16_t>& samples)
+    {
+        Frames frames;
+        int error = OPUS_OK;
+        OpusEncoder* encoder = opus_encoder_create(SAMPLE_RATE_HZ, 1, OPUS_APPLICATION_VOIP, &error);
+        const uint32_t frameSamples = SAMPLE_RATE_HZ / 100;
+
+        if (error == OPUS_OK) {
+            for (uint32_t offset = 0; (offset + frameSamples) <= samples.size(); offset += frameSamples) {
+                std::vector<uint8_t> frame(1275);
+                const opus_int32 written = opus_encode(encoder, &samples[offset], frameSamples, frame.data(), frame.size());
+                if (written > 0) {
+                    frame.resize(written);
+                    frames.push_back(frame);
+                }
+            }
+            opus_encoder_destroy(encoder);
+        }
+        return (frames);
+    }
+#endif
+
+    void Report(const char name[], const std::chrono::steady_clock::duration& elapsed, const uint32_t frames, const uint32_t frameDurationUs)
+    {
+        const double perFrame = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / frames;
+        printf("%-28s %10.0f ns per frame %10.0f ns per 10 ms\n", name, perFrame, (perFrame * TEN_MS_IN_US) / frameDurationUs);
+    }
+
+    uint32_t MeasureDecoder(const char name[], const VoiceDecoder::codec type, const Frames& frames, const uint32_t frameDurationUs)
+    {
+        VoiceDecoder decoder;
+        AudioFormat source{ AudioFormat::Encoding::LPCM, AudioFormat::Endianness::LITTLE, SAMPLE_RATE_HZ, 16, 1, true };
+        AudioFormat decoded;
+        uint32_t checksum = 0;
+
+        if ((frames.empty() == true) || (decoder.Configure(type, source, decoded) == false)) {
+            printf("%-28s skipped\n", name);
+        } else {
+            const auto start = std::chrono::steady_clock::now();
+            for (uint32_t index = 0; index < ITERATIONS; index++) {
+                const std::vector<uint8_t>& frame = frames[index % frames.size()];
+                checksum += decoder.Decode(frame.data(), static_cast<uint16_t>(frame.size()));
+                checksum += decoder.Buffer()[0];
+            }
+            Report(name, std::chrono::steady_clock::now() - start, ITERATIONS, frameDurationUs);
+        }
+        return (checksum);
+    }
+
+    uint32_t MeasureConverter(const char name[], const uint32_t sampleRate, const uint8_t channels)
+    {
+        AudioFormatConverter converter;
+        AudioFormat source{ AudioFormat::Encoding::LPCM, AudioFormat::Endianness::LITTLE, sampleRate, 16, channels, true };
+        const std::vector<int16_t> samples = Signal(sampleRate, channels);
+        const uint32_t frameLength = (sampleRate / 100) * channels * sizeof(int16_t);
+        uint32_t checksum = 0;
+
+        if (converter.Configure(source, frameLength) == true) {
+            std::vector<int16_t> output(converter.MaxOutput(frameLength));
+            const uint8_t* input = reinterpret_cast<const uint8_t*>(samples.data());
+            const uint32_t framesPerSecond = (samples.size() * sizeof(int16_t)) / frameLength;
+
+            const auto start = std::chrono::steady_clock::now();
+            for (uint32_t index = 0; index < ITERATIONS; index++) {
+                checksum += converter.Convert(&input[(index % framesPerSecond) * frameLength], frameLength, output.data());
+                checksum += output[0];
+            }
+            Report(name, std::chrono::steady_clock::now() - start, ITERATIONS, TEN_MS_IN_US);
+        }
+        return (checksum);
+    }
+
+} // namespace
+
+int main()
+{
+    const std::vector<int16_t> signal = Signal(SAMPLE_RATE_HZ, 1);
+    uint32_t checksum = 0;
+
+    checksum += MeasureDecoder("IMA ADPCM (10 ms blocks)", VoiceDecoder::ADPCM, EncodeADPCM(signal), TEN_MS_IN_US);
+#if defined(VOICE_CODEC_MSBC)
+    checksum += MeasureDecoder("mSBC (7.5 ms frames)", VoiceDecoder::MSBC, EncodeMSBC(signal), 7500);
+#else
+    printf("%-28s not compiled in\n", "mSBC");
+#endif
+#if defined(VOICE_CODEC_OPUS)
+    checksum += MeasureDecoder("Opus (10 ms frames)", VoiceDecoder::OPUS, EncodeOpus(signal), TEN_MS_IN_US);
+#else
+    printf("%-28s not compiled in\n", "Opus");
+#endif
+
+    checksum += MeasureConverter("Convert 48 kHz stereo", 48000, 2);
+    checksum += MeasureConverter("Convert 44.1 kHz mono", 44100, 1);
+    checksum += MeasureConverter("Convert 8 kHz mono", 8000, 1);
+
+    printf("checksum %u\n", checksum);
+
+    return (0);
+}
@@ -0,0 +1,712 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Replays recorded voice sessions through the ThunderVoiceHandler, the shared data stream, the keyword detector
+// and the reader of a hold-to-talk AudioProvider, with the original timing or faster.
+//
+//   AVSVoicePipelineBenchmark [--speed <factor>] [--batch <ms>] [--jitter <frames>] [--codec pcm|adpcm|msbc|opus] [--settle <ms>]
+//                             [--model <path/to/model> [--engine pryon|template]] session.rec ...
+//
+// Sessions are recorded by the plugin, one file each, with the voicerecording configuration. A speed of 1 keeps
+// the original timing, 2 replays twice as fast; at some speed the staging ring starts to drop frames. The sessions
+// are replayed one after the other, each one followed by the settle time for its audio to be written out.
+//
+// Frames the plugin dropped while the microphone was stopped are replayed to a stopped microphone as well. At the
+// end the first session is replayed once more, recorded, with the microphone stopped throughout; the benchmark exits
+// with 2 when that recording holds any of its audio.
+//
+// Every session is a hold-to-talk interaction. A stub interaction manager reads the stream from the start of
+// the interaction to its end, as the AudioInputProcessor does with the reader of its AudioProvider. With a model,
+// the keyword detector reads the stream as well.
+//
+// Reported per stage:
+//   Ingestion:  from the Data() call of a frame to its audio being in the stream, through the staging ring,
+//               the jitter buffer, the decoder and the batch. Frames are taken to be of equal duration.
+//   Recognize:  from the Data() call of a frame to the recognize request reading its audio, which adds the
+//               AudioProvider reader to the ingestion.
+//   Keyword:    audio written after the end of a keyword by the time it was detected.
+// The time audio is in the stream is taken by a thread waiting on the stream signal.
+
+#include "Module.h"
+#include "CompatibleAudioFormat.h"
+#include "StreamSettings.h"
+#include "StreamSignal.h"
+#include "ThunderVoiceHandler.h"
+#include "VoiceRecording.h"
+#if defined(KWD_SUPPORT)
+#include "KeywordDetector.h"
+
+#include <AVSCommon/Utils/Configuration/ConfigurationNode.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace WPEFramework::Plugin;
+using alexaClientSDK::avsCommon::avs::AudioInputStream;
+using alexaClientSDK::avsCommon::utils::AudioFormat;
+
+namespace {
+
+    typedef std::chrono::steady_clock Clock;
+
+    constexpr uint32_t SAMPLES_PER_MS = AudioFormatCompatibility::SAMPLE_RATE_HZ / 1000;
+    // The write log, the recognize request and the one taking over from it, the keyword detector
+    constexpr uint8_t STREAM_READERS = 4;
+    constexpr size_t PROVIDER_SAMPLES = 10 * SAMPLES_PER_MS;
+    constexpr std::chrono::milliseconds PROVIDER_TIMEOUT(100);
+    constexpr char CALLSIGN[] = "Replay";
+    // The muted session is replayed this much faster than recorded, none of its audio is decoded
+    constexpr double MUTED_SPEED = 100.0;
+    // Stands in for the audio of a frame the plugin dropped, it is only recorded as dropped
+    constexpr uint8_t GATED_FRAME[] = { 0 };
+
+    // Time the audio up to a stream index was written to the stream, or read from it
+    struct Written {
+        AudioInputStream::Index end;
+        Clock::time_point time;
+    };
+
+    // False if the audio up to the index never got there
+    bool Find(const std::vector<Written>& entries, const AudioInputStream::Index index, Clock::time_point& time)
+    {
+        auto entry = std::lower_bound(entries.begin(), entries.end(), index, [](const Written& written, const AudioInputStream::Index value) { return (written.end < value); });
+        if (entry != entries.end()) {
+            time = entry->time;
+        }
+        return (entry != entries.end());
+    }
+
+    class Latencies {
+    public:
+        void Add(const Clock::duration& latency)
+        {
+            m_values.push_back(std::chrono::duration<double, std::milli>(latency).count());
+        }
+
+        void Report(const char name[])
+        {
+            if (m_values.empty() == true) {
+                printf("%-14s no samples\n", name);
+            } else {
+                double total = 0;
+                std::sort(m_values.begin(), m_values.end());
+                for (const double value : m_values) {
+                    total += value;
+                }
+                printf("%-14s %.2f ms average, %.2f ms median, %.2f ms 99th percentile, %.2f ms max over %zu samples\n", name,
+                    total / m_values.size(), m_values[m_values.size() / 2], m_values[(m_values.size() * 99) / 100], m_values.back(), m_values.size());
+            }
+        }
+
+    private:
+        std::vector<double> m_values;
+    };
+
+    // Every write to the stream, as seen by a thread waiting on the stream signal
+    class WriteLog {
+    public:
+        WriteLog(const WriteLog&) = delete;
+        WriteLog& operator=(const WriteLog&) = delete;
+
+        WriteLog(std::shared_ptr<AudioInputStream> stream, std::shared_ptr<StreamSignal> signal)
+            : m_signal(signal)
+            , m_reader(stream->createReader(AudioInputStream::Reader::Policy::NONBLOCKING))
+            , m_lock()
+            , m_entries()
+            , m_isRunning(true)
+            , m_thread()
+        {
+            m_entries.reserve(1024 * 1024);
+            m_thread = std::thread(&WriteLog::Loop, this);
+        }
+
+        ~WriteLog()
+        {
+            m_isRunning = false;
+            m_signal->Raise();
+            m_thread.join();
+        }
+
+        AudioInputStream::Index End() const
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            return (m_entries.empty() == true ? 0 : m_entries.back().end);
+        }
+
+        // False if the audio up to the index never was in the stream
+        bool Time(const AudioInputStream::Index index, Clock::time_point& time) const
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            return (Find(m_entries, index, time));
+        }
+
+    private:
+        void Loop()
+        {
+            uint64_t count = m_signal->Count();
+
+            while (m_isRunning == true) {
+                m_reader->seek(0, AudioInputStream::Reader::Reference::BEFORE_WRITER);
+                const AudioInputStream::Index end = m_reader->tell();
+                const Clock::time_point now = Clock::now();
+                {
+                    std::lock_guard<std::mutex> lock(m_lock);
+                    if ((m_entries.empty() == true) || (end > m_entries.back().end)) {
+                        m_entries.push_back({ end, now });
+                    }
+                }
+                count = m_signal->Wait(count);
+            }
+        }
+
+    private:
+        const std::shared_ptr<StreamSignal> m_signal;
+        std::unique_ptr<AudioInputStream::Reader> m_reader;
+        mutable std::mutex m_lock;
+        std::vector<Written> m_entries;
+        std::atomic<bool> m_isRunning;
+        std::thread m_thread;
+    };
+
+    // Stands in for the interaction manager: a hold-to-talk interaction reads the stream from its start
+    // until its end, as the AudioInputProcessor does with the reader of a hold-to-talk AudioProvider
+    class ReplayInteraction {
+    public:
+        ReplayInteraction(const ReplayInteraction&) = delete;
+        ReplayInteraction& operator=(const ReplayInteraction&) = delete;
+
+        explicit ReplayInteraction(std::shared_ptr<AudioInputStream> stream)
+            : m_stream(stream)
+            , m_isHolding(false)
+            , m_thread()
+            , m_reads()
+            , m_samples(0)
+            , m_overruns(0)
+        {
+            m_reads.reserve(1024 * 1024);
+        }
+
+        ~ReplayInteraction()
+        {
+            m_isHolding = false;
+            Join();
+        }
+
+        // Called by the voice handler at the start and at the end of a session
+        void holdToggled()
+        {
+            if (m_isHolding == false) {
+                Join();
+                std::shared_ptr<AudioInputStream::Reader> reader = m_stream->createReader(AudioInputStream::Reader::Policy::BLOCKING);
+                if (reader) {
+                    reader->seek(0, AudioInputStream::Reader::Reference::BEFORE_WRITER);
+                    m_isHolding = true;
+                    m_thread = std::thread(&ReplayInteraction::RecognizeLoop, this, reader);
+                }
+            } else {
+                // Like stopping the capture, the reader takes what is in the stream by now and no more
+                m_isHolding = false;
+            }
+        }
+
+        // Read once no interaction is running
+        const std::vector<Written>& Reads() const
+        {
+            return (m_reads);
+        }
+
+        uint64_t Samples() const
+        {
+            return (m_samples);
+        }
+
+        uint32_t Overruns() const
+        {
+            return (m_overruns);
+        }
+
+        void Join()
+        {
+            if (m_thread.joinable() == true) {
+                m_thread.join();
+            }
+        }
+
+    private:
+        void RecognizeLoop(std::shared_ptr<AudioInputStream::Reader> reader)
+        {
+            int16_t samples[PROVIDER_SAMPLES];
+
+            while ((m_isHolding == true) || (reader->tell(AudioInputStream::Reader::Reference::BEFORE_WRITER) > 0)) {
+                const ssize_t read = reader->read(samples, PROVIDER_SAMPLES, PROVIDER_TIMEOUT);
+                if (read > 0) {
+                    m_samples += read;
+                    m_reads.push_back({ reader->tell(), Clock::now() });
+                } else if (read == AudioInputStream::Reader::Error::OVERRUN) {
+                    m_overruns++;
+                    reader->seek(0, AudioInputStream::Reader::Reference::BEFORE_WRITER);
+                } else if (read != AudioInputStream::Reader::Error::TIMEDOUT) {
+                    break;
+                }
+            }
+
+            reader->close();
+        }
+
+    private:
+        const std::shared_ptr<AudioInputStream> m_stream;
+        std::atomic<bool> m_isHolding;
+        std::thread m_thread;
+        std::vector<Written> m_reads;
+        uint64_t m_samples;
+        uint32_t m_overruns;
+    };
+
+    // The profile of a recorded session
+    class ReplayProfile : public WPEFramework::Exchange::IVoiceProducer::IProfile {
+    public:
+        explicit ReplayProfile(const VoiceSource::SessionFormat& format)
+            : m_format(format)
+        {
+        }
+
+        codec Codec() const override
+        {
+            return (static_cast<codec>(m_format.codec));
+        }
+
+        uint8_t Channels() const override
+        {
+            return (m_format.channels);
+        }
+
+        uint32_t SampleRate() const override
+        {
+            return (m_format.sampleRate);
+        }
+
+        uint8_t Resolution() const override
+        {
+            return (m_format.resolution);
+        }
+
+        BEGIN_INTERFACE_MAP(ReplayProfile)
+        INTERFACE_ENTRY(WPEFramework::Exchange::IVoiceProducer::IProfile)
+        END_INTERFACE_MAP
+
+    private:
+        const VoiceSource::SessionFormat m_format;
+    };
+
+} // namespace
+
+namespace WPEFramework {
+namespace Plugin {
+
+    template <>
+    inline void InteractionHandler<ReplayInteraction>::HoldToTalk()
+    {
+        if (m_interactionManager) {
+            m_interactionManager->holdToggled();
+        }
+    }
+
+} // namespace Plugin
+} // namespace WPEFramework
+
+namespace {
+
+    // A Data() call, its audio is at the place of its sequence number in the session
+    struct Frame {
+        Clock::time_point time;
+        uint32_t sequenceNo;
+    };
+
+    struct Session {
+        std::string path;
+        std::vector<VoiceRecording::Entry> entries;
+        // Filled in by the replay
+        Clock::time_point start;
+        std::vector<Frame> frames;
+        AudioInputStream::Index begin;
+        AudioInputStream::Index end;
+    };
+
+#if defined(KWD_SUPPORT)
+    class Observer : public alexaClientSDK::avsCommon::sdkInterfaces::KeyWordObserverInterface {
+    public:
+        void onKeyWordDetected(
+            std::shared_ptr<AudioInputStream> stream,
+            std::string keyword,
+            AudioInputStream::Index beginIndex,
+            AudioInputStream::Index endIndex,
+            std::shared_ptr<const std::vector<char>> KWDMetadata) override
+        {
+            m_detections++;
+        }
+
+        uint32_t Detections() const
+        {
+            return (m_detections);
+        }
+
+    private:
+        std::atomic<uint32_t> m_detections{ 0 };
+    };
+#endif
+
+    double CpuSeconds()
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+        return (now.tv_sec + (now.tv_nsec / 1e9));
+    }
+
+    void Usage(const char name[])
+    {
+        fprintf(stderr, "usage: %s [--speed <factor>] [--batch <ms>] [--jitter <frames>] [--codec pcm|adpcm|msbc|opus] [--settle <ms>] [--model <path/to/model> [--engine pryon|template]] session.rec ...\n", name);
+    }
+
+    // Calls the voice handler back as the voice producer did, speed times as fast. The microphone is stopped where
+    // the recording has frames dropped for it, and started again at the next frame that was not, unless it is muted.
+    void Replay(ThunderVoiceHandler<ReplayInteraction>& voiceHandler, WPEFramework::Exchange::IVoiceHandler& handler, Session& session, const double speed, const bool isMuted)
+    {
+        WPEFramework::Core::ProxyType<ReplayProfile> profile;
+        const Clock::time_point start = Clock::now();
+
+        session.start = start;
+        session.frames.reserve(session.entries.size());
+
+        for (const VoiceRecording::Entry& entry : session.entries) {
+            std::this_thread::sleep_until(start + std::chrono::microseconds(static_cast<uint64_t>(entry.time / speed)));
+
+            switch (entry.tag) {
+            case VoiceSource::STAGED_START: {
+                VoiceSource::SessionFormat format = { AudioFormatCompatibility::SAMPLE_RATE_HZ, AudioFormatCompatibility::NUM_CHANNELS, AudioFormatCompatibility::SAMPLE_SIZE_IN_BITS, WPEFramework::Exchange::IVoiceProducer::IProfile::PCM };
+                if (entry.data.size() == sizeof(format)) {
+                    ::memcpy(&format, entry.data.data(), sizeof(format));
+                }
+                profile = WPEFramework::Core::ProxyType<ReplayProfile>::Create(format);
+                handler.Start(&(*profile));
+                break;
+            }
+            case VoiceSource::STAGED_DATA:
+                if ((isMuted == false) && (voiceHandler.isStreaming() == false)) {
+                    voiceHandler.startStreamingMicrophoneData();
+                }
+                session.frames.push_back({ Clock::now(), entry.sequenceNo });
+                handler.Data(entry.sequenceNo, entry.data.data(), static_cast<uint16_t>(entry.data.size()));
+                break;
+            case VoiceSource::RECORDED_GATED:
+                if (voiceHandler.isStreaming() == true) {
+                    voiceHandler.stopStreamingMicrophoneData();
+                }
+                handler.Data(entry.sequenceNo, GATED_FRAME, sizeof(GATED_FRAME));
+                break;
+            case VoiceSource::STAGED_STOP:
+                handler.Stop();
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    // Replays a session to a stopped microphone with the voice recording on, and reads back what was recorded.
+    // False if nothing was recorded at all.
+    bool RecordMuted(std::shared_ptr<AudioInputStream> stream, std::shared_ptr<StreamSignal> signal, const AudioFormat& format, VoiceHandlerSettings settings, const Session& session, uint64_t& audio, uint32_t& gated)
+    {
+        char directory[] = "/tmp/avsmutedXXXXXX";
+        bool result = false;
+        audio = 0;
+        gated = 0;
+
+        if (::mkdtemp(directory) != nullptr) {
+            settings.recording = directory;
+
+            std::shared_ptr<ReplayInteraction> interaction = std::make_shared<ReplayInteraction>(stream);
+            std::shared_ptr<InteractionHandler<ReplayInteraction>> interactionHandler = InteractionHandler<ReplayInteraction>::Create();
+            interactionHandler->Initialize(interaction);
+
+            std::unique_ptr<ThunderVoiceHandler<ReplayInteraction>> voiceHandler = ThunderVoiceHandler<ReplayInteraction>::create(stream, signal, nullptr, CALLSIGN, interactionHandler, format, settings);
+            if (voiceHandler) {
+                Session muted = { session.path, session.entries, {}, {}, 0, 0 };
+                Replay(*voiceHandler, *(voiceHandler->Callback(CALLSIGN)), muted, MUTED_SPEED, true);
+                interaction->Join();
+                // The recording is written out before the handler is gone
+                voiceHandler.reset();
+            }
+            interactionHandler->Deinitialize();
+
+            DIR* listing = ::opendir(directory);
+            if (listing != nullptr) {
+                struct dirent* file;
+                while ((file = ::readdir(listing)) != nullptr) {
+                    if (file->d_name[0] != '.') {
+                        const std::string path = std::string(directory) + '/' + file->d_name;
+                        std::vector<VoiceRecording::Entry> entries;
+                        if (VoiceRecording::Load(path, entries) == true) {
+                            result = true;
+                            for (const VoiceRecording::Entry& entry : entries) {
+                                audio += (entry.tag != VoiceSource::STAGED_START ? entry.data.size() : 0);
+                                gated += (entry.tag == VoiceSource::RECORDED_GATED ? 1 : 0);
+                            }
+                        }
+                        ::unlink(path.c_str());
+                    }
+                }
+                ::closedir(listing);
+            }
+            ::rmdir(directory);
+        }
+
+        return (result);
+    }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    VoiceHandlerSettings settings;
+    double speed = 1.0;
+    uint32_t settleMs = 300;
+    std::string model;
+    std::vector<Session> sessions;
+#if defined(KWD_SUPPORT)
+    std::string engine = KeywordEngine::Default();
+#endif
+
+    for (int index = 1; index < argc; index++) {
+        const std::string option(argv[index]);
+        const bool hasValue = ((index + 1) < argc);
+        if ((option == "--speed") && (hasValue == true)) {
+            speed = atof(argv[++index]);
+        } else if ((option == "--batch") && (hasValue == true)) {
+            settings.batchDuration = static_cast<uint8_t>(std::min(255, std::max(0, atoi(argv[++index]))));
+        } else if ((option == "--jitter") && (hasValue == true)) {
+            settings.jitterWindow = static_cast<uint8_t>(std::min(255, std::max(0, atoi(argv[++index]))));
+        } else if ((option == "--codec") && (hasValue == true)) {
+            if (settings.Codec(argv[++index]) == false) {
+                Usage(argv[0]);
+                return (1);
+            }
+        } else if ((option == "--settle") && (hasValue == true)) {
+            settleMs = std::max(1, atoi(argv[++index]));
+        } else if ((option == "--model") && (hasValue == true)) {
+            model = argv[++index];
+#if defined(KWD_SUPPORT)
+        } else if ((option == "--engine") && (hasValue == true)) {
+            engine = argv[++index];
+#endif
+        } else if (option[0] != '-') {
+            sessions.push_back({ option, {}, {}, {}, 0, 0 });
+        } else {
+            Usage(argv[0]);
+            return (1);
+        }
+    }
+
+    if ((sessions.empty() == true) || (speed <= 0)) {
+        Usage(argv[0]);
+        return (1);
+    }
+
+    size_t frames = 0;
+    size_t dropped = 0;
+    uint64_t recorded = 0;
+    for (Session& session : sessions) {
+        if (VoiceRecording::Load(session.path, session.entries) == false) {
+            fprintf(stderr, "%s: not a voice recording\n", session.path.c_str());
+            return (1);
+        }
+        for (const VoiceRecording::Entry& entry : session.entries) {
+            frames += (entry.tag == VoiceSource::STAGED_DATA ? 1 : 0);
+            dropped += (entry.tag == VoiceSource::RECORDED_GATED ? 1 : 0);
+        }
+        recorded += (session.entries.empty() == true ? 0 : session.entries.back().time);
+    }
+
+    AudioFormat format{ AudioFormat::Encoding::LPCM, AudioFormat::Endianness::LITTLE, AudioFormatCompatibility::SAMPLE_RATE_HZ, AudioFormatCompatibility::SAMPLE_SIZE_IN_BITS, AudioFormatCompatibility::NUM_CHANNELS, true };
+    std::shared_ptr<AudioInputStream> stream = StreamSettings().Create(STREAM_READERS);
+    std::shared_ptr<StreamSignal> signal = std::make_shared<StreamSignal>();
+    if (!stream) {
+        fprintf(stderr, "Failed to create the shared data stream\n");
+        return (1);
+    }
+
+    printf("Sessions:      %zu, %zu frames, %zu dropped while the microphone was stopped, %.1f s as recorded\n", sessions.size(), frames, dropped, recorded / 1e6);
+    printf("Settings:      %g times the recorded speed, batch %u ms, jitter window %u frames\n", speed, settings.batchDuration, settings.jitterWindow);
+
+    WriteLog log(stream, signal);
+
+#if defined(KWD_SUPPORT)
+    std::shared_ptr<Observer> observer = std::make_shared<Observer>();
+    std::unique_ptr<KeywordDetector> detector;
+    if (model.empty() == false) {
+        // The detector picks its model through the locale configuration of the SDK, as in the keyword detector benchmark
+        if ((model.length() > 4) && (model.compare(model.length() - 4, 4, ".bin") == 0)) {
+            model.erase(model.length() - 4);
+        }
+        while ((model.length() > 1) && (model.back() == '/')) {
+            model.pop_back();
+        }
+        const size_t slash = model.find_last_of('/');
+        const std::string directory = ((slash == std::string::npos) ? std::string(".") : model.substr(0, slash));
+        const std::string name = model.substr((slash == std::string::npos) ? 0 : (slash + 1));
+        std::shared_ptr<std::istream> configuration(new std::stringstream("{\"alexa\":{\"en-US\":[\"" + name + "\"]}}"));
+        alexaClientSDK::avsCommon::utils::configuration::ConfigurationNode::initialize({ configuration });
+
+        KeywordDetectorSettings kwdSettings;
+        kwdSettings.engine = engine;
+        detector = KeywordDetector::create(stream, signal, format, { observer }, {}, directory, kwdSettings);
+        if (!detector) {
+            fprintf(stderr, "Failed to create the keyword detector for %s\n", model.c_str());
+            return (1);
+        }
+    }
+#else
+    if (model.empty() == false) {
+        fprintf(stderr, "Keyword detection is not compiled in\n");
+        return (1);
+    }
+#endif
+
+    std::shared_ptr<ReplayInteraction> interaction = std::make_shared<ReplayInteraction>(stream);
+    std::shared_ptr<InteractionHandler<ReplayInteraction>> interactionHandler = InteractionHandler<ReplayInteraction>::Create();
+    interactionHandler->Initialize(interaction);
+
+    std::unique_ptr<ThunderVoiceHandler<ReplayInteraction>> voiceHandler = ThunderVoiceHandler<ReplayInteraction>::create(stream, signal, nullptr, CALLSIGN, interactionHandler, format, settings);
+    if (!voiceHandler) {
+        fprintf(stderr, "Failed to create the voice handler\n");
+        return (1);
+    }
+    voiceHandler->startStreamingMicrophoneData();
+    WPEFramework::Exchange::IVoiceHandler* callback = voiceHandler->Callback(CALLSIGN);
+
+    const double cpuStart = CpuSeconds();
+
+    for (Session& session : sessions) {
+        session.begin = log.End();
+        Replay(*voiceHandler, *callback, session, speed, false);
+
+        // The audio of the session is written out, and read by the recognize request, before the next one starts
+        std::this_thread::sleep_for(std::chrono::milliseconds(settleMs));
+        interaction->Join();
+        session.end = log.End();
+    }
+
+    const double cpu = CpuSeconds() - cpuStart;
+    const VoiceSource::Totals totals = voiceHandler->Statistics();
+
+    voiceHandler.reset();
+    interactionHandler->Deinitialize();
+
+    // Lost frames are concealed, so the audio of a session spans its sequence numbers from the first frame on.
+    // The time is busy from the first callback of a session until its last audio is in the stream.
+    Latencies ingestion;
+    Latencies recognize;
+    uint64_t samples = 0;
+    double wall = 0;
+    for (const Session& session : sessions) {
+        const uint64_t count = session.end - session.begin;
+        Clock::time_point last;
+        uint64_t span = 0;
+        samples += count;
+
+        if ((count > 0) && (log.Time(session.end, last) == true)) {
+            wall += std::chrono::duration<double>(last - session.start).count();
+        }
+
+        for (const Frame& frame : session.frames) {
+            span = std::max<uint64_t>(span, static_cast<int32_t>(frame.sequenceNo - session.frames.front().sequenceNo) + 1);
+        }
+
+        for (const Frame& frame : session.frames) {
+            const int32_t place = static_cast<int32_t>(frame.sequenceNo - session.frames.front().sequenceNo);
+            if ((count > 0) && (place >= 0)) {
+                const AudioInputStream::Index end = session.begin + (((count * (place + 1)) + span - 1) / span);
+                // A frame that is late is dropped, its place was filled in before it came
+                Clock::time_point time;
+                if ((log.Time(end, time) == true) && (time >= frame.time)) {
+                    ingestion.Add(time - frame.time);
+                }
+                if ((Find(interaction->Reads(), end, time) == true) && (time >= frame.time)) {
+                    recognize.Add(time - frame.time);
+                }
+            }
+        }
+    }
+
+    const double seconds = static_cast<double>(samples) / AudioFormatCompatibility::SAMPLE_RATE_HZ;
+    printf("Throughput:    %.1f s of audio in %.2f s, real-time factor %.4f, %.0f frames per second\n", seconds, wall, (seconds > 0 ? wall / seconds : 0.0), (wall > 0 ? totals.received / wall : 0.0));
+    printf("CPU:           %.2f ms per second of audio\n", (seconds > 0 ? (cpu * 1000.0) / seconds : 0.0));
+    ingestion.Report("Ingestion:");
+    recognize.Report("Recognize:");
+    printf("Drops:         %u frames not staged, %u lost, %u late, %u duplicates of %u received in %u sessions\n",
+        totals.dropped, totals.lost, totals.late, totals.duplicates, totals.received, totals.sessions);
+    printf("Provider:      %.1f of %.1f s read by the recognize requests, %u overruns\n", static_cast<double>(interaction->Samples()) / AudioFormatCompatibility::SAMPLE_RATE_HZ, seconds, interaction->Overruns());
+
+#if defined(KWD_SUPPORT)
+    if (detector) {
+        KeywordTelemetry::Snapshot snapshot;
+        detector->Telemetry(snapshot);
+        uint32_t latencyTotal = 0;
+        uint32_t latencyMax = 0;
+        for (const KeywordTelemetry::Detection& detection : snapshot.detections) {
+            latencyTotal += detection.latency;
+            latencyMax = std::max(latencyMax, detection.latency);
+        }
+        printf("Keyword:       %u detections, %.2f ms of CPU per second of audio, %u overruns skipping %lld ms\n", observer->Detections(),
+            (seconds > 0 ? detector->DecodingTime().count() / seconds : 0.0), detector->Overruns(), static_cast<long long>(detector->OverrunTime().count()));
+        if (snapshot.detections.empty() == false) {
+            printf("Keyword:       %u ms average, %u ms max of audio written after the keyword by its detection\n",
+                static_cast<uint32_t>(latencyTotal / snapshot.detections.size()), latencyMax);
+        }
+        detector.reset();
+    }
+#endif
+
+    int exitCode = 0;
+    uint64_t audio;
+    uint32_t gated;
+    if (RecordMuted(stream, signal, format, settings, sessions.front(), audio, gated) == false) {
+        fprintf(stderr, "The session replayed with the microphone stopped was not recorded\n");
+        exitCode = 1;
+    } else {
+        printf("Muted:         %u frames recorded as dropped, %llu bytes of audio recorded\n", gated, static_cast<unsigned long long>(audio));
+        if (audio > 0) {
+            fprintf(stderr, "Audio was recorded while the microphone was stopped\n");
+            exitCode = 2;
+        }
+    }
+
+    return (exitCode);
+}
@@ -19,7 +19,7 @@
 
 #include "AVSDevice.h"
 
-#include "PryonKeywordDetector.h"
+#include "KeywordDetector.h"
 #include "ThunderLogger.h"
 #include "ThunderVoiceHandler.h"
 #include "TraceCategories.h"
@@ -59,13 +59,10 @@ namespace Plugin {
     static const std::string ENDPOINT_KEY("endpoint");
     static const std::string DISPLAY_CARD_KEY("displayCardsSupported");
 
-    // Share Data stream Configuraiton
-    static const size_t MAX_READERS = 10;
+    // Share Data stream Configuraiton, its size comes from StreamSettings
     static const size_t WORD_SIZE = 2;
     static const unsigned int SAMPLE_RATE_HZ = 16000;
     static const unsigned int NUM_CHANNELS = 1;
-    static const std::chrono::seconds AMOUNT_OF_AUDIO_DATA_IN_BUFFER = std::chrono::seconds(15);
-    static const size_t BUFFER_SIZE_IN_SAMPLES = (SAMPLE_RATE_HZ)*AMOUNT_OF_AUDIO_DATA_IN_BUFFER.count();
 
     // Thunder voice handler
     static constexpr const char* PORTAUDIO_CALLSIGN("PORTAUDIO");
@@ -108,21 +105,132 @@ namespace Plugin {
             status = false;
         }
 
+        VoiceHandlerSettings voiceSettings;
+        if (config.VoiceJitterWindow.IsSet() == true) {
+            voiceSettings.jitterWindow = config.VoiceJitterWindow.Value();
+        }
+        if (config.VoiceBatch.IsSet() == true) {
+            voiceSettings.batchDuration = config.VoiceBatch.Value();
+        }
+        if ((config.VoiceConcealment.IsSet() == true) && (voiceSettings.Concealment(config.VoiceConcealment.Value()) == false)) {
+            TRACE(AVSClient, (_T("Unknown voice concealment %s"), config.VoiceConcealment.Value().c_str()));
+            status = false;
+        }
+        if ((config.VoiceCodec.IsSet() == true) && (voiceSettings.Codec(config.VoiceCodec.Value()) == false)) {
+            TRACE(AVSClient, (_T("Unknown voice codec %s"), config.VoiceCodec.Value().c_str()));
+            status = false;
+        }
+        if ((config.VoiceTransport.IsSet() == true) && (voiceSettings.Transport(config.VoiceTransport.Value()) == false)) {
+            TRACE(AVSClient, (_T("Unknown voice transport %s"), config.VoiceTransport.Value().c_str()));
+            status = false;
+        }
+        if (config.VoiceSharedBuffer.IsSet() == true) {
+            voiceSettings.sharedBuffer = config.VoiceSharedBuffer.Value();
+        }
+        if ((config.VoiceMixing.IsSet() == true) && (voiceSettings.Mixing(config.VoiceMixing.Value()) == false)) {
+            TRACE(AVSClient, (_T("Unknown voice mixing %s"), config.VoiceMixing.Value().c_str()));
+            status = false;
+        }
+        if (voiceSettings.drainScheduling.Configure(config.VoiceScheduling) == false) {
+            TRACE(AVSClient, (_T("Invalid voice scheduling")));
+            status = false;
+        }
+        if ((config.VoiceRecording.IsSet() == true) && (config.VoiceRecording.Value().empty() == false)) {
+            voiceSettings.recording = config.VoiceRecording.Value();
+            if (Core::Directory(voiceSettings.recording.c_str()).CreatePath() == false) {
+                TRACE(AVSClient, (_T("Failed to create the voice recording directory %s"), voiceSettings.recording.c_str()));
+                status = false;
+            }
+        }
+
+        bool opusUplink = false;
+        if (config.UplinkCodec.IsSet() == true) {
+            const std::string uplinkCodec = config.UplinkCodec.Value();
+            if (uplinkCodec == _T("opus")) {
+#if defined(VOICE_CODEC_OPUS)
+                opusUplink = true;
+#else
+                TRACE(AVSClient, (_T("Requested Opus uplink, but it is not compiled in")));
+                status = false;
+#endif
+            } else if (uplinkCodec != _T("lpcm")) {
+                TRACE(AVSClient, (_T("Unknown uplink codec %s"), uplinkCodec.c_str()));
+                status = false;
+            }
+        }
+
         const bool enableKWD = config.EnableKWD.Value();
         if (enableKWD == true) {
-#if !defined(KWD_PRYON)
+#if !defined(KWD_SUPPORT)
             TRACE(AVSClient, (_T("Requested KWD, but it is not compiled in")));
             status = false;
 #endif
         }
 
+        KeywordDetectorSettings kwdSettings;
+#if defined(KWD_SUPPORT)
+        kwdSettings.engine = (config.KWDEngine.IsSet() == true ? config.KWDEngine.Value() : string(KeywordEngine::Default()));
+        if ((enableKWD == true) && (KeywordEngine::IsAvailable(kwdSettings.engine) == false)) {
+            TRACE(AVSClient, (_T("Keyword engine %s is not compiled in"), kwdSettings.engine.c_str()));
+            status = false;
+        }
+#endif
+        kwdSettings.locales = config.KWDLocales.Value();
+        kwdSettings.lockModels = config.KWDLockModels.Value();
+        if (kwdSettings.scheduling.Configure(config.KWDScheduling) == false) {
+            TRACE(AVSClient, (_T("Invalid keyword detection scheduling")));
+            status = false;
+        }
+
+        StreamSettings streamSettings;
+        if (config.StreamDuration.IsSet() == true) {
+            streamSettings.duration = config.StreamDuration.Value();
+        }
+        streamSettings.readers = config.StreamReaders.Value();
+        streamSettings.budget = config.StreamBudget.Value();
+        streamSettings.exportPath = config.StreamExport.Value();
+        if (streamSettings.duration < StreamSettings::MIN_DURATION) {
+            TRACE(AVSClient, (_T("Shared data stream must hold at least %u s of audio"), StreamSettings::MIN_DURATION));
+            status = false;
+        }
+
+        BlackBoxSettings blackBoxSettings;
+        blackBoxSettings.duration = config.BlackBoxDuration.Value();
+        if (config.BlackBoxFiles.IsSet() == true) {
+            blackBoxSettings.files = config.BlackBoxFiles.Value();
+        }
+        if (config.BlackBoxSize.IsSet() == true) {
+            blackBoxSettings.size = config.BlackBoxSize.Value();
+        }
+        blackBoxSettings.path = service->PersistentPath() + _T("blackbox");
+        if ((blackBoxSettings.duration != 0) && (blackBoxSettings.duration < BlackBox::MIN_DURATION)) {
+            TRACE(AVSClient, (_T("Black box snapshots must hold at least %u s of audio"), BlackBox::MIN_DURATION));
+            status = false;
+        }
+        if ((blackBoxSettings.duration != 0) && ((blackBoxSettings.files == 0) || (BlackBox::FileSize(blackBoxSettings.duration) > (static_cast<uint64_t>(blackBoxSettings.size) * 1024)))) {
+            TRACE(AVSClient, (_T("Black box limits do not leave room for a single snapshot")));
+            status = false;
+        }
+
+        const bool blackBox = (blackBoxSettings.duration != 0);
+        if ((streamSettings.readers != 0) && (streamSettings.readers < StreamSettings::Readers(enableKWD, opusUplink, blackBox))) {
+            TRACE(AVSClient, (_T("Shared data stream needs %u readers for the enabled features"), StreamSettings::Readers(enableKWD, opusUplink, blackBox)));
+            status = false;
+        }
+        // Against the audio the stream holds once the budget has cut it down
+        const size_t streamSamples = streamSettings.Samples(streamSettings.readers != 0 ? streamSettings.readers : StreamSettings::Readers(enableKWD, opusUplink, blackBox));
+        if ((blackBox == true) && ((static_cast<size_t>(blackBoxSettings.duration) * SAMPLE_RATE_HZ) >= streamSamples)) {
+            TRACE(AVSClient, (_T("Black box snapshots must hold less audio than the shared data stream, %u ms with its budget"), static_cast<uint32_t>((streamSamples * 1000) / SAMPLE_RATE_HZ)));
+            status = false;
+        }
+
         std::vector<std::shared_ptr<std::istream>> configJsonStreams;
         if ((status == true) && (JsonConfigToStream(configJsonStreams, alexaClientConfig) == false)) {
             TRACE(AVSClient, (_T("Failed to load alexaClientConfig")));
             status = false;
         }
 
-#if defined(KWD_PRYON)
+#if defined(KWD_SUPPORT)
         if (enableKWD) {
             if ((status == true) && (JsonConfigToStream(configJsonStreams, pathToInputFolder + "/localeToModels.json") == false)) {
                 TRACE(AVSClient, (_T("Failed to load localeToModels.json")));
@@ -136,13 +244,13 @@ namespace Plugin {
         }
 
         if (status == true) {
-            status = Init(audiosource, enableKWD, pathToInputFolder);
+            status = Init(audiosource, enableKWD, pathToInputFolder, kwdSettings, voiceSettings, opusUplink, streamSettings, blackBoxSettings);
         }
 
         return status;
     }
 
-    bool AVSDevice::Init(const std::string& audiosource, const bool enableKWD, const std::string& pathToInputFolder)
+    bool AVSDevice::Init(const std::string& audiosource, const bool enableKWD, const std::string& pathToInputFolder, const KeywordDetectorSettings& kwdSettings, const VoiceHandlerSettings& voiceSettings, const bool opusUplink, const StreamSettings& streamSettings, const BlackBoxSettings& blackBoxSettings)
     {
         auto config = avsCommon::utils::configuration::ConfigurationNode::getRoot();
 
@@ -399,15 +507,22 @@ namespace Plugin {
         }
 
         // Shared Data stream
-        size_t bufferSize = alexaClientSDK::avsCommon::avs::AudioInputStream::calculateBufferSize(
-            BUFFER_SIZE_IN_SAMPLES, WORD_SIZE, MAX_READERS);
-        auto buffer = std::make_shared<alexaClientSDK::avsCommon::avs::AudioInputStream::Buffer>(bufferSize);
-        std::shared_ptr<alexaClientSDK::avsCommon::avs::AudioInputStream> sharedDataStream = alexaClientSDK::avsCommon::avs::AudioInputStream::create(buffer, WORD_SIZE, MAX_READERS);
+        const uint8_t streamReaders = (streamSettings.readers != 0 ? streamSettings.readers : StreamSettings::Readers(enableKWD, opusUplink, (blackBoxSettings.duration != 0)));
+        std::shared_ptr<alexaClientSDK::avsCommon::avs::AudioInputStream> sharedDataStream = streamSettings.Create(streamReaders);
         if (!sharedDataStream) {
             TRACE(AVSClient, (_T("Failed to create sharedDataStream")));
             return false;
         }
 
+        // Black box, it also observes the keyword detector
+        if (blackBoxSettings.duration != 0) {
+            m_blackBox = BlackBox::create(sharedDataStream, blackBoxSettings);
+            if (!m_blackBox) {
+                TRACE(AVSClient, (_T("Failed to create m_blackBox")));
+                return false;
+            }
+        }
+
         // Audio providers
         alexaClientSDK::avsCommon::utils::AudioFormat compatibleAudioFormat;
         compatibleAudioFormat.sampleRateHz = SAMPLE_RATE_HZ;
@@ -416,24 +531,43 @@ namespace Plugin {
         compatibleAudioFormat.endianness = alexaClientSDK::avsCommon::utils::AudioFormat::Endianness::LITTLE;
         compatibleAudioFormat.encoding = alexaClientSDK::avsCommon::utils::AudioFormat::Encoding::LPCM;
 
+        // The Thunder voice handler signals its writes to the stream, the readers wait on it
+        std::shared_ptr<StreamSignal> streamSignal = (audiosource != PORTAUDIO_CALLSIGN ? std::make_shared<StreamSignal>() : nullptr);
+
+        // Recognize requests read the uplink stream, the wake word engine always reads the LPCM stream
+        std::shared_ptr<alexaClientSDK::avsCommon::avs::AudioInputStream> uplinkStream = sharedDataStream;
+        alexaClientSDK::avsCommon::utils::AudioFormat uplinkAudioFormat = compatibleAudioFormat;
+#if defined(VOICE_CODEC_OPUS)
+        if (opusUplink) {
+            m_opusUplinkEncoder = OpusUplinkEncoder::create(sharedDataStream, streamSignal, compatibleAudioFormat);
+            if (!m_opusUplinkEncoder) {
+                TRACE(AVSClient, (_T("Failed to create m_opusUplinkEncoder")));
+                return false;
+            }
+            uplinkStream = m_opusUplinkEncoder->stream();
+            uplinkAudioFormat = m_opusUplinkEncoder->format();
+            client->addAlexaDialogStateObserver(m_opusUplinkEncoder);
+        }
+#endif
+
         alexaClientSDK::capabilityAgents::aip::AudioProvider tapToTalkAudioProvider(
-            sharedDataStream,
-            compatibleAudioFormat,
+            uplinkStream,
+            uplinkAudioFormat,
             alexaClientSDK::capabilityAgents::aip::ASRProfile::NEAR_FIELD,
             true, // alwaysReadable
             true, // canOverride
             true); // canBeOverridden
 
         alexaClientSDK::capabilityAgents::aip::AudioProvider holdToTalkAudioProvider(
-            sharedDataStream,
-            compatibleAudioFormat,
+            uplinkStream,
+            uplinkAudioFormat,
             alexaClientSDK::capabilityAgents::aip::ASRProfile::CLOSE_TALK,
             false, // alwaysReadable
             true, // canOverride
             false); // canBeOverridden
 
         alexaClientSDK::capabilityAgents::aip::AudioProvider wakeWordAudioProvider(capabilityAgents::aip::AudioProvider::null());
-#if defined(KWD_PRYON)
+#if defined(KWD_SUPPORT)
         if (enableKWD) {
             wakeWordAudioProvider = alexaClientSDK::capabilityAgents::aip::AudioProvider(sharedDataStream,
                 compatibleAudioFormat,
@@ -451,18 +585,28 @@ namespace Plugin {
         if (audiosource == PORTAUDIO_CALLSIGN) {
 #if defined(PORTAUDIO)
             aspInput = sampleApp::PortAudioMicrophoneWrapper::create(sharedDataStream);
+            if (streamSettings.exportPath.empty() == false) {
+                TRACE(AVSClient, (_T("The stream is only exported with Thunder audio sources")));
+            }
 #else
             TRACE(AVSClient, (_T("Portaudio support is not compiled in")));
             return false;
 #endif
         } else {
+            if (streamSettings.exportPath.empty() == false) {
+                m_streamExport = std::make_shared<StreamExport>();
+                if (m_streamExport->Open(streamSettings.exportPath, sharedDataStream->getDataSize(), WORD_SIZE, SAMPLE_RATE_HZ, NUM_CHANNELS) == false) {
+                    TRACE(AVSClient, (_T("Failed to export the stream to %s"), streamSettings.exportPath.c_str()));
+                    return false;
+                }
+            }
             aspInputInteractionHandler = InteractionHandler<alexaClientSDK::sampleApp::InteractionManager>::Create();
             if (!aspInputInteractionHandler) {
                 TRACE(AVSClient, (_T("Failed to create aspInputInteractionHandler")));
                 return false;
             }
 
-            m_thunderVoiceHandler = ThunderVoiceHandler<alexaClientSDK::sampleApp::InteractionManager>::create(sharedDataStream, _service, audiosource, aspInputInteractionHandler, compatibleAudioFormat);
+            m_thunderVoiceHandler = ThunderVoiceHandler<alexaClientSDK::sampleApp::InteractionManager>::create(sharedDataStream, streamSignal, m_streamExport, _service, audiosource, aspInputInteractionHandler, compatibleAudioFormat, voiceSettings);
             aspInput = m_thunderVoiceHandler;
             aspInput->startStreamingMicrophoneData();
         }
@@ -472,16 +616,23 @@ namespace Plugin {
         }
 
         // Key Word Detection
-#if defined(KWD_PRYON)
+#if defined(KWD_SUPPORT)
         if (enableKWD) {
             auto keywordObserver = std::make_shared<alexaClientSDK::sampleApp::KeywordObserver>(client, wakeWordAudioProvider);
-            m_keywordDetector = PryonKeywordDetector::create(
+            std::unordered_set<std::shared_ptr<alexaClientSDK::avsCommon::sdkInterfaces::KeyWordObserverInterface>> keyWordObservers = { keywordObserver };
+            std::unordered_set<std::shared_ptr<alexaClientSDK::avsCommon::sdkInterfaces::KeyWordDetectorStateObserverInterface>> keyWordDetectorStateObservers;
+            if (m_blackBox) {
+                keyWordObservers.insert(m_blackBox);
+                keyWordDetectorStateObservers.insert(m_blackBox);
+            }
+            m_keywordDetector = KeywordDetector::create(
                 sharedDataStream,
+                streamSignal,
                 compatibleAudioFormat,
-                { keywordObserver },
-                std::unordered_set<
-                    std::shared_ptr<alexaClientSDK::avsCommon::sdkInterfaces::KeyWordDetectorStateObserverInterface>>(),
-                pathToInputFolder);
+                keyWordObservers,
+                keyWordDetectorStateObservers,
+                pathToInputFolder,
+                kwdSettings);
             if (!m_keywordDetector) {
                 TRACE(AVSClient, (_T("Failed to create m_keywordDetector")));
                 return false;
@@ -589,5 +740,84 @@ namespace Plugin {
             m_thunderVoiceHandler->stateChange(audiosource);
         }
     }
+
+    uint32_t AVSDevice::Export(string& path, uint64_t& capacity, uint64_t& written) const
+    {
+        uint32_t result = Core::ERROR_UNAVAILABLE;
+
+        if (m_streamExport) {
+            path = m_streamExport->Path();
+            capacity = m_streamExport->Capacity();
+            written = m_streamExport->Written();
+            result = Core::ERROR_NONE;
+        }
+
+        return result;
+    }
+
+    uint32_t AVSDevice::Snapshot(const string& reason)
+    {
+        uint32_t result = Core::ERROR_UNAVAILABLE;
+
+        if (m_blackBox) {
+            result = (m_blackBox->Snapshot(reason) == true ? Core::ERROR_NONE : Core::ERROR_INPROGRESS);
+        }
+
+        return result;
+    }
+
+#if defined(KWD_SUPPORT)
+    uint32_t AVSDevice::Models(const string& locales)
+    {
+        uint32_t result = Core::ERROR_UNAVAILABLE;
+
+        if (m_keywordDetector) {
+            KeywordDetector* detector = static_cast<KeywordDetector*>(m_keywordDetector.get());
+            result = (detector->SwapModels(locales) == true ? Core::ERROR_NONE : Core::ERROR_GENERAL);
+        }
+
+        return result;
+    }
+
+    uint32_t AVSDevice::Threshold(const string& keyword, const uint32_t threshold)
+    {
+        uint32_t result = Core::ERROR_UNAVAILABLE;
+
+        if (m_keywordDetector) {
+            KeywordDetector* detector = static_cast<KeywordDetector*>(m_keywordDetector.get());
+            result = (detector->Threshold(keyword, threshold) == true ? Core::ERROR_NONE : Core::ERROR_BAD_REQUEST);
+        }
+
+        return result;
+    }
+
+    uint32_t AVSDevice::Telemetry(KeywordTelemetry::Snapshot& snapshot) const
+    {
+        uint32_t result = Core::ERROR_UNAVAILABLE;
+
+        if (m_keywordDetector) {
+            const KeywordDetector* detector = static_cast<const KeywordDetector*>(m_keywordDetector.get());
+            detector->Telemetry(snapshot);
+            result = Core::ERROR_NONE;
+        }
+
+        return result;
+    }
+#else
+    uint32_t AVSDevice::Models(const string& /*locales*/)
+    {
+        return Core::ERROR_UNAVAILABLE;
+    }
+
+    uint32_t AVSDevice::Threshold(const string& /*keyword*/, const uint32_t /*threshold*/)
+    {
+        return Core::ERROR_UNAVAILABLE;
+    }
+
+    uint32_t AVSDevice::Telemetry(KeywordTelemetry::Snapshot& /*snapshot*/) const
+    {
+        return Core::ERROR_UNAVAILABLE;
+    }
+#endif
 }
 }
@@ -19,8 +19,17 @@
 
 #pragma once
 
+#include "BlackBox.h"
+#include "IBlackBox.h"
+#include "IKeywordDetector.h"
+#include "IStreamExport.h"
+#include "KeywordDetectorSettings.h"
+#include "StreamSettings.h"
 #include "ThunderInputManager.h"
 #include "ThunderVoiceHandler.h"
+#if defined(VOICE_CODEC_OPUS)
+#include "OpusUplinkEncoder.h"
+#endif
 
 #include <WPEFramework/interfaces/IAVSClient.h>
 
@@ -34,12 +43,17 @@ namespace Plugin {
 
     class AVSDevice
         : public WPEFramework::Exchange::IAVSClient,
+          public IKeywordDetector,
+          public IStreamExport,
+          public IBlackBox,
           private alexaClientSDK::sampleApp::SampleApplication {
     public:
         AVSDevice()
             : _service(nullptr)
             , m_thunderInputManager(nullptr)
             , m_thunderVoiceHandler(nullptr)
+            , m_streamExport(nullptr)
+            , m_blackBox(nullptr)
         {
         }
 
@@ -61,12 +75,54 @@ namespace Plugin {
                 , LogLevel()
                 , KWDModelsPath()
                 , EnableKWD()
+                , KWDEngine()
+                , KWDLocales()
+                , KWDLockModels()
+                , KWDScheduling()
+                , VoiceJitterWindow()
+                , VoiceConcealment()
+                , VoiceCodec()
+                , UplinkCodec()
+                , VoiceBatch()
+                , VoiceTransport()
+                , VoiceSharedBuffer()
+                , VoiceMixing()
+                , VoiceScheduling()
+                , VoiceRecording()
+                , StreamDuration()
+                , StreamReaders()
+                , StreamBudget()
+                , StreamExport()
+                , BlackBoxDuration()
+                , BlackBoxFiles()
+                , BlackBoxSize()
             {
                 Add(_T("audiosource"), &Audiosource);
                 Add(_T("alexaclientconfig"), &AlexaClientConfig);
                 Add(_T("loglevel"), &LogLevel);
                 Add(_T("kwdmodelspath"), &KWDModelsPath);
                 Add(_T("enablekwd"), &EnableKWD);
+                Add(_T("kwdengine"), &KWDEngine);
+                Add(_T("kwdlocales"), &KWDLocales);
+                Add(_T("kwdlockmodels"), &KWDLockModels);
+                Add(_T("kwdscheduling"), &KWDScheduling);
+                Add(_T("voicejitterwindow"), &VoiceJitterWindow);
+                Add(_T("voiceconcealment"), &VoiceConcealment);
+                Add(_T("voicecodec"), &VoiceCodec);
+                Add(_T("uplinkcodec"), &UplinkCodec);
+                Add(_T("voicebatch"), &VoiceBatch);
+                Add(_T("voicetransport"), &VoiceTransport);
+                Add(_T("voicesharedbuffer"), &VoiceSharedBuffer);
+                Add(_T("voicemixing"), &VoiceMixing);
+                Add(_T("voicescheduling"), &VoiceScheduling);
+                Add(_T("voicerecording"), &VoiceRecording);
+                Add(_T("streamduration"), &StreamDuration);
+                Add(_T("streamreaders"), &StreamReaders);
+                Add(_T("streambudget"), &StreamBudget);
+                Add(_T("streamexport"), &StreamExport);
+                Add(_T("blackboxduration"), &BlackBoxDuration);
+                Add(_T("blackboxfiles"), &BlackBoxFiles);
+                Add(_T("blackboxsize"), &BlackBoxSize);
             }
 
             ~Config() = default;
@@ -77,6 +133,27 @@ namespace Plugin {
             WPEFramework::Core::JSON::String LogLevel;
             WPEFramework::Core::JSON::String KWDModelsPath;
             WPEFramework::Core::JSON::Boolean EnableKWD;
+            WPEFramework::Core::JSON::String KWDEngine;
+            WPEFramework::Core::JSON::String KWDLocales;
+            WPEFramework::Core::JSON::Boolean KWDLockModels;
+            ThreadScheduling::Config KWDScheduling;
+            WPEFramework::Core::JSON::DecUInt8 VoiceJitterWindow;
+            WPEFramework::Core::JSON::String VoiceConcealment;
+            WPEFramework::Core::JSON::String VoiceCodec;
+            WPEFramework::Core::JSON::String UplinkCodec;
+            WPEFramework::Core::JSON::DecUInt8 VoiceBatch;
+            WPEFramework::Core::JSON::String VoiceTransport;
+            WPEFramework::Core::JSON::String VoiceSharedBuffer;
+            WPEFramework::Core::JSON::String VoiceMixing;
+            ThreadScheduling::Config VoiceScheduling;
+            WPEFramework::Core::JSON::String VoiceRecording;
+            WPEFramework::Core::JSON::DecUInt8 StreamDuration;
+            WPEFramework::Core::JSON::DecUInt8 StreamReaders;
+            WPEFramework::Core::JSON::DecUInt32 StreamBudget;
+            WPEFramework::Core::JSON::String StreamExport;
+            WPEFramework::Core::JSON::DecUInt8 BlackBoxDuration;
+            WPEFramework::Core::JSON::DecUInt16 BlackBoxFiles;
+            WPEFramework::Core::JSON::DecUInt32 BlackBoxSize;
         };
 
     public:
@@ -85,12 +162,23 @@ namespace Plugin {
         Exchange::IAVSController* Controller() override;
         void StateChange(PluginHost::IShell* audioSource) override;
 
+        uint32_t Models(const string& locales) override;
+        uint32_t Threshold(const string& keyword, const uint32_t threshold) override;
+        uint32_t Telemetry(KeywordTelemetry::Snapshot& snapshot) const override;
+
+        uint32_t Export(string& path, uint64_t& capacity, uint64_t& written) const override;
+
+        uint32_t Snapshot(const string& reason) override;
+
         BEGIN_INTERFACE_MAP(AVSDevice)
         INTERFACE_ENTRY(WPEFramework::Exchange::IAVSClient)
+        INTERFACE_ENTRY(IKeywordDetector)
+        INTERFACE_ENTRY(IStreamExport)
+        INTERFACE_ENTRY(IBlackBox)
         END_INTERFACE_MAP
 
     private:
-        bool Init(const std::string& audiosource, const bool enableKWD, const std::string& pathToInputFolder);
+        bool Init(const std::string& audiosource, const bool enableKWD, const std::string& pathToInputFolder, const KeywordDetectorSettings& kwdSettings, const VoiceHandlerSettings& voiceSettings, const bool opusUplink, const StreamSettings& streamSettings, const BlackBoxSettings& blackBoxSettings);
         bool InitSDKLogs(const string& logLevel);
         bool JsonConfigToStream(std::vector<std::shared_ptr<std::istream>>& streams, const std::string& configFile);
 
@@ -98,8 +186,13 @@ namespace Plugin {
         WPEFramework::PluginHost::IShell* _service;
         std::shared_ptr<ThunderInputManager> m_thunderInputManager;
         std::shared_ptr<ThunderVoiceHandler<alexaClientSDK::sampleApp::InteractionManager>> m_thunderVoiceHandler;
-#if defined(KWD_PRYON)
+        std::shared_ptr<StreamExport> m_streamExport;
+        std::shared_ptr<BlackBox> m_blackBox;
+#if defined(KWD_SUPPORT)
         std::unique_ptr<alexaClientSDK::kwd::AbstractKeywordDetector> m_keywordDetector;
+#endif
+#if defined(VOICE_CODEC_OPUS)
+        std::shared_ptr<OpusUplinkEncoder> m_opusUplinkEncoder;
 #endif
     };
 
@@ -0,0 +1,321 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "AudioFormatConverter.h"
+
+#include "CompatibleAudioFormat.h"
+#include "TraceCategories.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+namespace WPEFramework {
+namespace Plugin {
+
+    using namespace alexaClientSDK::avsCommon::utils;
+
+    // Taps per polyphase branch, a multiple of 8 so the vector kernels need no tail handling
+    static constexpr uint32_t TAPS_INTERPOLATING = 16;
+    static constexpr uint32_t TAPS_DECIMATING = 32;
+    // Fraction of the lower Nyquist frequency that is kept
+    static constexpr double PASSBAND = 0.9;
+    static constexpr uint32_t MAX_PHASES = 512;
+    static constexpr uint8_t MAX_CHANNELS = 8;
+
+    static inline int16_t Swap(const int16_t sample)
+    {
+        const uint16_t value = static_cast<uint16_t>(sample);
+        return (static_cast<int16_t>((value << 8) | (value >> 8)));
+    }
+
+    static inline int16_t Saturate(const int32_t value)
+    {
+        return (static_cast<int16_t>(std::min<int32_t>(std::max<int32_t>(value, INT16_MIN), INT16_MAX)));
+    }
+
+    // -------------------------------------------------------------------------------------------
+    // Channel/endianness kernels, all of them produce native (little-endian) mono samples
+    // -------------------------------------------------------------------------------------------
+
+    static void MonoNative(const uint8_t input[], int16_t output[], const uint32_t frames, const uint8_t)
+    {
+        ::memcpy(output, input, frames * sizeof(int16_t));
+    }
+
+    static void MonoSwapped(const uint8_t input[], int16_t output[], const uint32_t frames, const uint8_t)
+    {
+        const int16_t* samples = reinterpret_cast<const int16_t*>(input);
+        uint32_t index = 0;
+#if defined(__SSE2__)
+        for (; (index + 8) <= frames; index += 8) {
+            const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&samples[index]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&output[index]), _mm_or_si128(_mm_slli_epi16(value, 8), _mm_srli_epi16(value, 8)));
+        }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+        for (; (index + 8) <= frames; index += 8) {
+            const uint8x16_t value = vld1q_u8(&input[index * sizeof(int16_t)]);
+            vst1q_s16(&output[index], vreinterpretq_s16_u8(vrev16q_u8(value)));
+        }
+#endif
+        for (; index < frames; index++) {
+            output[index] = Swap(samples[index]);
+        }
+    }
+
+    static void StereoNative(const uint8_t input[], int16_t output[], const uint32_t frames, const uint8_t)
+    {
+        const int16_t* samples = reinterpret_cast<const int16_t*>(input);
+        uint32_t index = 0;
+#if defined(__SSE2__)
+        const __m128i ones = _mm_set1_epi16(1);
+        for (; (index + 8) <= frames; index += 8) {
+            // Pairwise sum of left and right, then halve
+            const __m128i low = _mm_srai_epi32(_mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&samples[index * 2])), ones), 1);
+            const __m128i high = _mm_srai_epi32(_mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&samples[(index * 2) + 8])), ones), 1);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&output[index]), _mm_packs_epi32(low, high));
+        }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+        for (; (index + 8) <= frames; index += 8) {
+            const int16x8x2_t value = vld2q_s16(&samples[index * 2]);
+            vst1q_s16(&output[index], vhaddq_s16(value.val[0], value.val[1]));
+        }
+#endif
+        for (; index < frames; index++) {
+            output[index] = static_cast<int16_t>((static_cast<int32_t>(samples[index * 2]) + samples[(index * 2) + 1]) >> 1);
+        }
+    }
+
+    template <bool SWAPPED>
+    static void MultiChannel(const uint8_t input[], int16_t output[], const uint32_t frames, const uint8_t channels)
+    {
+        const int16_t* samples = reinterpret_cast<const int16_t*>(input);
+        for (uint32_t index = 0; index < frames; index++) {
+            int32_t sum = 0;
+            for (uint8_t channel = 0; channel < channels; channel++) {
+                const int16_t sample = samples[(index * channels) + channel];
+                sum += (SWAPPED ? Swap(sample) : sample);
+            }
+            output[index] = static_cast<int16_t>(sum / channels);
+        }
+    }
+
+    // -------------------------------------------------------------------------------------------
+    // FIR dot product kernels, taps is always a multiple of 8
+    // -------------------------------------------------------------------------------------------
+
+#if defined(__SSE2__)
+    static int32_t DotSSE2(const int16_t samples[], const int16_t coefficients[], const uint32_t taps)
+    {
+        __m128i sum = _mm_setzero_si128();
+        for (uint32_t index = 0; index < taps; index += 8) {
+            const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&samples[index]));
+            const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&coefficients[index]));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(x, h));
+        }
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+        return (_mm_cvtsi128_si32(sum));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    static int32_t DotNEON(const int16_t samples[], const int16_t coefficients[], const uint32_t taps)
+    {
+        int32x4_t sum = vdupq_n_s32(0);
+        for (uint32_t index = 0; index < taps; index += 8) {
+            const int16x8_t x = vld1q_s16(&samples[index]);
+            const int16x8_t h = vld1q_s16(&coefficients[index]);
+            sum = vmlal_s16(sum, vget_low_s16(x), vget_low_s16(h));
+            sum = vmlal_s16(sum, vget_high_s16(x), vget_high_s16(h));
+        }
+        const int32x2_t pair = vadd_s32(vget_low_s32(sum), vget_high_s32(sum));
+        return (vget_lane_s32(vpadd_s32(pair, pair), 0));
+    }
+#else
+    static int32_t DotScalar(const int16_t samples[], const int16_t coefficients[], const uint32_t taps)
+    {
+        int32_t sum = 0;
+        for (uint32_t index = 0; index < taps; index++) {
+            sum += static_cast<int32_t>(samples[index]) * coefficients[index];
+        }
+        return (sum);
+    }
+#endif
+
+    static uint32_t GreatestCommonDivisor(uint32_t a, uint32_t b)
+    {
+        while (b != 0) {
+            const uint32_t rest = a % b;
+            a = b;
+            b = rest;
+        }
+        return (a);
+    }
+
+    AudioFormatConverter::AudioFormatConverter()
+        : m_frameSize{ sizeof(int16_t) }
+        , m_channels{ 1 }
+        , m_interpolation{ 1 }
+        , m_decimation{ 1 }
+        , m_taps{ 0 }
+        , m_toMono{ MonoNative }
+#if defined(__SSE2__)
+        , m_dot{ DotSSE2 }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+        , m_dot{ DotNEON }
+#else
+        , m_dot{ DotScalar }
+#endif
+        , m_convert{ &AudioFormatConverter::ConvertDirect }
+        , m_coefficients()
+        , m_nextPhase()
+        , m_advance()
+        , m_history()
+        , m_phase{ 0 }
+        , m_index{ 0 }
+    {
+    }
+
+    bool AudioFormatConverter::Configure(const AudioFormat& source, const uint32_t maxInputLength)
+    {
+        if (AudioFormatCompatibility::IsConvertible(source) == false) {
+            TRACE(AVSClient, (_T("Unsupported source format: %u Hz, %u bits, %u channels"), source.sampleRateHz, source.sampleSizeInBits, source.numChannels));
+            return false;
+        }
+
+        const uint32_t divisor = GreatestCommonDivisor(AudioFormatCompatibility::SAMPLE_RATE_HZ, source.sampleRateHz);
+        if (((AudioFormatCompatibility::SAMPLE_RATE_HZ / divisor) > MAX_PHASES) || (source.numChannels > MAX_CHANNELS)) {
+            TRACE(AVSClient, (_T("Unsupported source format: %u Hz, %u channels"), source.sampleRateHz, source.numChannels));
+            return false;
+        }
+
+        const bool swapped = (source.endianness != AudioFormatCompatibility::ENDIANESS);
+
+        m_channels = static_cast<uint8_t>(source.numChannels);
+        m_frameSize = static_cast<uint16_t>(m_channels * sizeof(int16_t));
+        m_interpolation = AudioFormatCompatibility::SAMPLE_RATE_HZ / divisor;
+        m_decimation = source.sampleRateHz / divisor;
+
+        if (m_channels == 1) {
+            m_toMono = (swapped ? MonoSwapped : MonoNative);
+        } else if ((m_channels == 2) && (swapped == false)) {
+            m_toMono = StereoNative;
+        } else {
+            m_toMono = (swapped ? &MultiChannel<true> : &MultiChannel<false>);
+        }
+
+        if ((m_interpolation == 1) && (m_decimation == 1)) {
+            m_taps = 0;
+            m_coefficients.clear();
+            m_history.clear();
+            m_convert = &AudioFormatConverter::ConvertDirect;
+        } else {
+            m_taps = ((m_interpolation > m_decimation) ? TAPS_INTERPOLATING : TAPS_DECIMATING);
+            DesignFilter();
+            m_history.assign((m_taps - 1) + (maxInputLength / m_frameSize), 0);
+            m_convert = &AudioFormatConverter::ConvertResampled;
+        }
+
+        Reset();
+
+        TRACE(AVSClient, (_T("Audio conversion: %u Hz/%u channels/%s endian -> %u Hz mono, %u/%u polyphase with %u taps"),
+            source.sampleRateHz, m_channels, (swapped ? _T("swapped") : _T("native")), AudioFormatCompatibility::SAMPLE_RATE_HZ,
+            m_interpolation, m_decimation, m_taps));
+
+        return true;
+    }
+
+    void AudioFormatConverter::Reset()
+    {
+        std::fill(m_history.begin(), m_history.end(), 0);
+        m_phase = 0;
+        m_index = ((m_taps > 0) ? (m_taps - 1) : 0);
+    }
+
+    // Windowed-sinc prototype at the interpolated rate, split into its polyphase branches
+    void AudioFormatConverter::DesignFilter()
+    {
+        const uint32_t length = m_taps * m_interpolation;
+        const double cutoff = (0.5 * PASSBAND) / std::max(m_interpolation, m_decimation);
+        const double center = (length - 1) / 2.0;
+        std::vector<double> prototype(length);
+        double sum = 0.0;
+
+        for (uint32_t index = 0; index < length; index++) {
+            const double t = index - center;
+            const double sinc = ((t == 0.0) ? (2.0 * cutoff) : (std::sin(2.0 * M_PI * cutoff * t) / (M_PI * t)));
+            const double window = 0.42 - (0.5 * std::cos((2.0 * M_PI * index) / (length - 1))) + (0.08 * std::cos((4.0 * M_PI * index) / (length - 1)));
+            prototype[index] = sinc * window;
+            sum += prototype[index];
+        }
+
+        // Unity gain on every branch after zero stuffing
+        const double gain = m_interpolation / sum;
+
+        m_coefficients.assign(length, 0);
+        m_nextPhase.resize(m_interpolation);
+        m_advance.resize(m_interpolation);
+
+        for (uint32_t phase = 0; phase < m_interpolation; phase++) {
+            for (uint32_t tap = 0; tap < m_taps; tap++) {
+                const double value = prototype[phase + ((m_taps - 1 - tap) * m_interpolation)] * gain * 32768.0;
+                m_coefficients[(phase * m_taps) + tap] = Saturate(static_cast<int32_t>(std::lround(value)));
+            }
+            m_nextPhase[phase] = static_cast<uint16_t>((phase + m_decimation) % m_interpolation);
+            m_advance[phase] = static_cast<uint8_t>((phase + m_decimation) / m_interpolation);
+        }
+    }
+
+    uint32_t AudioFormatConverter::ConvertDirect(const uint8_t input[], const uint32_t frames, int16_t output[])
+    {
+        m_toMono(input, output, frames, m_channels);
+        return (frames);
+    }
+
+    uint32_t AudioFormatConverter::ConvertResampled(const uint8_t input[], const uint32_t frames, int16_t output[])
+    {
+        const uint32_t keep = m_taps - 1;
+        const uint32_t available = keep + frames;
+        int16_t* samples = m_history.data();
+        uint32_t produced = 0;
+
+        m_toMono(input, &samples[keep], frames, m_channels);
+
+        while (m_index < available) {
+            const int32_t sum = m_dot(&samples[m_index - keep], &m_coefficients[m_phase * m_taps], m_taps);
+            output[produced++] = Saturate((sum + (1 << 14)) >> 15);
+            m_index += m_advance[m_phase];
+            m_phase = m_nextPhase[m_phase];
+        }
+
+        // Keep the tail as history for the next chunk
+        ::memmove(samples, &samples[available - keep], keep * sizeof(int16_t));
+        m_index -= (available - keep);
+
+        return (produced);
+    }
+
+} // namespace Plugin
+} // namespace WPEFramework
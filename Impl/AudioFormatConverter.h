@@ -0,0 +1,95 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <AVSCommon/Utils/AudioFormat.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    /// Converts 16-bit LPCM of any supported rate, channel count and endianness into the
+    /// 16 kHz/16-bit/mono/little-endian format of the SDS.
+    /// All kernels are selected once in Configure(), Convert() only calls through them.
+    class AudioFormatConverter {
+    public:
+        AudioFormatConverter(const AudioFormatConverter&) = delete;
+        AudioFormatConverter& operator=(const AudioFormatConverter&) = delete;
+
+        AudioFormatConverter();
+        ~AudioFormatConverter() = default;
+
+    public:
+        // maxInputLength is the largest chunk (in bytes) that will be passed to Convert()
+        bool Configure(const alexaClientSDK::avsCommon::utils::AudioFormat& source, const uint32_t maxInputLength);
+
+        // Converts the whole source frames in input, returns the number of samples written to output.
+        // Output must have room for MaxOutput(length) samples.
+        uint32_t Convert(const uint8_t input[], const uint32_t length, int16_t output[])
+        {
+            return ((this->*m_convert)(input, length / m_frameSize, output));
+        }
+
+        uint32_t MaxOutput(const uint32_t length) const
+        {
+            return (static_cast<uint32_t>(((static_cast<uint64_t>(length / m_frameSize) * m_interpolation) / m_decimation) + 2));
+        }
+
+        // Size in bytes of one source frame (all channels of one sample)
+        uint16_t FrameSize() const
+        {
+            return (m_frameSize);
+        }
+
+        void Reset();
+
+    private:
+        typedef void (*MonoKernel)(const uint8_t input[], int16_t output[], const uint32_t frames, const uint8_t channels);
+        typedef int32_t (*DotKernel)(const int16_t samples[], const int16_t coefficients[], const uint32_t taps);
+
+        uint32_t ConvertDirect(const uint8_t input[], const uint32_t frames, int16_t output[]);
+        uint32_t ConvertResampled(const uint8_t input[], const uint32_t frames, int16_t output[]);
+
+        void DesignFilter();
+
+    private:
+        uint16_t m_frameSize;
+        uint8_t m_channels;
+        uint32_t m_interpolation;
+        uint32_t m_decimation;
+        uint32_t m_taps;
+        MonoKernel m_toMono;
+        DotKernel m_dot;
+        uint32_t (AudioFormatConverter::*m_convert)(const uint8_t input[], const uint32_t frames, int16_t output[]);
+
+        // Polyphase filter, m_taps coefficients per phase, stored in reversed order
+        std::vector<int16_t> m_coefficients;
+        std::vector<uint16_t> m_nextPhase;
+        std::vector<uint8_t> m_advance;
+        // Last (m_taps - 1) input samples followed by the samples being converted
+        std::vector<int16_t> m_history;
+        uint32_t m_phase;
+        uint32_t m_index;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
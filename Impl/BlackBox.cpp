@@ -0,0 +1,330 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BlackBox.h"
+
+#include "CompatibleAudioFormat.h"
+#include "ThreadScheduling.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    using namespace alexaClientSDK::avsCommon::avs;
+    using namespace alexaClientSDK::avsCommon::sdkInterfaces;
+
+    static constexpr uint32_t WAV_HEADER_SIZE = 44;
+    static constexpr uint32_t BYTES_PER_SAMPLE = AudioFormatCompatibility::SAMPLE_SIZE_IN_BITS / 8;
+    // The snapshot is written between everything else
+    static constexpr int8_t RECORDING_NICE = 19;
+    // Gives up on the audio after the event when the microphone stops
+    static const std::chrono::milliseconds TIMEOUT_FOR_READ_CALLS = std::chrono::milliseconds(100);
+    static const std::chrono::seconds CAPTURE_SLACK = std::chrono::seconds(2);
+
+    static const char* FILE_PREFIX = "blackbox-";
+    static const char* FILE_SUFFIX = ".wav";
+
+    static void PutLE(uint8_t destination[], const uint32_t value, const uint8_t bytes)
+    {
+        for (uint8_t index = 0; index < bytes; index++) {
+            destination[index] = static_cast<uint8_t>(value >> (8 * index));
+        }
+    }
+
+    std::shared_ptr<BlackBox> BlackBox::create(std::shared_ptr<AudioInputStream> stream, const BlackBoxSettings& settings)
+    {
+        if (!stream) {
+            TRACE_GLOBAL(AVSClient, (_T("Failed to create BlackBox: stream is nullptr")));
+            return nullptr;
+        }
+
+        if ((settings.duration < MIN_DURATION) || (settings.files == 0) || (settings.path.empty() == true)) {
+            TRACE_GLOBAL(AVSClient, (_T("Failed to create BlackBox: invalid settings")));
+            return nullptr;
+        }
+
+        if ((static_cast<size_t>(settings.duration) * AudioFormatCompatibility::SAMPLE_RATE_HZ) >= stream->getDataSize()) {
+            TRACE_GLOBAL(AVSClient, (_T("Failed to create BlackBox: the stream holds no more than %u s of audio"), settings.duration));
+            return nullptr;
+        }
+
+        std::shared_ptr<BlackBox> blackBox(new BlackBox(stream, settings));
+        if (!blackBox->Initialize()) {
+            TRACE_GLOBAL(AVSClient, (_T("Failed to initialize BlackBox")));
+            return nullptr;
+        }
+
+        return blackBox;
+    }
+
+    BlackBox::BlackBox(std::shared_ptr<AudioInputStream> stream, const BlackBoxSettings& settings)
+        : m_stream{ stream }
+        , m_settings{ settings }
+        , m_arena(static_cast<size_t>(settings.duration) * AudioFormatCompatibility::SAMPLE_RATE_HZ)
+        , m_isShuttingDown{ false }
+        , m_lock()
+        , m_requested()
+        , m_isPending{ false }
+        , m_request()
+        , m_recordingThread{}
+    {
+    }
+
+    BlackBox::~BlackBox()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_isShuttingDown = true;
+            m_requested.notify_all();
+        }
+
+        if (m_recordingThread.joinable()) {
+            m_recordingThread.join();
+        }
+    }
+
+    uint32_t BlackBox::FileSize(const uint8_t duration)
+    {
+        return (WAV_HEADER_SIZE + (static_cast<uint32_t>(duration) * AudioFormatCompatibility::SAMPLE_RATE_HZ * BYTES_PER_SAMPLE));
+    }
+
+    bool BlackBox::Initialize()
+    {
+        if (Core::Directory(m_settings.path.c_str()).CreatePath() == false) {
+            TRACE(AVSClient, (_T("Failed to create the black box directory %s"), m_settings.path.c_str()));
+            return false;
+        }
+
+        m_recordingThread = std::thread(&BlackBox::RecordingLoop, this);
+
+        TRACE(AVSClient, (_T("Black box: %u s snapshots in %s, at most %u files and %u kB"), m_settings.duration, m_settings.path.c_str(), m_settings.files, m_settings.size));
+        return true;
+    }
+
+    bool BlackBox::Snapshot(const string& reason)
+    {
+        return (Trigger((reason.empty() == true ? _T("request") : reason.c_str()), KeyWordObserverInterface::UNSPECIFIED_INDEX));
+    }
+
+    void BlackBox::onKeyWordDetected(
+        std::shared_ptr<AudioInputStream> /*stream*/,
+        std::string keyword,
+        AudioInputStream::Index /*beginIndex*/,
+        AudioInputStream::Index endIndex,
+        std::shared_ptr<const std::vector<char>> /*KWDMetadata*/)
+    {
+        Trigger(keyword.c_str(), endIndex);
+    }
+
+    void BlackBox::onStateChanged(KeyWordDetectorStateObserverInterface::KeyWordDetectorState keyWordDetectorState)
+    {
+        if (keyWordDetectorState == KeyWordDetectorStateObserverInterface::KeyWordDetectorState::ERROR) {
+            Trigger(_T("error"), KeyWordObserverInterface::UNSPECIFIED_INDEX);
+        }
+    }
+
+    // Runs on the thread of the caller, so it only fills in the request
+    bool BlackBox::Trigger(const char reason[], const AudioInputStream::Index event)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        const bool result = (m_isPending == false);
+
+        if (result == true) {
+            // The reason ends up in the file name
+            uint8_t length = 0;
+            for (; (length < (REASON_LENGTH - 1)) && (reason[length] != '\0'); length++) {
+                const char c = reason[length];
+                const bool isSafe = (((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) || ((c >= '0') && (c <= '9')) || (c == '-') || (c == '_'));
+                m_request.reason[length] = (isSafe == true ? c : '_');
+            }
+            m_request.reason[length] = '\0';
+            m_request.event = event;
+            m_request.time = std::chrono::steady_clock::now();
+            m_request.date = std::chrono::system_clock::now();
+            m_isPending = true;
+            m_requested.notify_one();
+        }
+
+        return (result);
+    }
+
+    void BlackBox::RecordingLoop()
+    {
+        ThreadScheduling scheduling;
+        scheduling.schedulingPolicy = ThreadScheduling::OTHER;
+        scheduling.nice = RECORDING_NICE;
+        const string applied = scheduling.Apply();
+        TRACE(AVSClient, (_T("Black box thread: %s"), applied.c_str()));
+
+        std::unique_lock<std::mutex> lock(m_lock);
+
+        while (m_isShuttingDown == false) {
+            m_requested.wait(lock, [this]() { return ((m_isPending == true) || (m_isShuttingDown == true)); });
+
+            if (m_isShuttingDown == false) {
+                const Request request = m_request;
+                lock.unlock();
+
+                const size_t samples = Capture(request);
+                if (samples > 0) {
+                    Save(request, samples);
+                }
+
+                lock.lock();
+                // Events while the snapshot was taken are dropped, most of them are in it
+                m_isPending = false;
+            }
+        }
+    }
+
+    size_t BlackBox::Capture(const Request& request)
+    {
+        static constexpr uint32_t SAMPLES_PER_MS = AudioFormatCompatibility::SAMPLE_RATE_HZ / 1000;
+
+        std::unique_ptr<AudioInputStream::Reader> reader = m_stream->createReader(AudioInputStream::Reader::Policy::BLOCKING);
+        if (!reader) {
+            TRACE(AVSClient, (_T("Black box: no reader left in the stream")));
+            return 0;
+        }
+
+        reader->seek(0, AudioInputStream::Reader::Reference::BEFORE_WRITER);
+        const AudioInputStream::Index writer = reader->tell();
+
+        AudioInputStream::Index event = request.event;
+        if (event == KeyWordObserverInterface::UNSPECIFIED_INDEX) {
+            // The audio written since the request was made
+            const uint64_t elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - request.time).count() * SAMPLES_PER_MS;
+            event = (writer > elapsed ? writer - elapsed : 0);
+        }
+
+        const AudioInputStream::Index end = event + (static_cast<AudioInputStream::Index>(FOLLOW_UP) * AudioFormatCompatibility::SAMPLE_RATE_HZ);
+        const AudioInputStream::Index start = (end > m_arena.size() ? end - m_arena.size() : 0);
+        if (reader->seek(start, AudioInputStream::Reader::Reference::ABSOLUTE) == false) {
+            TRACE(AVSClient, (_T("Black box: the audio of the %s snapshot is no longer in the stream"), request.reason));
+            return 0;
+        }
+
+        const size_t wanted = static_cast<size_t>(end - start);
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(FOLLOW_UP) + CAPTURE_SLACK;
+        size_t captured = 0;
+
+        while ((captured < wanted) && (m_isShuttingDown == false) && (std::chrono::steady_clock::now() < deadline)) {
+            const ssize_t wordsRead = reader->read(&m_arena[captured], wanted - captured, TIMEOUT_FOR_READ_CALLS);
+            if (wordsRead > 0) {
+                captured += wordsRead;
+            } else if (wordsRead == AudioInputStream::Reader::Error::OVERRUN) {
+                TRACE(AVSClient, (_T("Black box: overrun while taking the %s snapshot"), request.reason));
+                captured = 0;
+                break;
+            } else if (wordsRead == AudioInputStream::Reader::Error::CLOSED) {
+                break;
+            }
+        }
+
+        reader->close();
+
+        return (captured);
+    }
+
+    void BlackBox::Save(const Request& request, const size_t samples)
+    {
+        const uint32_t dataSize = static_cast<uint32_t>(samples * BYTES_PER_SAMPLE);
+        const uint64_t date = std::chrono::duration_cast<std::chrono::milliseconds>(request.date.time_since_epoch()).count();
+
+        Prune(WAV_HEADER_SIZE + dataSize);
+
+        // Zero padded, so the names sort oldest first
+        char name[64];
+        ::snprintf(name, sizeof(name), "%s%013llu-%s%s", FILE_PREFIX, static_cast<unsigned long long>(date), request.reason, FILE_SUFFIX);
+        const string path = m_settings.path + '/' + name;
+
+        uint8_t header[WAV_HEADER_SIZE];
+        ::memcpy(&header[0], "RIFF", 4);
+        PutLE(&header[4], WAV_HEADER_SIZE - 8 + dataSize, 4);
+        ::memcpy(&header[8], "WAVEfmt ", 8);
+        PutLE(&header[16], 16, 4);
+        PutLE(&header[20], 1, 2);
+        PutLE(&header[22], AudioFormatCompatibility::NUM_CHANNELS, 2);
+        PutLE(&header[24], AudioFormatCompatibility::SAMPLE_RATE_HZ, 4);
+        PutLE(&header[28], AudioFormatCompatibility::SAMPLE_RATE_HZ * AudioFormatCompatibility::NUM_CHANNELS * BYTES_PER_SAMPLE, 4);
+        PutLE(&header[32], AudioFormatCompatibility::NUM_CHANNELS * BYTES_PER_SAMPLE, 2);
+        PutLE(&header[34], AudioFormatCompatibility::SAMPLE_SIZE_IN_BITS, 2);
+        ::memcpy(&header[36], "data", 4);
+        PutLE(&header[40], dataSize, 4);
+
+        // The stream holds little endian LPCM, it is written as it is
+        FILE* file = ::fopen(path.c_str(), "wb");
+        bool isWritten = (file != nullptr);
+        if (isWritten == true) {
+            isWritten = (::fwrite(header, 1, sizeof(header), file) == sizeof(header)) && (::fwrite(m_arena.data(), 1, dataSize, file) == dataSize);
+            isWritten = (::fclose(file) == 0) && (isWritten == true);
+        }
+
+        if (isWritten == true) {
+            TRACE(AVSClient, (_T("Black box: saved %u ms of audio to %s"), static_cast<uint32_t>((samples * 1000) / AudioFormatCompatibility::SAMPLE_RATE_HZ), path.c_str()));
+        } else {
+            TRACE(AVSClient, (_T("Black box: failed to save %s"), path.c_str()));
+            ::remove(path.c_str());
+        }
+    }
+
+    // Removes the oldest snapshots until another one of this size fits in the limits
+    void BlackBox::Prune(const uint32_t size) const
+    {
+        std::vector<std::pair<string, uint64_t>> snapshots;
+        uint64_t total = 0;
+
+        DIR* directory = ::opendir(m_settings.path.c_str());
+        if (directory != nullptr) {
+            const size_t prefix = ::strlen(FILE_PREFIX);
+            const size_t suffix = ::strlen(FILE_SUFFIX);
+            struct dirent* entry;
+
+            while ((entry = ::readdir(directory)) != nullptr) {
+                const string name(entry->d_name);
+                struct stat status;
+                if ((name.length() > (prefix + suffix)) && (name.compare(0, prefix, FILE_PREFIX) == 0)
+                    && (name.compare(name.length() - suffix, suffix, FILE_SUFFIX) == 0)
+                    && (::stat((m_settings.path + '/' + name).c_str(), &status) == 0) && (S_ISREG(status.st_mode))) {
+                    snapshots.emplace_back(name, static_cast<uint64_t>(status.st_size));
+                    total += status.st_size;
+                }
+            }
+            ::closedir(directory);
+        }
+
+        std::sort(snapshots.begin(), snapshots.end());
+
+        const uint64_t limit = static_cast<uint64_t>(m_settings.size) * 1024;
+        for (auto snapshot = snapshots.cbegin(); (snapshot != snapshots.cend()) && ((static_cast<size_t>(snapshots.cend() - snapshot) >= m_settings.files) || ((total + size) > limit)); ++snapshot) {
+            if (::remove((m_settings.path + '/' + snapshot->first).c_str()) == 0) {
+                total -= snapshot->second;
+            }
+        }
+    }
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,133 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <AVSCommon/AVS/AudioInputStream.h>
+#include <AVSCommon/SDKInterfaces/KeyWordDetectorStateObserverInterface.h>
+#include <AVSCommon/SDKInterfaces/KeyWordObserverInterface.h>
+
+#include "Module.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    struct BlackBoxSettings {
+        static constexpr uint16_t DEFAULT_FILES = 10;
+        static constexpr uint32_t DEFAULT_SIZE = 4096;
+
+        BlackBoxSettings()
+            : duration(0)
+            , files(DEFAULT_FILES)
+            , size(DEFAULT_SIZE)
+            , path()
+        {
+        }
+
+        // Seconds of audio in a snapshot, 0 for no black box
+        uint8_t duration;
+        // Snapshots kept on disk, and their total size in kB; the oldest are removed first
+        uint16_t files;
+        uint32_t size;
+        // Directory the snapshots are written to
+        string path;
+    };
+
+    /// Saves the audio around a keyword detection, a failure of the keyword detector or a request to a WAV file,
+    /// to look into false and missed wakes reported from the field.
+    /// The shared data stream is the always-on ring: a snapshot is copied out of it by a low-priority thread
+    /// into memory set aside up front, so nothing is added to the audio path and the observers only flag the event.
+    class BlackBox
+        : public alexaClientSDK::avsCommon::sdkInterfaces::KeyWordObserverInterface,
+          public alexaClientSDK::avsCommon::sdkInterfaces::KeyWordDetectorStateObserverInterface {
+    public:
+        // Seconds of audio after the event, the rest of the snapshot comes before it
+        static constexpr uint8_t FOLLOW_UP = 1;
+        static constexpr uint8_t MIN_DURATION = 2;
+        static constexpr uint8_t REASON_LENGTH = 24;
+
+        static std::shared_ptr<BlackBox> create(
+            std::shared_ptr<alexaClientSDK::avsCommon::avs::AudioInputStream> stream,
+            const BlackBoxSettings& settings);
+
+        BlackBox(const BlackBox&) = delete;
+        BlackBox& operator=(const BlackBox&) = delete;
+
+        ~BlackBox() override;
+
+        // Bytes a snapshot of this many seconds takes on disk
+        static uint32_t FileSize(const uint8_t duration);
+
+        // May be called from any thread, false while an earlier snapshot is still pending
+        bool Snapshot(const string& reason);
+
+        /// KeyWordObserverInterface, the snapshot is taken around the end of the keyword
+        void onKeyWordDetected(
+            std::shared_ptr<alexaClientSDK::avsCommon::avs::AudioInputStream> stream,
+            std::string keyword,
+            alexaClientSDK::avsCommon::avs::AudioInputStream::Index beginIndex,
+            alexaClientSDK::avsCommon::avs::AudioInputStream::Index endIndex,
+            std::shared_ptr<const std::vector<char>> KWDMetadata) override;
+
+        /// KeyWordDetectorStateObserverInterface, the keyword detector reports an overrun or a failure as an error
+        void onStateChanged(alexaClientSDK::avsCommon::sdkInterfaces::KeyWordDetectorStateObserverInterface::KeyWordDetectorState keyWordDetectorState) override;
+
+    private:
+        struct Request {
+            char reason[REASON_LENGTH];
+            // Stream index of the event, UNSPECIFIED_INDEX for the time it was requested
+            alexaClientSDK::avsCommon::avs::AudioInputStream::Index event;
+            std::chrono::steady_clock::time_point time;
+            std::chrono::system_clock::time_point date;
+        };
+
+        BlackBox(std::shared_ptr<alexaClientSDK::avsCommon::avs::AudioInputStream> stream, const BlackBoxSettings& settings);
+
+        bool Initialize();
+        bool Trigger(const char reason[], const alexaClientSDK::avsCommon::avs::AudioInputStream::Index event);
+        void RecordingLoop();
+        size_t Capture(const Request& request);
+        void Save(const Request& request, const size_t samples);
+        void Prune(const uint32_t size) const;
+
+        const std::shared_ptr<alexaClientSDK::avsCommon::avs::AudioInputStream> m_stream;
+        const BlackBoxSettings m_settings;
+        // Holds one snapshot
+        std::vector<int16_t> m_arena;
+        std::atomic<bool> m_isShuttingDown;
+
+        // A single request is pending at a time, the observers only fill it in
+        std::mutex m_lock;
+        std::condition_variable m_requested;
+        bool m_isPending;
+        Request m_request;
+
+        std::thread m_recordingThread;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
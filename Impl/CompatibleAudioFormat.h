@@ -61,6 +61,36 @@ namespace Plugin {
             return true;
         }
 
+        // Source formats the ThunderVoiceHandler can convert into the compatible format
+        static bool IsConvertible(alexaClientSDK::avsCommon::utils::AudioFormat other)
+        {
+            if (ENCODING != other.encoding) {
+                TRACE_GLOBAL(AVSClient, (_T("Unconvertible audio format encoding")));
+                return false;
+            }
+            if (SAMPLE_SIZE_IN_BITS != other.sampleSizeInBits) {
+                TRACE_GLOBAL(AVSClient, (_T("Unconvertible audio format sample size in bits")));
+                return false;
+            }
+            if ((other.numChannels < 1) || (other.numChannels > 8)) {
+                TRACE_GLOBAL(AVSClient, (_T("Unconvertible audio format number of channels")));
+                return false;
+            }
+            switch (other.sampleRateHz) {
+            case 8000:
+            case 16000:
+            case 22050:
+            case 44100:
+            case 48000:
+                break;
+            default:
+                TRACE_GLOBAL(AVSClient, (_T("Unconvertible audio format sample rate")));
+                return false;
+            }
+
+            return true;
+        }
+
     } // namespace AudioFormatCompatibility
 } // namespace Plugin
 } // namespace WPEFramework
@@ -0,0 +1,38 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "Module.h"
+
+namespace WPEFramework {
+namespace Plugin {
+
+    // Audio snapshots of the AVS client on request. Private to this plugin, like IKeywordDetector.
+    struct IBlackBox : virtual public Core::IUnknown {
+        enum { ID = RPC::ID_EXTERNAL_INTERFACE_OFFSET + 0xA502 };
+
+        virtual ~IBlackBox() = default;
+
+        // Saves the audio around now, the reason is part of the file name
+        virtual uint32_t Snapshot(const string& reason) = 0;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,45 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "Module.h"
+
+#include "KeywordTelemetry.h"
+
+namespace WPEFramework {
+namespace Plugin {
+
+    // Keyword detection controls of the AVS client. Private to this plugin: no proxy stubs are generated for it,
+    // so it is only offered when the client runs in process.
+    struct IKeywordDetector : virtual public Core::IUnknown {
+        enum { ID = RPC::ID_EXTERNAL_INTERFACE_OFFSET + 0xA500 };
+
+        virtual ~IKeywordDetector() = default;
+
+        // Loads the models of these locales (comma separated) and swaps them in without stopping detection
+        virtual uint32_t Models(const string& locales) = 0;
+        // Detection threshold of one keyword, or of all keywords when it is empty
+        virtual uint32_t Threshold(const string& keyword, const uint32_t threshold) = 0;
+        // Recent detections and the confidence histogram of each locale
+        virtual uint32_t Telemetry(KeywordTelemetry::Snapshot& snapshot) const = 0;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
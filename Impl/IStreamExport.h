@@ -0,0 +1,38 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "Module.h"
+
+namespace WPEFramework {
+namespace Plugin {
+
+    // Where other processes find the microphone stream of the AVS client. Private to this plugin, like IKeywordDetector.
+    struct IStreamExport : virtual public Core::IUnknown {
+        enum { ID = RPC::ID_EXTERNAL_INTERFACE_OFFSET + 0xA501 };
+
+        virtual ~IStreamExport() = default;
+
+        // Shared memory file of the stream, the words of audio it holds and the words written to it so far
+        virtual uint32_t Export(string& path, uint64_t& capacity, uint64_t& written) const = 0;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,898 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "KeywordDetector.h"
+
+#include "Module.h"
+#include "CompatibleAudioFormat.h"
+
+#include <AVSCommon/Utils/Logger/Logger.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <memory>
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    using namespace alexaClientSDK::avsCommon;
+    using namespace alexaClientSDK::avsCommon::avs;
+    using namespace alexaClientSDK::avsCommon::sdkInterfaces;
+    using namespace alexaClientSDK::avsCommon::utils::logger;
+
+    static const size_t HERTZ_PER_KILOHERTZ = 1000;
+    // Only used when the writer of the stream does not raise a stream signal
+    const std::chrono::milliseconds TIMEOUT_FOR_READ_CALLS = std::chrono::milliseconds(1000);
+    // Push size while the VAD reports silence, trading detection latency at speech onset for fewer wakeups
+    static const std::chrono::milliseconds SILENCE_PUSH_DURATION = std::chrono::milliseconds(100);
+    // Silence, as reported by the VAD, after which decoding stops until the energy rises again
+    static const std::chrono::milliseconds IDLE_HOLD_DURATION = std::chrono::milliseconds(2000);
+    // Audio replayed from the stream when decoding resumes, so the start of the keyword is not lost
+    static const std::chrono::milliseconds PRE_ROLL_DURATION = std::chrono::milliseconds(500);
+    // Silent audio kept back by the energy gate, pushed ahead of the first block that passes it
+    static const std::chrono::milliseconds LOOK_BACK_DURATION = std::chrono::milliseconds(200);
+    // Audio that passes the energy gate after a block with voice, so the end of the keyword reaches the decoder
+    static const std::chrono::milliseconds HANGOVER_DURATION = std::chrono::milliseconds(300);
+    // Pushed audio kept mapped to the stream, longer than a keyword and the delay before it is detected
+    static const std::chrono::milliseconds SPAN_DURATION = std::chrono::milliseconds(10000);
+    // An overrun within this time of the previous one raises the priority of the detection thread, or else its batch size
+    static const std::chrono::seconds OVERRUN_REPEAT_WINDOW = std::chrono::seconds(60);
+    static constexpr int OVERRUN_NICE_STEP = 5;
+    static constexpr int OVERRUN_NICE_LIMIT = -10;
+    static const std::chrono::milliseconds OVERRUN_BATCH_LIMIT = std::chrono::milliseconds(400);
+    // How long a change waits for the detection thread to take it over, the stream is not read while nothing writes it
+    static const std::chrono::milliseconds SWAP_TIMEOUT = std::chrono::milliseconds(1000);
+    // Seconds of audio between two push statistics reports
+    static constexpr uint32_t PUSH_REPORT_INTERVAL_S = 300;
+
+    static const char* DEFAULT_LOCALE = "en-US";
+
+    static int64_t ResidentKb()
+    {
+        int64_t result = 0;
+        long size = 0;
+        long pages = 0;
+
+        FILE* statm = fopen("/proc/self/statm", "r");
+        if (statm != nullptr) {
+            if (fscanf(statm, "%ld %ld", &size, &pages) == 2) {
+                result = (static_cast<int64_t>(pages) * sysconf(_SC_PAGESIZE)) / 1024;
+            }
+            fclose(statm);
+        }
+
+        return (result);
+    }
+
+    static size_t ToSamples(const std::chrono::milliseconds duration)
+    {
+        return ((AudioFormatCompatibility::SAMPLE_RATE_HZ / HERTZ_PER_KILOHERTZ) * duration.count());
+    }
+
+    std::unique_ptr<KeywordDetector> KeywordDetector::create(
+        std::shared_ptr<AudioInputStream> stream,
+        std::shared_ptr<StreamSignal> streamSignal,
+        utils::AudioFormat audioFormat,
+        std::unordered_set<std::shared_ptr<KeyWordObserverInterface>> keyWordObservers,
+        std::unordered_set<std::shared_ptr<KeyWordDetectorStateObserverInterface>>
+            keyWordDetectorStateObservers,
+        const std::string& modelsFilePath,
+        const KeywordDetectorSettings& settings,
+        std::chrono::milliseconds msToPushPerIteration,
+        const uint32_t detectionThreshold,
+        const bool energyGate)
+    {
+        if (!stream) {
+            TRACE_GLOBAL(AVSClient, (_T("Failed to create KeywordDetector: stream is nullptr")));
+            return nullptr;
+        }
+
+        if (!AudioFormatCompatibility::IsCompatible(audioFormat)) {
+            return nullptr;
+        }
+
+        std::unique_ptr<KeywordDetector> detector(new KeywordDetector(
+            stream, streamSignal, keyWordObservers, keyWordDetectorStateObservers, audioFormat, msToPushPerIteration, energyGate));
+        if (!detector->Initialize(modelsFilePath, settings, detectionThreshold)) {
+            TRACE_GLOBAL(AVSClient, (_T("Failed to initialize KeywordDetector")));
+            return nullptr;
+        }
+
+        return detector;
+    }
+
+    KeywordDetector::~KeywordDetector()
+    {
+        m_shutdownLock.lock();
+        m_isShuttingDown = true;
+        m_shutdown.notify_all();
+        m_shutdownLock.unlock();
+        if (m_streamSignal) {
+            m_streamSignal->Raise();
+        }
+        if (m_detectionThread.joinable()) {
+            m_detectionThread.join();
+        }
+
+        m_poolLock.lock();
+        m_poolStart.notify_all();
+        m_poolLock.unlock();
+        for (std::thread& worker : m_workers) {
+            worker.join();
+        }
+
+        m_decoders.clear();
+        m_retiredDecoders.clear();
+    }
+
+    KeywordDetector::KeywordDetector(
+        std::shared_ptr<AudioInputStream> stream,
+        std::shared_ptr<StreamSignal> streamSignal,
+        std::unordered_set<std::shared_ptr<KeyWordObserverInterface>> keyWordObservers,
+        std::unordered_set<std::shared_ptr<KeyWordDetectorStateObserverInterface>> keyWordDetectorStateObservers,
+        utils::AudioFormat audioFormat,
+        std::chrono::milliseconds msToPushPerIteration,
+        const bool energyGate)
+        : AbstractKeywordDetector(keyWordObservers, keyWordDetectorStateObservers)
+        , m_isShuttingDown{ false }
+        , m_shutdownLock()
+        , m_shutdown()
+        , m_stream{ stream }
+        , m_streamSignal{ streamSignal }
+        , m_streamReader{ nullptr }
+        , m_detectionThread{}
+        , m_maxSamplesPerPush((audioFormat.sampleRateHz / HERTZ_PER_KILOHERTZ) * msToPushPerIteration.count())
+        , m_maxSamplesPerBatch(std::max<size_t>(m_maxSamplesPerPush, (audioFormat.sampleRateHz / HERTZ_PER_KILOHERTZ) * SILENCE_PUSH_DURATION.count()))
+        , m_isVoiceActive{ false }
+        , m_isIdle{ false }
+        , m_silentSamples{ 0 }
+        , m_isGated(energyGate)
+        , m_energyGate(audioFormat.sampleRateHz)
+        , m_lookBack()
+        , m_lookBackEnd{ 0 }
+        , m_hangoverSamples{ 0 }
+        , m_spans()
+        , m_spanSamples{ 0 }
+        , m_decoders()
+        , m_engine()
+        , m_modelFilePath()
+        , m_lockModels{ false }
+        , m_scheduling()
+        , m_latency()
+        , m_reconfigureLock()
+        , m_isReconfigured{ false }
+        , m_pendingDecoders()
+        , m_retiredDecoders()
+        , m_reconfigured()
+        , m_reconfigurations{ 0 }
+        , m_detectionThreshold{ DEFAULT_DETECTION_THRESHOLD }
+        , m_keywordThresholds()
+        , m_workers()
+        , m_poolLock()
+        , m_poolStart()
+        , m_poolDone()
+        , m_poolSamples{ nullptr }
+        , m_poolCount{ 0 }
+        , m_poolRound{ 0 }
+        , m_poolPending{ 0 }
+        , m_poolError{ KeywordEngine::ERROR_NONE }
+        , m_detectionLock()
+        , m_lastDetectionEnd{ 0 }
+        , m_telemetry()
+        , m_decodingSamples{ 0 }
+        , m_idleSamples{ 0 }
+        , m_wakeups{ 0 }
+        , m_gatedSamples{ 0 }
+        , m_overruns{ 0 }
+        , m_overrunSamples{ 0 }
+        , m_recoveryTimeMs{ 0 }
+        , m_lastOverrun()
+        , m_isRecovering{ false }
+        , m_pushes{ 0 }
+        , m_batchedPushes{ 0 }
+        , m_pushedSamples{ 0 }
+        , m_pushTimeUs{ 0 }
+        , m_reportSamples{ 0 }
+    {
+    }
+
+    bool KeywordDetector::Initialize(const std::string& modelFilePath, const KeywordDetectorSettings& settings, const uint32_t detectionThreshold)
+    {
+        m_streamReader = m_stream->createReader(m_streamSignal ? AudioInputStream::Reader::Policy::NONBLOCKING : AudioInputStream::Reader::Policy::BLOCKING);
+        if (!m_streamReader) {
+            TRACE(AVSClient, (_T("Failed to initialize KeywordDetector: m_streamReader is nullptr")));
+            return false;
+        }
+
+        m_engine = (settings.engine.empty() == true ? std::string(KeywordEngine::Default()) : settings.engine);
+        m_modelFilePath = modelFilePath;
+        m_lockModels = settings.lockModels;
+        m_scheduling = settings.scheduling;
+        m_detectionThreshold = detectionThreshold;
+
+        if (CreateDecoders(settings.locales, m_decoders) == false) {
+            return false;
+        }
+
+        const unsigned int cores = std::thread::hardware_concurrency();
+        const size_t workers = std::min<size_t>(m_decoders.size() - 1, (cores > 1 ? (cores - 1) : 0));
+        TRACE(AVSClient, (_T("Keyword detection for %u locale(s) on %u thread(s)"), static_cast<uint32_t>(m_decoders.size()), static_cast<uint32_t>(workers + 1)));
+
+        m_isShuttingDown = false;
+        for (size_t worker = 0; worker < workers; worker++) {
+            m_workers.emplace_back(&KeywordDetector::PushLoop, this, static_cast<uint8_t>(worker + 1));
+        }
+        m_detectionThread = std::thread(&KeywordDetector::DetectionLoop, this);
+        return true;
+    }
+
+    bool KeywordDetector::CreateDecoders(const std::string& locales, std::vector<std::unique_ptr<KeywordEngine>>& decoders)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const int64_t residentBefore = ResidentKb();
+
+        m_reconfigureLock.lock();
+        const uint32_t detectionThreshold = m_detectionThreshold;
+        m_reconfigureLock.unlock();
+
+        // Comma separated, in the order of the locale combination
+        std::vector<std::string> names;
+        size_t begin = 0;
+        while (begin <= locales.length()) {
+            size_t end = locales.find(',', begin);
+            if (end == std::string::npos) {
+                end = locales.length();
+            }
+
+            const size_t first = locales.find_first_not_of(" \t", begin);
+            const size_t last = locales.find_last_not_of(" \t", end - 1);
+            if ((first < end) && (last != std::string::npos) && (last >= first)) {
+                const std::string locale = locales.substr(first, last - first + 1);
+                if (std::find(names.cbegin(), names.cend(), locale) == names.cend()) {
+                    names.push_back(locale);
+                }
+            }
+            begin = end + 1;
+        }
+
+        if (names.empty() == true) {
+            names.push_back(DEFAULT_LOCALE);
+        }
+
+        for (const std::string& locale : names) {
+            std::unique_ptr<KeywordEngine> decoder = KeywordEngine::Create(m_engine, *this, locale);
+            if (!decoder) {
+                TRACE(AVSClient, (_T("Keyword engine %s is not available"), m_engine.c_str()));
+                decoders.clear();
+                return false;
+            }
+            decoders.push_back(std::move(decoder));
+        }
+
+        // The VAD of the first decoder stands for all of them
+        size_t models = 0;
+        for (size_t index = 0; index < decoders.size(); index++) {
+            if (decoders[index]->Initialize(m_modelFilePath, detectionThreshold, (index == 0), m_lockModels) == false) {
+                decoders.clear();
+                return false;
+            }
+            models += decoders[index]->ModelSize();
+        }
+
+        TRACE(AVSClient, (_T("Keyword models of the %s engine ready in %u ms, %u kB of models%s, resident memory grew by %d kB"),
+            m_engine.c_str(), static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count()),
+            static_cast<uint32_t>(models / 1024), (m_lockModels == true ? _T(" locked") : _T("")), static_cast<int32_t>(ResidentKb() - residentBefore)));
+
+        return true;
+    }
+
+    bool KeywordDetector::SwapModels(const std::string& locales)
+    {
+        std::vector<std::unique_ptr<KeywordEngine>> decoders;
+
+        if (CreateDecoders(locales, decoders) == false) {
+            TRACE(AVSClient, (_T("Keyword models for '%s' not loaded, detection continues on the current ones"), locales.c_str()));
+            return false;
+        }
+
+        if (decoders.size() > (m_workers.size() + 1)) {
+            TRACE(AVSClient, (_T("%u locale(s) share %u thread(s)"), static_cast<uint32_t>(decoders.size()), static_cast<uint32_t>(m_workers.size() + 1)));
+        }
+
+        std::vector<std::unique_ptr<KeywordEngine>> retired;
+
+        std::unique_lock<std::mutex> lock(m_reconfigureLock);
+        // A swap not yet taken over is replaced, and released outside the lock
+        m_pendingDecoders.swap(decoders);
+        m_isReconfigured = true;
+        // Freeing the models takes a while, it is done here rather than on the detection thread. If the stream
+        // is not written to, the old models are freed with the next swap.
+        m_reconfigured.wait_for(lock, SWAP_TIMEOUT, [this]() { return ((m_pendingDecoders.empty() == true) || (m_isShuttingDown == true)); });
+        retired.swap(m_retiredDecoders);
+        lock.unlock();
+
+        return true;
+    }
+
+    bool KeywordDetector::Threshold(const std::string& keyword, const uint32_t threshold)
+    {
+        bool result = false;
+
+        if ((threshold >= MIN_DETECTION_THRESHOLD) && (threshold <= MAX_DETECTION_THRESHOLD)) {
+            std::unique_lock<std::mutex> lock(m_reconfigureLock);
+            const uint32_t reconfigurations = m_reconfigurations;
+            if (keyword.empty() == true) {
+                m_detectionThreshold = threshold;
+                m_keywordThresholds.clear();
+            } else {
+                m_keywordThresholds[keyword] = threshold;
+            }
+            m_isReconfigured = true;
+            result = true;
+
+            // Only the engines know their keywords, a keyword none of them has is dropped by the detection thread
+            if (keyword.empty() == false) {
+                const bool isApplied = m_reconfigured.wait_for(lock, SWAP_TIMEOUT, [this, reconfigurations]() { return ((m_reconfigurations != reconfigurations) || (m_isShuttingDown == true)); });
+                result = ((isApplied == false) || (m_keywordThresholds.find(keyword) != m_keywordThresholds.end()));
+            }
+        }
+
+        return (result);
+    }
+
+    void KeywordDetector::Reconfigure()
+    {
+        std::map<std::string, uint32_t> keywordThresholds;
+        uint32_t detectionThreshold;
+        bool isSwapped = false;
+
+        m_reconfigureLock.lock();
+        m_isReconfigured = false;
+        if (m_pendingDecoders.empty() == false) {
+            // Handed back to SwapModels(), which frees them
+            for (std::unique_ptr<KeywordEngine>& decoder : m_decoders) {
+                m_retiredDecoders.push_back(std::move(decoder));
+            }
+            m_decoders.swap(m_pendingDecoders);
+            m_pendingDecoders.clear();
+            isSwapped = true;
+        }
+        detectionThreshold = m_detectionThreshold;
+        keywordThresholds = m_keywordThresholds;
+        m_reconfigureLock.unlock();
+
+        // Engines are not thread safe, the thresholds are only changed on the detection thread
+        for (const std::unique_ptr<KeywordEngine>& decoder : m_decoders) {
+            const KeywordEngine::Error error = decoder->Threshold(nullptr, detectionThreshold);
+            if (error != KeywordEngine::ERROR_NONE) {
+                TRACE(AVSClient, (_T("Failed to set detection threshold for %s (%d)"), decoder->Locale().c_str(), error));
+            }
+        }
+
+        // Each keyword is set on its own, a keyword of one locale is unknown to the others. A keyword no
+        // locale knows is dropped, so it is not tried again with every reconfiguration.
+        for (const std::pair<const std::string, uint32_t>& entry : keywordThresholds) {
+            KeywordEngine::Error error = KeywordEngine::ERROR_NONE;
+            bool isSet = false;
+
+            for (const std::unique_ptr<KeywordEngine>& decoder : m_decoders) {
+                const KeywordEngine::Error result = decoder->Threshold(entry.first.c_str(), entry.second);
+                if (result == KeywordEngine::ERROR_NONE) {
+                    isSet = true;
+                } else {
+                    error = result;
+                }
+            }
+
+            if (isSet == false) {
+                TRACE(AVSClient, (_T("Keyword %s is not in the models (%d), its threshold is dropped"), entry.first.c_str(), error));
+
+                m_reconfigureLock.lock();
+                auto it = m_keywordThresholds.find(entry.first);
+                if ((it != m_keywordThresholds.end()) && (it->second == entry.second)) {
+                    m_keywordThresholds.erase(it);
+                }
+                m_reconfigureLock.unlock();
+            }
+        }
+
+        m_reconfigureLock.lock();
+        m_reconfigurations++;
+        m_reconfigureLock.unlock();
+        m_reconfigured.notify_all();
+
+        if (isSwapped == true) {
+            TRACE(AVSClient, (_T("Keyword detection swapped to %u locale(s)"), static_cast<uint32_t>(m_decoders.size())));
+
+            // The new VAD starts without voice and only reports changes
+            m_isVoiceActive = false;
+            m_silentSamples = 0;
+
+            // A keyword already under way is heard in full by the new decoders
+            if (m_isIdle == false) {
+                Rewind();
+            }
+        }
+    }
+
+    bool KeywordDetector::IsVoiceActive() const
+    {
+        return m_isVoiceActive;
+    }
+
+    bool KeywordDetector::IsIdle() const
+    {
+        return m_isIdle;
+    }
+
+    std::chrono::milliseconds KeywordDetector::DecodingTime() const
+    {
+        return std::chrono::milliseconds(m_decodingSamples / (AudioFormatCompatibility::SAMPLE_RATE_HZ / HERTZ_PER_KILOHERTZ));
+    }
+
+    std::chrono::milliseconds KeywordDetector::IdleTime() const
+    {
+        return std::chrono::milliseconds(m_idleSamples / (AudioFormatCompatibility::SAMPLE_RATE_HZ / HERTZ_PER_KILOHERTZ));
+    }
+
+    uint32_t KeywordDetector::Wakeups() const
+    {
+        return m_wakeups;
+    }
+
+    std::chrono::milliseconds KeywordDetector::GatedTime() const
+    {
+        return std::chrono::milliseconds(m_gatedSamples / (AudioFormatCompatibility::SAMPLE_RATE_HZ / HERTZ_PER_KILOHERTZ));
+    }
+
+    uint32_t KeywordDetector::Overruns() const
+    {
+        return m_overruns;
+    }
+
+    std::chrono::milliseconds KeywordDetector::OverrunTime() const
+    {
+        return std::chrono::milliseconds(m_overrunSamples / (AudioFormatCompatibility::SAMPLE_RATE_HZ / HERTZ_PER_KILOHERTZ));
+    }
+
+    std::chrono::milliseconds KeywordDetector::RecoveryTime() const
+    {
+        return std::chrono::milliseconds(m_recoveryTimeMs);
+    }
+
+    void KeywordDetector::Telemetry(KeywordTelemetry::Snapshot& snapshot) const
+    {
+        m_telemetry.Read(snapshot);
+    }
+
+    void KeywordDetector::DetectionLoop()
+    {
+        std::vector<int16_t> audioDataToPush(m_maxSamplesPerBatch);
+        size_t buffered = 0;
+        ssize_t wordsRead;
+        KeywordEngine::Error writeStatus = KeywordEngine::ERROR_NONE;
+
+        TRACE(AVSClient, (_T("Keyword detection thread: %s"), m_scheduling.Apply().c_str()));
+
+        notifyKeyWordDetectorStateObservers(KeyWordDetectorStateObserverInterface::KeyWordDetectorState::ACTIVE);
+
+        while (!m_isShuttingDown) {
+            // Only between two pushes, the rewind of a swap must not replay part of a block
+            if ((m_isReconfigured == true) && (buffered == 0)) {
+                Reconfigure();
+            }
+
+            // Small pushes while there is voice, the keyword is detected with the least delay
+            const bool isVoiceActive = ((m_isVoiceActive == true) && (m_isIdle == false) && (m_lookBack.empty() == true));
+            const size_t pushSize = (isVoiceActive ? m_maxSamplesPerPush : m_maxSamplesPerBatch);
+
+            wordsRead = Read(&audioDataToPush[buffered], pushSize - buffered);
+
+            if (wordsRead == AudioInputStream::Reader::Error::OVERRUN) {
+                // The partial batch is older than the gap, it is dropped with it
+                buffered = 0;
+                if (Recover() == false) {
+                    notifyKeyWordDetectorStateObservers(KeyWordDetectorStateObserverInterface::KeyWordDetectorState::ERROR);
+                    break;
+                }
+                audioDataToPush.resize(m_maxSamplesPerBatch);
+            } else if (wordsRead == AudioInputStream::Reader::Error::CLOSED) {
+                TRACE(AVSClient, (_T("Stream closed, keyword detection stops")));
+                notifyKeyWordDetectorStateObservers(KeyWordDetectorStateObserverInterface::KeyWordDetectorState::STREAM_CLOSED);
+                break;
+            } else if (wordsRead > 0) {
+                buffered += wordsRead;
+
+                if ((isVoiceActive == false) && (buffered < pushSize)) {
+                    // Let the rest of the batch arrive instead of waking up for every write to the stream
+                    const std::chrono::microseconds wait(((pushSize - buffered) * 1000 * HERTZ_PER_KILOHERTZ) / AudioFormatCompatibility::SAMPLE_RATE_HZ);
+                    const auto due = std::chrono::steady_clock::now() + wait;
+                    Pause(wait);
+                    m_latency.Add(due);
+                    continue;
+                }
+
+                const bool isSilent = m_energyGate.IsSilent(audioDataToPush.data(), buffered);
+                const AudioInputStream::Index index = m_streamReader->tell() - buffered;
+
+                if (m_isIdle == true) {
+                    if ((isSilent == true) || (Wake() == true)) {
+                        // Either still quiet, or the pre-roll is read again from the stream
+                        m_idleSamples += buffered;
+                        ReportStatistics(buffered);
+                        buffered = 0;
+                        continue;
+                    }
+                }
+
+                if ((m_isGated == true) && (isSilent == true) && (m_hangoverSamples == 0)) {
+                    LookBack(audioDataToPush.data(), buffered, index);
+                    m_gatedSamples += buffered;
+                    m_silentSamples += buffered;
+                } else {
+                    m_hangoverSamples = (isSilent == true ? m_hangoverSamples - std::min(m_hangoverSamples, buffered) : ToSamples(HANGOVER_DURATION));
+
+                    writeStatus = Push(m_lookBack.data(), m_lookBack.size(), m_lookBackEnd - m_lookBack.size());
+                    m_lookBack.clear();
+                    if (writeStatus == KeywordEngine::ERROR_NONE) {
+                        writeStatus = Push(audioDataToPush.data(), buffered, index);
+                    }
+                    if (writeStatus) {
+                        TRACE(AVSClient, (_T("Error (%d) in detection loop"), writeStatus));
+                        notifyKeyWordDetectorStateObservers(KeyWordDetectorStateObserverInterface::KeyWordDetectorState::ERROR);
+                        break;
+                    }
+
+                    m_silentSamples = (m_isVoiceActive == true ? 0 : m_silentSamples + buffered);
+                }
+
+                if (m_silentSamples >= ToSamples(IDLE_HOLD_DURATION)) {
+                    TRACE_L1(_T("No voice for %u ms, keyword detection goes idle"), static_cast<uint32_t>(IDLE_HOLD_DURATION.count()));
+                    m_isIdle = true;
+                }
+
+                if (m_isRecovering == true) {
+                    m_isRecovering = false;
+                    m_recoveryTimeMs = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_lastOverrun).count());
+                    TRACE(AVSClient, (_T("Keyword detection back on live audio %u ms after the overrun"), m_recoveryTimeMs.load()));
+                    notifyKeyWordDetectorStateObservers(KeyWordDetectorStateObserverInterface::KeyWordDetectorState::ACTIVE);
+                }
+
+                ReportStatistics(buffered);
+                buffered = 0;
+            } else if ((wordsRead != AudioInputStream::Reader::Error::TIMEDOUT) && (wordsRead != AudioInputStream::Reader::Error::WOULDBLOCK)) {
+                // A timeout only means nothing was written for a while, a pending read is only left on shutdown
+                TRACE(AVSClient, (_T("Error (%d) reading the stream in detection loop"), static_cast<int>(wordsRead)));
+                notifyKeyWordDetectorStateObservers(KeyWordDetectorStateObserverInterface::KeyWordDetectorState::ERROR);
+                break;
+            }
+        }
+
+        m_streamReader->close();
+        TRACE_L1(_T("End of detection thread"));
+    }
+
+    ssize_t KeywordDetector::Read(int16_t samples[], const size_t count)
+    {
+        ssize_t result;
+
+        if (m_streamSignal) {
+            uint64_t written = m_streamSignal->Count();
+            result = m_streamReader->read(samples, count);
+            while ((result == AudioInputStream::Reader::Error::WOULDBLOCK) && (m_isShuttingDown == false)) {
+                written = m_streamSignal->Wait(written);
+                result = m_streamReader->read(samples, count);
+            }
+        } else {
+            result = m_streamReader->read(samples, count, TIMEOUT_FOR_READ_CALLS);
+        }
+
+        return (result);
+    }
+
+    void KeywordDetector::Pause(const std::chrono::microseconds duration)
+    {
+        std::unique_lock<std::mutex> lock(m_shutdownLock);
+        m_shutdown.wait_for(lock, duration, [this]() { return (m_isShuttingDown == true); });
+    }
+
+    KeywordEngine::Error KeywordDetector::Push(const int16_t samples[], const size_t count, const AudioInputStream::Index index)
+    {
+        KeywordEngine::Error result = KeywordEngine::ERROR_NONE;
+
+        if (count > 0) {
+            const auto start = std::chrono::steady_clock::now();
+
+            // Before the decoders see the audio, they may detect a keyword in it
+            if ((m_spans.empty() == false) && ((m_spans.back().start + m_spans.back().count) == index)) {
+                m_spans.back().count += count;
+            } else {
+                m_spans.push_back({ index, count });
+            }
+            m_spanSamples += count;
+            while ((m_spanSamples - m_spans.front().count) >= ToSamples(SPAN_DURATION)) {
+                m_spanSamples -= m_spans.front().count;
+                m_spans.pop_front();
+            }
+
+            if (m_workers.empty() == false) {
+                std::lock_guard<std::mutex> lock(m_poolLock);
+                m_poolSamples = samples;
+                m_poolCount = count;
+                m_poolPending = static_cast<uint8_t>(m_workers.size());
+                m_poolError = KeywordEngine::ERROR_NONE;
+                m_poolRound++;
+                m_poolStart.notify_all();
+            }
+
+            result = PushShare(0, samples, count);
+
+            if (m_workers.empty() == false) {
+                std::unique_lock<std::mutex> lock(m_poolLock);
+                m_poolDone.wait(lock, [this]() { return (m_poolPending == 0); });
+                if (result == KeywordEngine::ERROR_NONE) {
+                    result = m_poolError;
+                }
+            }
+
+            m_pushes++;
+            m_batchedPushes += (count > m_maxSamplesPerPush ? 1 : 0);
+            m_pushedSamples += count;
+            m_pushTimeUs += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+            m_decodingSamples += count;
+        }
+
+        return (result);
+    }
+
+    KeywordEngine::Error KeywordDetector::PushShare(const uint8_t worker, const int16_t samples[], const size_t count)
+    {
+        KeywordEngine::Error result = KeywordEngine::ERROR_NONE;
+
+        for (size_t index = worker; (index < m_decoders.size()) && (result == KeywordEngine::ERROR_NONE); index += (m_workers.size() + 1)) {
+            result = m_decoders[index]->Push(samples, count);
+        }
+
+        return (result);
+    }
+
+    void KeywordDetector::PushLoop(const uint8_t worker)
+    {
+        TRACE(AVSClient, (_T("Keyword detection thread %u: %s"), worker, m_scheduling.Apply().c_str()));
+
+        uint32_t round = 0;
+        std::unique_lock<std::mutex> lock(m_poolLock);
+
+        while (true) {
+            m_poolStart.wait(lock, [this, &round]() { return ((m_poolRound != round) || (m_isShuttingDown == true)); });
+            if (m_isShuttingDown == true) {
+                break;
+            }
+
+            round = m_poolRound;
+            const int16_t* samples = m_poolSamples;
+            const size_t count = m_poolCount;
+            lock.unlock();
+
+            const KeywordEngine::Error error = PushShare(worker, samples, count);
+
+            lock.lock();
+            if (error != KeywordEngine::ERROR_NONE) {
+                m_poolError = error;
+            }
+            if (--m_poolPending == 0) {
+                m_poolDone.notify_one();
+            }
+        }
+    }
+
+    void KeywordDetector::Detected(const KeywordEngine& engine, const char keyword[], const int32_t confidence, const uint64_t begin, const uint64_t end)
+    {
+        // Pushes run while the detection thread waits for them, so the reader does not move
+        const AudioInputStream::Index position = m_streamReader->tell();
+        const AudioInputStream::Index last = StreamIndex(engine, end);
+        const AudioInputStream::Index first = StreamIndex(engine, begin);
+
+        KeywordTelemetry::Detection detection;
+        detection.timestamp = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+        detection.begin = first;
+        detection.end = last;
+        detection.confidence = confidence;
+        const AudioInputStream::Index lag = m_streamReader->tell(AudioInputStream::Reader::Reference::BEFORE_WRITER);
+        detection.lag = static_cast<uint32_t>(lag / (AudioFormatCompatibility::SAMPLE_RATE_HZ / HERTZ_PER_KILOHERTZ));
+        detection.latency = static_cast<uint32_t>((lag + (position - last)) / (AudioFormatCompatibility::SAMPLE_RATE_HZ / HERTZ_PER_KILOHERTZ));
+        KeywordTelemetry::Name(detection.keyword, keyword);
+        KeywordTelemetry::Name(detection.locale, engine.Locale().c_str());
+
+        std::lock_guard<std::mutex> lock(m_detectionLock);
+        detection.reported = (first >= m_lastDetectionEnd);
+        m_telemetry.Record(detection);
+
+        if (detection.reported == false) {
+            TRACE_L1(_T("Keyword %s for %s overlaps an earlier detection"), keyword, engine.Locale().c_str());
+        } else {
+            TRACE_L1(_T("Keyword %s detected for %s, confidence %d, %u ms after its end"), keyword, engine.Locale().c_str(), confidence, detection.latency);
+            m_lastDetectionEnd = last;
+            notifyKeyWordObservers(m_stream, keyword, first, last);
+        }
+    }
+
+    void KeywordDetector::VoiceActivity(const KeywordEngine& /* engine */, const bool isActive)
+    {
+        m_isVoiceActive = isActive;
+    }
+
+    AudioInputStream::Index KeywordDetector::StreamIndex(const KeywordEngine& engine, const uint64_t offset) const
+    {
+        // The engine has been pushed up to the end of the last span, its offsets count back from there
+        uint64_t back = engine.Pushed() - std::min(engine.Pushed(), offset);
+        std::deque<Span>::const_reverse_iterator span = m_spans.rbegin();
+
+        while ((span != m_spans.rend()) && (back > span->count)) {
+            back -= span->count;
+            span++;
+        }
+
+        AudioInputStream::Index result = 0;
+        if (span != m_spans.rend()) {
+            result = span->start + span->count - back;
+        } else if (m_spans.empty() == false) {
+            // Older than the spans kept, taken as contiguous with the oldest
+            result = m_spans.front().start - std::min(m_spans.front().start, back);
+        }
+
+        return (result);
+    }
+
+    void KeywordDetector::LookBack(const int16_t samples[], const size_t count, const AudioInputStream::Index index)
+    {
+        const size_t size = ToSamples(LOOK_BACK_DURATION);
+        m_lookBackEnd = index + count;
+
+        if (count >= size) {
+            m_lookBack.assign(samples + (count - size), samples + count);
+        } else {
+            const size_t keep = std::min(m_lookBack.size(), size - count);
+            m_lookBack.erase(m_lookBack.begin(), m_lookBack.end() - keep);
+            m_lookBack.insert(m_lookBack.end(), samples, samples + count);
+        }
+    }
+
+    bool KeywordDetector::Wake()
+    {
+        m_isIdle = false;
+        m_silentSamples = 0;
+        m_wakeups++;
+
+        // The block that woke the decoder up is part of the pre-roll
+        return (Rewind());
+    }
+
+    bool KeywordDetector::Rewind()
+    {
+        m_lookBack.clear();
+        // The energy gate must not hold back the pre-roll
+        m_hangoverSamples = ToSamples(PRE_ROLL_DURATION + HANGOVER_DURATION);
+
+        const bool isReplayed = m_streamReader->seek(ToSamples(PRE_ROLL_DURATION), AudioInputStream::Reader::Reference::BEFORE_READER);
+        if (isReplayed == false) {
+            TRACE(AVSClient, (_T("Pre-roll is no longer in the stream, decoding resumes without it")));
+        }
+
+        return (isReplayed);
+    }
+
+    bool KeywordDetector::Recover()
+    {
+        const auto now = std::chrono::steady_clock::now();
+        const bool isRepeated = ((m_overruns > 0) && ((now - m_lastOverrun) < OVERRUN_REPEAT_WINDOW));
+        m_lastOverrun = now;
+        m_overruns++;
+        m_isRecovering = true;
+        notifyKeyWordDetectorStateObservers(KeyWordDetectorStateObserverInterface::KeyWordDetectorState::ERROR);
+
+        const AudioInputStream::Index before = m_streamReader->tell();
+        if (m_streamReader->seek(0, AudioInputStream::Reader::Reference::BEFORE_WRITER) == false) {
+            TRACE(AVSClient, (_T("Overrun in detection loop, failed to move up to the writer")));
+            return (false);
+        }
+        const AudioInputStream::Index skipped = m_streamReader->tell() - before;
+        m_overrunSamples += skipped;
+        TRACE(AVSClient, (_T("Overrun in detection loop, %u ms of audio skipped"), static_cast<uint32_t>(skipped / (AudioFormatCompatibility::SAMPLE_RATE_HZ / HERTZ_PER_KILOHERTZ))));
+
+        // The audio on both sides of the gap must not be decoded as one
+        for (const std::unique_ptr<KeywordEngine>& decoder : m_decoders) {
+            const KeywordEngine::Error error = decoder->Reset();
+            if (error != KeywordEngine::ERROR_NONE) {
+                TRACE(AVSClient, (_T("Failed to reset the decoder for %s (%d)"), decoder->Locale().c_str(), error));
+                return (false);
+            }
+        }
+        // The thresholds set since the start are applied again
+        m_isReconfigured = true;
+
+        m_lookBack.clear();
+        m_hangoverSamples = 0;
+        m_silentSamples = 0;
+        m_isVoiceActive = false;
+        m_isIdle = false;
+
+        if (isRepeated == true) {
+            Escalate();
+        }
+
+        return (true);
+    }
+
+    void KeywordDetector::Escalate()
+    {
+        const id_t thread = static_cast<id_t>(::syscall(SYS_gettid));
+        int policy = SCHED_OTHER;
+        struct sched_param param;
+        ::pthread_getschedparam(::pthread_self(), &policy, &param);
+
+        // The nice level does not apply to a thread under a real-time policy
+        errno = 0;
+        const int nice = ::getpriority(PRIO_PROCESS, thread);
+        if ((policy == SCHED_OTHER) && (errno == 0) && (nice > OVERRUN_NICE_LIMIT) && (::setpriority(PRIO_PROCESS, thread, std::max(nice - OVERRUN_NICE_STEP, OVERRUN_NICE_LIMIT)) == 0)) {
+            TRACE(AVSClient, (_T("Repeated overruns, detection thread nice level raised from %d to %d"), nice, ::getpriority(PRIO_PROCESS, thread)));
+        } else if (m_maxSamplesPerBatch < ToSamples(OVERRUN_BATCH_LIMIT)) {
+            // Without the privilege to raise the priority, fewer and larger pushes spend less time per second of audio
+            m_maxSamplesPerBatch = std::min(m_maxSamplesPerBatch * 2, ToSamples(OVERRUN_BATCH_LIMIT));
+            TRACE(AVSClient, (_T("Repeated overruns, batches grown to %u samples"), static_cast<uint32_t>(m_maxSamplesPerBatch)));
+        } else {
+            TRACE(AVSClient, (_T("Repeated overruns, no further escalation possible")));
+        }
+    }
+
+    void KeywordDetector::ReportStatistics(const size_t samples)
+    {
+        m_reportSamples += samples;
+
+        const uint64_t seconds = m_reportSamples / AudioFormatCompatibility::SAMPLE_RATE_HZ;
+        if (seconds >= PUSH_REPORT_INTERVAL_S) {
+            const uint64_t decoded = m_decodingSamples;
+            const uint64_t gated = m_gatedSamples;
+            const uint64_t total = decoded + gated + m_idleSamples;
+
+            TRACE(AVSClient, (_T("Keyword detection: %u pushes per second, %u samples per push, %u%% batched in silence, %u us decoding per second of audio"),
+                static_cast<uint32_t>(m_pushes / seconds), static_cast<uint32_t>(m_pushes != 0 ? m_pushedSamples / m_pushes : 0),
+                (m_pushes != 0 ? (m_batchedPushes * 100) / m_pushes : 0), static_cast<uint32_t>(m_pushTimeUs / seconds)));
+            TRACE(AVSClient, (_T("Keyword detection: VAD %s, %s, %u%% of all audio decoded, %u%% gated, %u wakeups, noise floor %u, %u overruns"),
+                (m_isVoiceActive == true ? _T("active") : _T("inactive")), (m_isIdle == true ? _T("idle") : _T("decoding")),
+                static_cast<uint32_t>((decoded * 100) / total), static_cast<uint32_t>((gated * 100) / total), m_wakeups.load(), m_energyGate.NoiseFloor(), m_overruns.load()));
+            TRACE(AVSClient, (_T("Keyword detection thread: wakeup latency %u us average, %u us max over %u waits"),
+                m_latency.AverageUs(), m_latency.MaxUs(), m_latency.Count()));
+
+            m_latency.Reset();
+            m_pushes = 0;
+            m_batchedPushes = 0;
+            m_pushedSamples = 0;
+            m_pushTimeUs = 0;
+            m_reportSamples = 0;
+        }
+    }
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,211 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <AVSCommon/AVS/AudioInputStream.h>
+#include <AVSCommon/SDKInterfaces/KeyWordDetectorStateObserverInterface.h>
+#include <AVSCommon/SDKInterfaces/KeyWordObserverInterface.h>
+#include <AVSCommon/Utils/AudioFormat.h>
+#include <KWD/AbstractKeywordDetector.h>
+
+#include "KeywordDetectorSettings.h"
+#include "KeywordEngine.h"
+#include "KeywordTelemetry.h"
+#include "StreamSignal.h"
+#include "VoiceEnergy.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    /// Reads the shared data stream and pushes it to a keyword engine per locale, batching the audio and gating silence
+    /// whatever engine decodes it.
+    class KeywordDetector : public alexaClientSDK::kwd::AbstractKeywordDetector, private KeywordEngine::IObserver {
+    public:
+        static constexpr uint32_t DEFAULT_DETECTION_THRESHOLD = 200;
+        static constexpr uint32_t MIN_DETECTION_THRESHOLD = 1;
+        static constexpr uint32_t MAX_DETECTION_THRESHOLD = 1000;
+
+        // Without a stream signal from the writer, the stream is read with timed blocking reads
+        static std::unique_ptr<KeywordDetector> create(
+            std::shared_ptr<alexaClientSDK::avsCommon::avs::AudioInputStream> stream,
+            std::shared_ptr<StreamSignal> streamSignal,
+            alexaClientSDK::avsCommon::utils::AudioFormat audioFormat,
+            std::unordered_set<std::shared_ptr<alexaClientSDK::avsCommon::sdkInterfaces::KeyWordObserverInterface>> keyWordObservers,
+            std::unordered_set<std::shared_ptr<alexaClientSDK::avsCommon::sdkInterfaces::KeyWordDetectorStateObserverInterface>> keyWordDetectorStateObservers,
+            const std::string& modelFilePath,
+            const KeywordDetectorSettings& settings = KeywordDetectorSettings(),
+            std::chrono::milliseconds msToPushPerIteration = std::chrono::milliseconds(10),
+            const uint32_t detectionThreshold = DEFAULT_DETECTION_THRESHOLD,
+            const bool energyGate = true);
+
+        ~KeywordDetector() override;
+
+        // Low-power mode metrics, these may be read from any thread
+        bool IsVoiceActive() const;
+        bool IsIdle() const;
+        std::chrono::milliseconds DecodingTime() const;
+        std::chrono::milliseconds IdleTime() const;
+        uint32_t Wakeups() const;
+        std::chrono::milliseconds GatedTime() const;
+        uint32_t Overruns() const;
+        // Audio skipped by the overruns, and the time taken to decode live audio again after the last one
+        std::chrono::milliseconds OverrunTime() const;
+        std::chrono::milliseconds RecoveryTime() const;
+        // Recent detections and the confidence histograms, may be read from any thread
+        void Telemetry(KeywordTelemetry::Snapshot& snapshot) const;
+
+        // Both may be called from any thread, the detection thread takes the change over between two pushes.
+        // The decoders for the new locales are built by the caller, detection keeps running on the current ones meanwhile.
+        bool SwapModels(const std::string& locales);
+        // An empty keyword sets the threshold of all keywords. The threshold of a keyword is applied by the detection thread,
+        // which drops it if no locale has the keyword, false then. It is kept if the detection thread does not apply it in time.
+        bool Threshold(const std::string& keyword, const uint32_t threshold);
+
+    private:
+        KeywordDetector(
+            std::shared_ptr<alexaClientSDK::avsCommon::avs::AudioInputStream> stream,
+            std::shared_ptr<StreamSignal> streamSignal,
+            std::unordered_set<std::shared_ptr<alexaClientSDK::avsCommon::sdkInterfaces::KeyWordObserverInterface>> keyWordObservers,
+            std::unordered_set<std::shared_ptr<alexaClientSDK::avsCommon::sdkInterfaces::KeyWordDetectorStateObserverInterface>> keyWordDetectorStateObservers,
+            alexaClientSDK::avsCommon::utils::AudioFormat audioFormat,
+            std::chrono::milliseconds msToPushPerIteration = std::chrono::milliseconds(10),
+            const bool energyGate = true);
+
+        bool Initialize(const std::string& modelFilePath, const KeywordDetectorSettings& settings, const uint32_t detectionThreshold);
+        bool CreateDecoders(const std::string& locales, std::vector<std::unique_ptr<KeywordEngine>>& decoders);
+        void Reconfigure();
+        void DetectionLoop();
+        ssize_t Read(int16_t samples[], const size_t count);
+        void Pause(const std::chrono::microseconds duration);
+        void PushLoop(const uint8_t worker);
+        KeywordEngine::Error Push(const int16_t samples[], const size_t count, const alexaClientSDK::avsCommon::avs::AudioInputStream::Index index);
+        KeywordEngine::Error PushShare(const uint8_t worker, const int16_t samples[], const size_t count);
+        void Detected(const KeywordEngine& engine, const char keyword[], const int32_t confidence, const uint64_t begin, const uint64_t end) override;
+        void VoiceActivity(const KeywordEngine& engine, const bool isActive) override;
+        alexaClientSDK::avsCommon::avs::AudioInputStream::Index StreamIndex(const KeywordEngine& engine, const uint64_t offset) const;
+        void LookBack(const int16_t samples[], const size_t count, const alexaClientSDK::avsCommon::avs::AudioInputStream::Index index);
+        bool Wake();
+        bool Rewind();
+        bool Recover();
+        void Escalate();
+        void ReportStatistics(const size_t samples);
+
+        std::atomic<bool> m_isShuttingDown;
+        // Wakes the detection thread from a pause as soon as it shuts down
+        std::mutex m_shutdownLock;
+        std::condition_variable m_shutdown;
+        const std::shared_ptr<alexaClientSDK::avsCommon::avs::AudioInputStream> m_stream;
+        const std::shared_ptr<StreamSignal> m_streamSignal;
+        std::shared_ptr<alexaClientSDK::avsCommon::avs::AudioInputStream::Reader> m_streamReader;
+        std::thread m_detectionThread;
+        const size_t m_maxSamplesPerPush;
+        // Pushed at once while the VAD reports silence, grows on repeated overruns
+        size_t m_maxSamplesPerBatch;
+        // Set from the VAD callback, which runs on the detection thread
+        std::atomic<bool> m_isVoiceActive;
+        // While idle only the block energy is checked, the decoder is not fed
+        std::atomic<bool> m_isIdle;
+        // Samples pushed since the VAD last reported voice
+        size_t m_silentSamples;
+        // Clearly silent blocks are not pushed, the most recent ones are kept to be pushed ahead of the next voice
+        const bool m_isGated;
+        VoiceEnergyGate m_energyGate;
+        std::vector<int16_t> m_lookBack;
+        // Stream index just after the audio kept back
+        alexaClientSDK::avsCommon::avs::AudioInputStream::Index m_lookBackEnd;
+        size_t m_hangoverSamples;
+        // Stretches of the stream pushed to the decoders without a gap, most recent last. Gated audio, replays and
+        // overruns break the stream up, so the engine offsets of a detection are mapped through them. Written by the
+        // detection thread before each push, only read during one.
+        struct Span {
+            alexaClientSDK::avsCommon::avs::AudioInputStream::Index start;
+            uint64_t count;
+        };
+        std::deque<Span> m_spans;
+        uint64_t m_spanSamples;
+        std::vector<std::unique_ptr<KeywordEngine>> m_decoders;
+        std::string m_engine;
+        std::string m_modelFilePath;
+        bool m_lockModels;
+        ThreadScheduling m_scheduling;
+        // Detection thread only, how late it wakes up from waiting for a batch
+        SchedulingLatency m_latency;
+
+        // Set from any thread, taken over by the detection thread when m_isReconfigured is raised
+        std::mutex m_reconfigureLock;
+        std::atomic<bool> m_isReconfigured;
+        std::vector<std::unique_ptr<KeywordEngine>> m_pendingDecoders;
+        // Swapped out by the detection thread, freed by SwapModels()
+        std::vector<std::unique_ptr<KeywordEngine>> m_retiredDecoders;
+        // Raised by the detection thread whenever it has taken the changes over
+        std::condition_variable m_reconfigured;
+        uint32_t m_reconfigurations;
+        uint32_t m_detectionThreshold;
+        std::map<std::string, uint32_t> m_keywordThresholds;
+
+        // Decoders beyond the first are shared out over these workers, each block is pushed by all of them before the next is read
+        std::vector<std::thread> m_workers;
+        std::mutex m_poolLock;
+        std::condition_variable m_poolStart;
+        std::condition_variable m_poolDone;
+        const int16_t* m_poolSamples;
+        size_t m_poolCount;
+        uint32_t m_poolRound;
+        uint8_t m_poolPending;
+        KeywordEngine::Error m_poolError;
+
+        // Several locales may detect the same keyword, only the first is reported
+        std::mutex m_detectionLock;
+        alexaClientSDK::avsCommon::avs::AudioInputStream::Index m_lastDetectionEnd;
+        // Written under the detection lock
+        KeywordTelemetry m_telemetry;
+
+        std::atomic<uint64_t> m_decodingSamples;
+        std::atomic<uint64_t> m_idleSamples;
+        std::atomic<uint32_t> m_wakeups;
+        std::atomic<uint64_t> m_gatedSamples;
+
+        // The reader is moved up to the writer after an overrun, repeated ones are escalated
+        std::atomic<uint32_t> m_overruns;
+        std::atomic<uint64_t> m_overrunSamples;
+        std::atomic<uint32_t> m_recoveryTimeMs;
+        std::chrono::steady_clock::time_point m_lastOverrun;
+        bool m_isRecovering;
+
+        // Push statistics since the last report, detection thread only
+        uint32_t m_pushes;
+        uint32_t m_batchedPushes;
+        uint64_t m_pushedSamples;
+        uint64_t m_pushTimeUs;
+        uint64_t m_reportSamples;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
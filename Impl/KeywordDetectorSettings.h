@@ -0,0 +1,48 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "Module.h"
+#include "ThreadScheduling.h"
+
+namespace WPEFramework {
+namespace Plugin {
+
+    struct KeywordDetectorSettings {
+        KeywordDetectorSettings()
+            : engine()
+            , locales()
+            , lockModels(false)
+            , scheduling()
+        {
+        }
+
+        // Name of the keyword engine, empty for the default one
+        string engine;
+        // Locales whose models run side by side, separated by commas; empty for the default locale
+        string locales;
+        // Keeps the mapped models resident, so a detection never waits for a page to be read back
+        bool lockModels;
+        // Applied to the detection thread and the threads that decode the other locales
+        ThreadScheduling scheduling;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,96 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "KeywordEngine.h"
+
+#include "Module.h"
+#include "TemplateKeywordEngine.h"
+#if defined(KWD_PRYON)
+#include "PryonKeywordEngine.h"
+#endif
+
+#include <AVSCommon/Utils/Configuration/ConfigurationNode.h>
+
+#include <set>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    static const std::string KEY_MODEL_LOCALES = "alexa";
+
+    constexpr KeywordEngine::Error KeywordEngine::ERROR_NONE;
+    constexpr const char* KeywordEngine::PRYON;
+    constexpr const char* KeywordEngine::TEMPLATE;
+
+    /* static */ std::unique_ptr<KeywordEngine> KeywordEngine::Create(const std::string& engine, IObserver& observer, const std::string& locale)
+    {
+        std::unique_ptr<KeywordEngine> result;
+
+#if defined(KWD_PRYON)
+        if (engine == PRYON) {
+            result.reset(new PryonKeywordEngine(observer, locale));
+        }
+#endif
+        if (engine == TEMPLATE) {
+            result.reset(new TemplateKeywordEngine(observer, locale));
+        }
+
+        return (result);
+    }
+
+    /* static */ bool KeywordEngine::IsAvailable(const std::string& engine)
+    {
+#if defined(KWD_PRYON)
+        if (engine == PRYON) {
+            return (true);
+        }
+#endif
+        return (engine == TEMPLATE);
+    }
+
+    /* static */ const char* KeywordEngine::Default()
+    {
+#if defined(KWD_PRYON)
+        return (PRYON);
+#else
+        return (TEMPLATE);
+#endif
+    }
+
+    std::string KeywordEngine::Model(const std::string& modelsPath) const
+    {
+        std::string result;
+
+        std::set<std::string> models;
+        auto localeToModelsConfig = alexaClientSDK::avsCommon::utils::configuration::ConfigurationNode::getRoot()[KEY_MODEL_LOCALES];
+        if (localeToModelsConfig.getStringValues(m_locale, &models) == false) {
+            TRACE(AVSClient, (_T("Failed to get locale %s from config"), m_locale.c_str()));
+        } else {
+            for (auto it = models.cbegin(); it != models.cend(); ++it) {
+                if (!it->empty()) {
+                    result = modelsPath + "/" + (*it);
+                }
+            }
+        }
+
+        return (result);
+    }
+
+} // namespace Plugin
+} // namespace WPEFramework
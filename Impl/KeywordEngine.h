@@ -0,0 +1,118 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    /// Decodes the audio of one locale for the KeywordDetector, which owns the stream, the batching and the metrics.
+    /// An engine is only used from one thread at a time and calls its observer from within Push.
+    class KeywordEngine {
+    public:
+        // Engine specific, anything but ERROR_NONE stops detection
+        typedef int32_t Error;
+        static constexpr Error ERROR_NONE = 0;
+
+        // Compiled in with the vendor library
+        static constexpr const char* PRYON = "pryon";
+        // Runs anywhere, for testing and benchmarking the detection pipeline
+        static constexpr const char* TEMPLATE = "template";
+
+        struct IObserver {
+            virtual ~IObserver() = default;
+
+            // Begin and end count the samples pushed to the engine since it was initialized or reset
+            virtual void Detected(const KeywordEngine& engine, const char keyword[], const int32_t confidence, const uint64_t begin, const uint64_t end) = 0;
+            // Only from the engine that was initialized to run its VAD
+            virtual void VoiceActivity(const KeywordEngine& engine, const bool isActive) = 0;
+        };
+
+        KeywordEngine() = delete;
+        KeywordEngine(const KeywordEngine&) = delete;
+        KeywordEngine& operator=(const KeywordEngine&) = delete;
+
+        KeywordEngine(IObserver& observer, const std::string& locale)
+            : m_observer(observer)
+            , m_locale(locale)
+            , m_pushed(0)
+        {
+        }
+
+        virtual ~KeywordEngine() = default;
+
+        // Nullptr for an engine that is unknown or not compiled in
+        static std::unique_ptr<KeywordEngine> Create(const std::string& engine, IObserver& observer, const std::string& locale);
+        static bool IsAvailable(const std::string& engine);
+        // The vendor engine when it is compiled in, the template engine otherwise
+        static const char* Default();
+
+    public:
+        // The models path holds the localeToModels.json mapping, the model of the locale is looked up through it
+        virtual bool Initialize(const std::string& modelsPath, const uint32_t detectionThreshold, const bool useVad, const bool lockModel) = 0;
+        // Nullptr sets the threshold of all keywords
+        virtual Error Threshold(const char keyword[], const uint32_t threshold) = 0;
+        // Bytes of model data in use
+        virtual size_t ModelSize() const = 0;
+
+        Error Push(const int16_t samples[], const size_t count)
+        {
+            m_pushed += count;
+            return (Decode(samples, count));
+        }
+
+        // Drops all audio history, the model is kept
+        Error Reset()
+        {
+            m_pushed = 0;
+            return (Restart());
+        }
+
+        // Samples pushed since the engine was initialized or reset, including those of the current push
+        uint64_t Pushed() const
+        {
+            return (m_pushed);
+        }
+
+        const std::string& Locale() const
+        {
+            return (m_locale);
+        }
+
+    protected:
+        virtual Error Decode(const int16_t samples[], const size_t count) = 0;
+        virtual Error Restart() = 0;
+
+        // Path of the model of this locale without its extension, empty when the locale has no model
+        std::string Model(const std::string& modelsPath) const;
+
+        IObserver& m_observer;
+
+    private:
+        const std::string m_locale;
+        uint64_t m_pushed;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,202 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    /// Recent keyword detections and the confidence histogram of each locale, for tuning thresholds in the field.
+    /// There is one writer, which never blocks or allocates. Readers on any other thread copy the records
+    /// and skip any record that is overwritten while they copy it.
+    class KeywordTelemetry {
+    public:
+        static constexpr uint32_t DETECTIONS = 64;
+        static constexpr uint8_t LOCALES = 8;
+        static constexpr uint16_t BUCKET_WIDTH = 50;
+        // Confidences run from 0 to 1000, the last bucket also takes 1000 and above
+        static constexpr uint8_t BUCKETS = 20;
+        static constexpr uint8_t NAME_LENGTH = 24;
+
+        struct Detection {
+            // Milliseconds since the epoch
+            uint64_t timestamp;
+            // Stream indices of the keyword
+            uint64_t begin;
+            uint64_t end;
+            int32_t confidence;
+            // Milliseconds of audio the reader was behind the writer when the keyword was detected
+            uint32_t lag;
+            // Milliseconds of audio written after the end of the keyword by the time it was detected
+            uint32_t latency;
+            // False when an earlier detection, from another locale, already covered it
+            bool reported;
+            char keyword[NAME_LENGTH];
+            char locale[NAME_LENGTH];
+        };
+
+        struct Histogram {
+            std::string locale;
+            uint32_t counts[BUCKETS];
+        };
+
+        struct Snapshot {
+            // Detections since the start, the oldest of them may no longer be in the list
+            uint64_t recorded;
+            std::vector<Detection> detections;
+            std::vector<Histogram> histograms;
+        };
+
+        KeywordTelemetry(const KeywordTelemetry&) = delete;
+        KeywordTelemetry& operator=(const KeywordTelemetry&) = delete;
+
+        KeywordTelemetry()
+            : m_slots()
+            , m_recorded{ 0 }
+            , m_histograms()
+            , m_locales{ 0 }
+        {
+        }
+
+        ~KeywordTelemetry() = default;
+
+    public:
+        static void Name(char destination[NAME_LENGTH], const char source[])
+        {
+            ::strncpy(destination, source, NAME_LENGTH - 1);
+            destination[NAME_LENGTH - 1] = '\0';
+        }
+
+        // Writer side
+        void Record(const Detection& detection)
+        {
+            const uint64_t index = m_recorded.load(std::memory_order_relaxed);
+            Slot& slot = m_slots[index % DETECTIONS];
+
+            // Odd while the record is written, then twice the number of times the slot was filled
+            slot.sequence.store(Sequence(index) - 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.detection = detection;
+            slot.sequence.store(Sequence(index), std::memory_order_release);
+            m_recorded.store(index + 1, std::memory_order_release);
+
+            Counts* counts = Find(detection.locale);
+            if (counts != nullptr) {
+                const uint8_t bucket = static_cast<uint8_t>(std::min<int32_t>(std::max<int32_t>(detection.confidence, 0) / BUCKET_WIDTH, BUCKETS - 1));
+                counts->counts[bucket].fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        // Reader side, the detections are listed oldest first
+        void Read(Snapshot& snapshot) const
+        {
+            const uint64_t recorded = m_recorded.load(std::memory_order_acquire);
+
+            snapshot.recorded = recorded;
+            snapshot.detections.clear();
+            for (uint64_t index = (recorded > DETECTIONS ? recorded - DETECTIONS : 0); index < recorded; index++) {
+                const Slot& slot = m_slots[index % DETECTIONS];
+                const uint32_t before = slot.sequence.load(std::memory_order_acquire);
+                const Detection detection = slot.detection;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if ((before == Sequence(index)) && (slot.sequence.load(std::memory_order_relaxed) == before)) {
+                    snapshot.detections.push_back(detection);
+                }
+            }
+
+            snapshot.histograms.clear();
+            const uint8_t locales = m_locales.load(std::memory_order_acquire);
+            for (uint8_t index = 0; index < locales; index++) {
+                Histogram histogram;
+                histogram.locale = m_histograms[index].locale;
+                for (uint8_t bucket = 0; bucket < BUCKETS; bucket++) {
+                    histogram.counts[bucket] = m_histograms[index].counts[bucket].load(std::memory_order_relaxed);
+                }
+                snapshot.histograms.push_back(histogram);
+            }
+        }
+
+    private:
+        struct Slot {
+            Slot()
+                : sequence{ 0 }
+                , detection()
+            {
+            }
+
+            std::atomic<uint32_t> sequence;
+            Detection detection;
+        };
+
+        // The locale is published before its counts, and never changes after that
+        struct Counts {
+            Counts()
+                : locale()
+            {
+                for (std::atomic<uint32_t>& count : counts) {
+                    count.store(0, std::memory_order_relaxed);
+                }
+            }
+
+            char locale[NAME_LENGTH];
+            std::atomic<uint32_t> counts[BUCKETS];
+        };
+
+        static uint32_t Sequence(const uint64_t index)
+        {
+            return (static_cast<uint32_t>(((index / DETECTIONS) + 1) * 2));
+        }
+
+        // Locales beyond the first LOCALES seen have no histogram
+        Counts* Find(const char locale[])
+        {
+            Counts* result = nullptr;
+            const uint8_t locales = m_locales.load(std::memory_order_relaxed);
+
+            for (uint8_t index = 0; (result == nullptr) && (index < locales); index++) {
+                if (::strcmp(m_histograms[index].locale, locale) == 0) {
+                    result = &m_histograms[index];
+                }
+            }
+
+            if ((result == nullptr) && (locales < LOCALES)) {
+                result = &m_histograms[locales];
+                Name(result->locale, locale);
+                m_locales.store(locales + 1, std::memory_order_release);
+            }
+
+            return (result);
+        }
+
+    private:
+        Slot m_slots[DETECTIONS];
+        std::atomic<uint64_t> m_recorded;
+        Counts m_histograms[LOCALES];
+        std::atomic<uint8_t> m_locales;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
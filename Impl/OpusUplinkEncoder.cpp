@@ -0,0 +1,287 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "OpusUplinkEncoder.h"
+
+#include "Module.h"
+#include "CompatibleAudioFormat.h"
+
+#include <chrono>
+#include <climits>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    using namespace alexaClientSDK::avsCommon;
+    using namespace alexaClientSDK::avsCommon::avs;
+    using namespace alexaClientSDK::avsCommon::sdkInterfaces;
+
+    // AVS accepts Opus at 16 kHz, 32 kbit/s CBR in 20 ms frames
+    static constexpr opus_int32 BITRATE = 32000;
+    static constexpr size_t FRAME_SAMPLES = (AudioFormatCompatibility::SAMPLE_RATE_HZ / 1000) * 20;
+    static constexpr size_t FRAME_BYTES = (BITRATE / 8) / 50;
+    static constexpr size_t LPCM_FRAME_BYTES = FRAME_SAMPLES * sizeof(int16_t);
+
+    // The encoded stream holds as much audio as the LPCM stream, bytes are the words.
+    // Only recognize requests read it, one more while a new request takes over from the previous one.
+    static constexpr size_t ENCODED_WORD_SIZE = 1;
+    static constexpr size_t ENCODED_MAX_READERS = 2;
+
+    // Only used when the writer of the stream does not raise a stream signal
+    static const std::chrono::milliseconds TIMEOUT_FOR_READ_CALLS = std::chrono::milliseconds(1000);
+    // Encoded ahead of the writer when the dialog starts expecting or listening, the request has started reading before
+    static constexpr size_t PRE_ROLL_SAMPLES = (AudioFormatCompatibility::SAMPLE_RATE_HZ / 1000) * 200;
+
+    std::unique_ptr<OpusUplinkEncoder> OpusUplinkEncoder::create(
+        std::shared_ptr<AudioInputStream> stream,
+        std::shared_ptr<StreamSignal> streamSignal,
+        utils::AudioFormat audioFormat)
+    {
+        if (!stream) {
+            TRACE_GLOBAL(AVSClient, (_T("Failed to create OpusUplinkEncoder: stream is nullptr")));
+            return nullptr;
+        }
+
+        if (!AudioFormatCompatibility::IsCompatible(audioFormat)) {
+            return nullptr;
+        }
+
+        std::unique_ptr<OpusUplinkEncoder> encoder(new OpusUplinkEncoder(stream, streamSignal));
+        if (!encoder->Initialize()) {
+            TRACE_GLOBAL(AVSClient, (_T("Failed to initialize OpusUplinkEncoder")));
+            return nullptr;
+        }
+
+        return encoder;
+    }
+
+    OpusUplinkEncoder::OpusUplinkEncoder(std::shared_ptr<AudioInputStream> stream, std::shared_ptr<StreamSignal> streamSignal)
+        : m_isShuttingDown{ false }
+        , m_stream{ stream }
+        , m_streamSignal{ streamSignal }
+        , m_streamReader{ nullptr }
+        , m_encodedStream{ nullptr }
+        , m_encodedWriter{ nullptr }
+        , m_encoder{ nullptr }
+        , m_encodingThread{}
+        , m_stateLock()
+        , m_activated()
+        , m_isActive{ false }
+        , m_framesEncoded{ 0 }
+        , m_bytesEncoded{ 0 }
+        , m_encodeTimeUs{ 0 }
+        , m_maxEncodeTimeUs{ 0 }
+        , m_isListening{ false }
+        , m_utteranceFrames{ 0 }
+        , m_utteranceBytes{ 0 }
+        , m_utteranceTimeUs{ 0 }
+    {
+    }
+
+    OpusUplinkEncoder::~OpusUplinkEncoder()
+    {
+        m_stateLock.lock();
+        m_isShuttingDown = true;
+        m_activated.notify_all();
+        m_stateLock.unlock();
+        if (m_streamSignal) {
+            m_streamSignal->Raise();
+        }
+        if (m_encodingThread.joinable()) {
+            m_encodingThread.join();
+        }
+
+        if (m_encoder != nullptr) {
+            opus_encoder_destroy(m_encoder);
+        }
+    }
+
+    utils::AudioFormat OpusUplinkEncoder::format() const
+    {
+        utils::AudioFormat format;
+        format.encoding = utils::AudioFormat::Encoding::OPUS;
+        format.endianness = utils::AudioFormat::Endianness::LITTLE;
+        format.sampleRateHz = AudioFormatCompatibility::SAMPLE_RATE_HZ;
+        format.sampleSizeInBits = ENCODED_WORD_SIZE * CHAR_BIT;
+        format.numChannels = AudioFormatCompatibility::NUM_CHANNELS;
+        return format;
+    }
+
+    bool OpusUplinkEncoder::Initialize()
+    {
+        int error = OPUS_OK;
+        m_encoder = opus_encoder_create(AudioFormatCompatibility::SAMPLE_RATE_HZ, AudioFormatCompatibility::NUM_CHANNELS, OPUS_APPLICATION_VOIP, &error);
+        if (error != OPUS_OK) {
+            TRACE(AVSClient, (_T("Failed to create the Opus encoder: %s"), opus_strerror(error)));
+            m_encoder = nullptr;
+            return false;
+        }
+
+        if ((opus_encoder_ctl(m_encoder, OPUS_SET_BITRATE(BITRATE)) != OPUS_OK) || (opus_encoder_ctl(m_encoder, OPUS_SET_VBR(0)) != OPUS_OK)) {
+            TRACE(AVSClient, (_T("Failed to configure the Opus encoder")));
+            return false;
+        }
+
+        const size_t encodedWords = (m_stream->getDataSize() / FRAME_SAMPLES) * FRAME_BYTES;
+        size_t bufferSize = AudioInputStream::calculateBufferSize(encodedWords, ENCODED_WORD_SIZE, ENCODED_MAX_READERS);
+        auto buffer = std::make_shared<AudioInputStream::Buffer>(bufferSize);
+        m_encodedStream = AudioInputStream::create(buffer, ENCODED_WORD_SIZE, ENCODED_MAX_READERS);
+        if (!m_encodedStream) {
+            TRACE(AVSClient, (_T("Failed to create the encoded stream")));
+            return false;
+        }
+
+        m_encodedWriter = m_encodedStream->createWriter(AudioInputStream::Writer::Policy::NONBLOCKABLE);
+        if (!m_encodedWriter) {
+            TRACE(AVSClient, (_T("Failed to create the encoded stream writer")));
+            return false;
+        }
+
+        m_streamReader = m_stream->createReader(m_streamSignal ? AudioInputStream::Reader::Policy::NONBLOCKING : AudioInputStream::Reader::Policy::BLOCKING, true);
+        if (!m_streamReader) {
+            TRACE(AVSClient, (_T("Failed to create the stream reader")));
+            return false;
+        }
+
+        m_isShuttingDown = false;
+        m_encodingThread = std::thread(&OpusUplinkEncoder::EncodingLoop, this);
+        return true;
+    }
+
+    void OpusUplinkEncoder::EncodingLoop()
+    {
+        std::vector<int16_t> samples(FRAME_SAMPLES);
+        std::vector<uint8_t> frame(FRAME_BYTES);
+        size_t filled = 0;
+        bool isEncoding = false;
+
+        while (!m_isShuttingDown) {
+            if (m_isActive == false) {
+                // Nothing reads the uplink, the microphone audio is skipped instead of encoded
+                isEncoding = false;
+                std::unique_lock<std::mutex> lock(m_stateLock);
+                m_activated.wait(lock, [this]() { return ((m_isActive == true) || (m_isShuttingDown == true)); });
+                continue;
+            }
+
+            if (isEncoding == false) {
+                isEncoding = true;
+                filled = 0;
+                if (m_streamReader->seek(PRE_ROLL_SAMPLES, AudioInputStream::Reader::Reference::BEFORE_WRITER) == false) {
+                    m_streamReader->seek(0, AudioInputStream::Reader::Reference::BEFORE_WRITER);
+                }
+            }
+
+            const ssize_t wordsRead = Read(&samples[filled], FRAME_SAMPLES - filled);
+
+            if (wordsRead > 0) {
+                filled += wordsRead;
+                if (filled == FRAME_SAMPLES) {
+                    filled = 0;
+
+                    const auto start = std::chrono::steady_clock::now();
+                    const opus_int32 length = opus_encode(m_encoder, samples.data(), FRAME_SAMPLES, frame.data(), frame.size());
+                    const uint32_t elapsed = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+
+                    if (length < 0) {
+                        TRACE(AVSClient, (_T("Failed to encode Opus frame: %s"), opus_strerror(length)));
+                    } else {
+                        m_encodedWriter->write(frame.data(), length);
+
+                        m_framesEncoded.fetch_add(1, std::memory_order_relaxed);
+                        m_bytesEncoded.fetch_add(length, std::memory_order_relaxed);
+                        m_encodeTimeUs.fetch_add(elapsed, std::memory_order_relaxed);
+                        if (elapsed > m_maxEncodeTimeUs.load(std::memory_order_relaxed)) {
+                            m_maxEncodeTimeUs.store(elapsed, std::memory_order_relaxed);
+                        }
+                    }
+                }
+            } else if (wordsRead == AudioInputStream::Reader::Error::OVERRUN) {
+                // Fell behind the microphone, continue with the newest audio
+                TRACE(AVSClient, (_T("Overrun in encoding loop")));
+                m_streamReader->seek(0, AudioInputStream::Reader::Reference::BEFORE_WRITER);
+                filled = 0;
+            } else if (wordsRead == AudioInputStream::Reader::Error::CLOSED) {
+                break;
+            }
+        }
+
+        m_streamReader->close();
+        TRACE_L1(_T("End of encoding thread"));
+    }
+
+    ssize_t OpusUplinkEncoder::Read(int16_t samples[], const size_t count)
+    {
+        ssize_t result;
+
+        if (m_streamSignal) {
+            uint64_t written = m_streamSignal->Count();
+            result = m_streamReader->read(samples, count);
+            while ((result == AudioInputStream::Reader::Error::WOULDBLOCK) && (m_isShuttingDown == false)) {
+                written = m_streamSignal->Wait(written);
+                result = m_streamReader->read(samples, count);
+            }
+        } else {
+            result = m_streamReader->read(samples, count, TIMEOUT_FOR_READ_CALLS);
+        }
+
+        return (result);
+    }
+
+    void OpusUplinkEncoder::onDialogUXStateChanged(DialogUXStateObserverInterface::DialogUXState newState)
+    {
+        const bool isListening = (newState == DialogUXStateObserverInterface::DialogUXState::LISTENING);
+        // A recognize request reads the uplink from the time the dialog expects speech until it has been understood
+        const bool isActive = ((newState == DialogUXStateObserverInterface::DialogUXState::EXPECTING)
+            || (isListening == true) || (newState == DialogUXStateObserverInterface::DialogUXState::THINKING));
+
+        if ((isListening == true) && (m_isListening == false)) {
+            m_utteranceFrames = m_framesEncoded.load(std::memory_order_relaxed);
+            m_utteranceBytes = m_bytesEncoded.load(std::memory_order_relaxed);
+            m_utteranceTimeUs = m_encodeTimeUs.load(std::memory_order_relaxed);
+            m_maxEncodeTimeUs.store(0, std::memory_order_relaxed);
+        } else if ((isListening == false) && (m_isListening == true)) {
+            ReportUtterance();
+        }
+
+        m_isListening = isListening;
+
+        if (isActive != m_isActive) {
+            std::lock_guard<std::mutex> lock(m_stateLock);
+            m_isActive = isActive;
+            m_activated.notify_all();
+        }
+    }
+
+    void OpusUplinkEncoder::ReportUtterance()
+    {
+        const uint64_t frames = m_framesEncoded.load(std::memory_order_relaxed) - m_utteranceFrames;
+        const uint64_t bytes = m_bytesEncoded.load(std::memory_order_relaxed) - m_utteranceBytes;
+        const uint64_t timeUs = m_encodeTimeUs.load(std::memory_order_relaxed) - m_utteranceTimeUs;
+        const uint64_t lpcmBytes = frames * LPCM_FRAME_BYTES;
+
+        if (frames > 0) {
+            TRACE(AVSClient, (_T("Opus uplink utterance: %u ms, %u bytes instead of %u (%u saved), encode %u us average, %u us max per frame"),
+                static_cast<uint32_t>(frames * 20), static_cast<uint32_t>(bytes), static_cast<uint32_t>(lpcmBytes), static_cast<uint32_t>(lpcmBytes - bytes),
+                static_cast<uint32_t>(timeUs / frames), m_maxEncodeTimeUs.load(std::memory_order_relaxed)));
+        }
+    }
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,105 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <AVSCommon/AVS/AudioInputStream.h>
+#include <AVSCommon/SDKInterfaces/DialogUXStateObserverInterface.h>
+#include <AVSCommon/Utils/AudioFormat.h>
+
+#include <opus.h>
+
+#include "StreamSignal.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    /// Encodes the LPCM microphone stream into a second, Opus encoded stream for the AVS uplink.
+    /// The encoder only runs while a recognize request may read the encoded stream, from the dialog expecting speech
+    /// until it stops thinking. It is created once, so its state is warm when an utterance starts, and it starts a
+    /// little before the writer, for the audio between the start of the request and the change of the dialog state.
+    /// The wake word engine keeps reading the LPCM stream.
+    class OpusUplinkEncoder : public alexaClientSDK::avsCommon::sdkInterfaces::DialogUXStateObserverInterface {
+    public:
+        // Without a stream signal from the writer, the stream is read with timed blocking reads
+        static std::unique_ptr<OpusUplinkEncoder> create(
+            std::shared_ptr<alexaClientSDK::avsCommon::avs::AudioInputStream> stream,
+            std::shared_ptr<StreamSignal> streamSignal,
+            alexaClientSDK::avsCommon::utils::AudioFormat audioFormat);
+
+        OpusUplinkEncoder(const OpusUplinkEncoder&) = delete;
+        OpusUplinkEncoder& operator=(const OpusUplinkEncoder&) = delete;
+
+        ~OpusUplinkEncoder() override;
+
+        /// The Opus encoded stream to hand to the AudioProviders
+        std::shared_ptr<alexaClientSDK::avsCommon::avs::AudioInputStream> stream() const
+        {
+            return m_encodedStream;
+        }
+
+        alexaClientSDK::avsCommon::utils::AudioFormat format() const;
+
+        /// DialogUXStateObserverInterface
+        void onDialogUXStateChanged(alexaClientSDK::avsCommon::sdkInterfaces::DialogUXStateObserverInterface::DialogUXState newState) override;
+
+    private:
+        OpusUplinkEncoder(std::shared_ptr<alexaClientSDK::avsCommon::avs::AudioInputStream> stream, std::shared_ptr<StreamSignal> streamSignal);
+
+        bool Initialize();
+        void EncodingLoop();
+        ssize_t Read(int16_t samples[], const size_t count);
+        void ReportUtterance();
+
+        std::atomic<bool> m_isShuttingDown;
+        const std::shared_ptr<alexaClientSDK::avsCommon::avs::AudioInputStream> m_stream;
+        const std::shared_ptr<StreamSignal> m_streamSignal;
+        std::shared_ptr<alexaClientSDK::avsCommon::avs::AudioInputStream::Reader> m_streamReader;
+        std::shared_ptr<alexaClientSDK::avsCommon::avs::AudioInputStream> m_encodedStream;
+        std::shared_ptr<alexaClientSDK::avsCommon::avs::AudioInputStream::Writer> m_encodedWriter;
+        OpusEncoder* m_encoder;
+        std::thread m_encodingThread;
+
+        // Set from the dialog state, the encoding thread waits for it while the uplink is not read
+        std::mutex m_stateLock;
+        std::condition_variable m_activated;
+        std::atomic<bool> m_isActive;
+
+        // Totals since start, written by the encoding thread only
+        std::atomic<uint64_t> m_framesEncoded;
+        std::atomic<uint64_t> m_bytesEncoded;
+        std::atomic<uint64_t> m_encodeTimeUs;
+        std::atomic<uint32_t> m_maxEncodeTimeUs;
+
+        // Totals at the start of the current utterance
+        bool m_isListening;
+        uint64_t m_utteranceFrames;
+        uint64_t m_utteranceBytes;
+        uint64_t m_utteranceTimeUs;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,194 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PryonKeywordEngine.h"
+
+#include "Module.h"
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    static constexpr const char* DETECTION_KEYWORD = "ALEXA";
+
+    PryonKeywordEngine::PryonKeywordEngine(IObserver& observer, const std::string& locale)
+        : KeywordEngine(observer, locale)
+        , m_decoder{ nullptr }
+        , m_config{}
+        , m_sessionInfo{}
+        , m_decoderBuffer{ nullptr }
+        , m_model{ nullptr }
+        , m_modelSize{ 0 }
+    {
+    }
+
+    PryonKeywordEngine::~PryonKeywordEngine()
+    {
+        if (m_decoder != nullptr) {
+            PryonLiteError error = PryonLiteDecoder_Destroy(&m_decoder);
+            if (error != PRYON_LITE_ERROR_OK) {
+                TRACE(AVSClient, (_T("Failed to destroy PryonLiteDecoder for %s"), Locale().c_str()));
+            }
+        }
+
+        delete[] m_decoderBuffer;
+        if (m_model != nullptr) {
+            ::munmap(const_cast<uint8_t*>(m_model), m_modelSize);
+        }
+    }
+
+    bool PryonKeywordEngine::Initialize(const std::string& modelsPath, const uint32_t detectionThreshold, const bool useVad, const bool lockModel)
+    {
+        m_config = PryonLiteDecoderConfig_Default;
+
+        const std::string model = Model(modelsPath);
+        if (model.empty() == true) {
+            return false;
+        }
+        const std::string localizedModelFilepath = model + ".bin";
+
+        // Pages are only read when the decoder touches them
+        const int modelFile = ::open(localizedModelFilepath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (modelFile < 0) {
+            TRACE(AVSClient, (_T("Failed to open model file")));
+            return false;
+        }
+
+        struct stat modelInfo;
+        void* mapping = MAP_FAILED;
+        if ((::fstat(modelFile, &modelInfo) == 0) && (modelInfo.st_size > 0)) {
+            mapping = ::mmap(nullptr, modelInfo.st_size, PROT_READ, MAP_SHARED, modelFile, 0);
+        }
+        ::close(modelFile);
+
+        if (mapping == MAP_FAILED) {
+            TRACE(AVSClient, (_T("Failed to map model file")));
+            return false;
+        }
+
+        m_model = static_cast<const uint8_t*>(mapping);
+        m_modelSize = modelInfo.st_size;
+
+        if ((lockModel == true) && (::mlock(mapping, m_modelSize) != 0)) {
+            // Not fatal, the model still works from the page cache
+            TRACE(AVSClient, (_T("Failed to lock model file in memory (%d)"), errno));
+        }
+
+        m_config.model = m_model;
+        m_config.sizeofModel = m_modelSize;
+
+        // Query for the size of instance memory required by the decoder
+        PryonLiteModelAttributes modelAttributes;
+        PryonLiteError error = PryonLite_GetModelAttributes(m_config.model, m_config.sizeofModel, &modelAttributes);
+        if (error) {
+            TRACE(AVSClient, (_T("Failed to get model attributes from config")));
+            return false;
+        }
+
+        m_decoderBuffer = new char[modelAttributes.requiredDecoderMem]();
+        m_config.decoderMem = m_decoderBuffer;
+        m_config.sizeofDecoderMem = modelAttributes.requiredDecoderMem;
+        m_config.userData = reinterpret_cast<void*>(this);
+        m_config.detectThreshold = detectionThreshold;
+        m_config.resultCallback = DetectionCallback;
+        m_config.vadCallback = VadCallback;
+        m_config.useVad = (useVad == true ? 1 : 0);
+
+        error = PryonLiteDecoder_Initialize(&m_config, &m_sessionInfo, &m_decoder);
+        if (error) {
+            TRACE(AVSClient, (_T("Failed to initialize PryonLiteDecoder")));
+            m_decoder = nullptr;
+            return false;
+        }
+
+        error = PryonLiteDecoder_SetDetectionThreshold(m_decoder, DETECTION_KEYWORD, m_config.detectThreshold);
+        if (error) {
+            TRACE(AVSClient, (_T("Failed to set detection treshold")));
+            return false;
+        }
+
+        return true;
+    }
+
+    KeywordEngine::Error PryonKeywordEngine::Decode(const int16_t samples[], const size_t count)
+    {
+        return (PryonLiteDecoder_PushAudioSamples(m_decoder, samples, count));
+    }
+
+    KeywordEngine::Error PryonKeywordEngine::Threshold(const char keyword[], const uint32_t threshold)
+    {
+        return (PryonLiteDecoder_SetDetectionThreshold(m_decoder, keyword, threshold));
+    }
+
+    // The buffers and the model are reused
+    KeywordEngine::Error PryonKeywordEngine::Restart()
+    {
+        PryonLiteError error = PryonLiteDecoder_Destroy(&m_decoder);
+        if (error == PRYON_LITE_ERROR_OK) {
+            error = PryonLiteDecoder_Initialize(&m_config, &m_sessionInfo, &m_decoder);
+            if (error != PRYON_LITE_ERROR_OK) {
+                m_decoder = nullptr;
+            }
+        }
+
+        return (error);
+    }
+
+    /* static */ void PryonKeywordEngine::DetectionCallback(PryonLiteDecoderHandle handle, const PryonLiteResult* result)
+    {
+        TRACE_L1(_T("DetectionCallback()"));
+
+        if (!result) {
+            TRACE_GLOBAL(AVSClient, (_T("Result is nullptr")));
+            return;
+        }
+
+        PryonKeywordEngine* engine = reinterpret_cast<PryonKeywordEngine*>(result->userData);
+        if (!engine) {
+            TRACE_GLOBAL(AVSClient, (_T("User data is nullptr")));
+            return;
+        }
+
+        TRACE_L1((_T("Detection Callback Results:\n"
+                     "confidenence = %d, beginSampleIndex = %d, endSampleIndex = %d, sampleLen = %d, keyword = %s, locale = %s"),
+            result->confidence, result->beginSampleIndex, result->endSampleIndex, result->endSampleIndex - result->beginSampleIndex, result->keyword, engine->Locale().c_str()));
+
+        engine->m_observer.Detected(*engine, result->keyword, result->confidence, result->beginSampleIndex, result->endSampleIndex);
+    }
+
+    /* static */ void PryonKeywordEngine::VadCallback(PryonLiteDecoderHandle handle, const PryonLiteVadEvent* vadEvent)
+    {
+        TRACE_L1(_T("VadCallback()"));
+
+        if (vadEvent != nullptr) {
+            PryonKeywordEngine* engine = reinterpret_cast<PryonKeywordEngine*>(vadEvent->userData);
+            if (engine != nullptr) {
+                engine->m_observer.VoiceActivity(*engine, (vadEvent->vadState == PRYON_LITE_VAD_ACTIVE));
+            }
+        }
+    }
+
+} // namespace Plugin
+} // namespace WPEFramework
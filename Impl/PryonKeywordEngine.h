@@ -0,0 +1,64 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "KeywordEngine.h"
+#include "pryon_lite.h"
+
+namespace WPEFramework {
+namespace Plugin {
+
+    // One PryonLite decoder, with the model of its locale
+    class PryonKeywordEngine : public KeywordEngine {
+    public:
+        PryonKeywordEngine() = delete;
+        PryonKeywordEngine(const PryonKeywordEngine&) = delete;
+        PryonKeywordEngine& operator=(const PryonKeywordEngine&) = delete;
+
+        PryonKeywordEngine(IObserver& observer, const std::string& locale);
+        ~PryonKeywordEngine() override;
+
+    public:
+        bool Initialize(const std::string& modelsPath, const uint32_t detectionThreshold, const bool useVad, const bool lockModel) override;
+        Error Threshold(const char keyword[], const uint32_t threshold) override;
+        size_t ModelSize() const override
+        {
+            return m_modelSize;
+        }
+
+    protected:
+        Error Decode(const int16_t samples[], const size_t count) override;
+        Error Restart() override;
+
+    private:
+        static void DetectionCallback(PryonLiteDecoderHandle handle, const PryonLiteResult* result);
+        static void VadCallback(PryonLiteDecoderHandle handle, const PryonLiteVadEvent* vadEvent);
+
+        PryonLiteDecoderHandle m_decoder;
+        PryonLiteDecoderConfig m_config;
+        PryonLiteSessionInfo m_sessionInfo;
+        char* m_decoderBuffer;
+        // Mapped read-only, so its pages are shared with the page cache and any other process using the model
+        const uint8_t* m_model;
+        size_t m_modelSize;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
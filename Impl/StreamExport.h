@@ -0,0 +1,256 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "Module.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    /// The microphone stream, mirrored into a shared memory file for other processes on the device.
+    /// Every write to the shared data stream is copied to the same stream index, modulo the capacity. Readers map
+    /// the file read-only and keep their cursor to themselves: they hold no reader slot of the shared data stream
+    /// and the writer never waits for them. A reader that falls more than the capacity behind is overrun.
+    class StreamExport {
+    public:
+        static constexpr uint32_t MAGIC = 0x4D535641; // "AVSM"
+        static constexpr uint16_t VERSION = 1;
+        // The audio starts at this offset in the file
+        static constexpr uint32_t DATA_OFFSET = 64;
+
+        struct Header {
+            // Written last, once the rest of the header is valid
+            std::atomic<uint32_t> magic;
+            uint16_t version;
+            uint16_t wordSize;
+            uint32_t sampleRate;
+            uint32_t channels;
+            // Words of audio the file holds
+            uint64_t capacity;
+            // End of the write in progress, moved before the audio is copied in
+            std::atomic<uint64_t> writing;
+            // Words written since the start, equal to the index of the shared data stream writer
+            std::atomic<uint64_t> written;
+        };
+
+        static_assert(sizeof(Header) <= DATA_OFFSET, "Header overlaps the audio");
+
+        /// The side of the other processes. Reading words at a cursor never changes the file, nor anything of the writer.
+        class Reader {
+        public:
+            Reader(const Reader&) = delete;
+            Reader& operator=(const Reader&) = delete;
+
+            Reader()
+                : m_file()
+                , m_header(nullptr)
+            {
+            }
+
+            ~Reader() = default;
+
+        public:
+            bool Attach(const string& path)
+            {
+                m_file.reset(new Core::DataElementFile(path, Core::File::USER_READ | Core::File::SHAREABLE));
+                if ((m_file->IsValid() == false) || (m_file->Size() < DATA_OFFSET)) {
+                    Detach();
+                } else {
+                    m_header = reinterpret_cast<const Header*>(m_file->Buffer());
+                    if ((m_header->magic.load(std::memory_order_acquire) != MAGIC) || (m_header->version != VERSION)
+                        || (m_file->Size() < (DATA_OFFSET + (m_header->capacity * m_header->wordSize)))) {
+                        Detach();
+                    }
+                }
+                return (IsAttached());
+            }
+
+            void Detach()
+            {
+                m_header = nullptr;
+                m_file.reset();
+            }
+
+            bool IsAttached() const
+            {
+                return (m_header != nullptr);
+            }
+
+            const Header& Format() const
+            {
+                ASSERT(IsAttached() == true);
+                return (*m_header);
+            }
+
+            // Cursor to start reading live audio at
+            uint64_t Written() const
+            {
+                ASSERT(IsAttached() == true);
+                return (m_header->written.load(std::memory_order_acquire));
+            }
+
+            // Copies up to words words from the cursor on and moves it past them. When the writer overran the cursor,
+            // nothing is copied, overrun is set and the cursor moves to the live audio.
+            uint32_t Read(uint64_t& cursor, uint8_t data[], const uint32_t words, bool& overrun) const
+            {
+                ASSERT(IsAttached() == true);
+
+                const uint64_t capacity = m_header->capacity;
+                const uint64_t written = m_header->written.load(std::memory_order_acquire);
+                uint32_t result = 0;
+
+                // Behind the cursor after a restart of the writer
+                overrun = ((cursor > written) || ((written - cursor) > capacity));
+
+                if (overrun == false) {
+                    result = static_cast<uint32_t>(std::min<uint64_t>(words, written - cursor));
+                    Copy(cursor, data, result);
+                    std::atomic_thread_fence(std::memory_order_acquire);
+
+                    // Words overwritten while they were copied can not be trusted
+                    overrun = (m_header->writing.load(std::memory_order_relaxed) > (cursor + capacity));
+                }
+
+                if (overrun == true) {
+                    cursor = m_header->written.load(std::memory_order_acquire);
+                    result = 0;
+                } else {
+                    cursor += result;
+                }
+
+                return (result);
+            }
+
+        private:
+            void Copy(const uint64_t cursor, uint8_t data[], const uint32_t words) const
+            {
+                const uint16_t wordSize = m_header->wordSize;
+                const uint64_t capacity = m_header->capacity;
+                const uint8_t* audio = m_file->Buffer() + DATA_OFFSET;
+                const uint64_t offset = cursor % capacity;
+                const uint64_t first = std::min<uint64_t>(words, capacity - offset);
+
+                ::memcpy(data, audio + (offset * wordSize), first * wordSize);
+                ::memcpy(data + (first * wordSize), audio, (words - first) * wordSize);
+            }
+
+        private:
+            std::unique_ptr<Core::DataElementFile> m_file;
+            const Header* m_header;
+        };
+
+    public:
+        StreamExport(const StreamExport&) = delete;
+        StreamExport& operator=(const StreamExport&) = delete;
+
+        StreamExport()
+            : m_file()
+            , m_header(nullptr)
+            , m_path()
+        {
+        }
+
+        ~StreamExport() = default;
+
+    public:
+        bool Open(const string& path, const uint64_t capacity, const uint16_t wordSize, const uint32_t sampleRate, const uint32_t channels)
+        {
+            const uint64_t size = DATA_OFFSET + (capacity * wordSize);
+
+            if ((capacity > 0) && (size <= UINT32_MAX)) {
+                // Other users of the group may map it, but only for reading
+                m_file.reset(new Core::DataElementFile(path, Core::File::USER_READ | Core::File::USER_WRITE | Core::File::GROUP_READ | Core::File::SHAREABLE | Core::File::CREATE, static_cast<uint32_t>(size)));
+                if ((m_file->IsValid() == false) || (m_file->Size() < size)) {
+                    m_file.reset();
+                } else {
+                    m_header = reinterpret_cast<Header*>(m_file->Buffer());
+                    m_header->magic.store(0, std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_release);
+                    m_header->version = VERSION;
+                    m_header->wordSize = wordSize;
+                    m_header->sampleRate = sampleRate;
+                    m_header->channels = channels;
+                    m_header->capacity = capacity;
+                    m_header->writing.store(0, std::memory_order_relaxed);
+                    m_header->written.store(0, std::memory_order_relaxed);
+                    m_header->magic.store(MAGIC, std::memory_order_release);
+                    m_path = path;
+                }
+            }
+
+            return (IsOpen());
+        }
+
+        bool IsOpen() const
+        {
+            return (m_header != nullptr);
+        }
+
+        const string& Path() const
+        {
+            return (m_path);
+        }
+
+        uint64_t Capacity() const
+        {
+            return (IsOpen() ? m_header->capacity : 0);
+        }
+
+        uint64_t Written() const
+        {
+            return (IsOpen() ? m_header->written.load(std::memory_order_relaxed) : 0);
+        }
+
+        // Called by the writer of the shared data stream, right after it wrote the same words
+        void Write(const uint8_t data[], const uint64_t words)
+        {
+            if ((IsOpen() == true) && (words > 0)) {
+                const uint16_t wordSize = m_header->wordSize;
+                const uint64_t capacity = m_header->capacity;
+                const uint64_t written = m_header->written.load(std::memory_order_relaxed);
+                // More than the capacity at once leaves only the last of it
+                const uint64_t kept = std::min(words, capacity);
+                const uint64_t start = written + (words - kept);
+                uint8_t* audio = m_file->Buffer() + DATA_OFFSET;
+                const uint64_t offset = start % capacity;
+                const uint64_t first = std::min(kept, capacity - offset);
+
+                m_header->writing.store(written + words, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+                ::memcpy(audio + (offset * wordSize), data + ((words - kept) * wordSize), first * wordSize);
+                ::memcpy(audio, data + ((words - kept + first) * wordSize), (kept - first) * wordSize);
+                m_header->written.store(written + words, std::memory_order_release);
+            }
+        }
+
+    private:
+        std::unique_ptr<Core::DataElementFile> m_file;
+        Header* m_header;
+        string m_path;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,117 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "Module.h"
+#include "CompatibleAudioFormat.h"
+#include "TraceCategories.h"
+
+#include <AVSCommon/AVS/AudioInputStream.h>
+
+#include <memory>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    /// Sizing of the shared data stream the microphone audio is written to.
+    /// Nearly all of its memory is the audio itself, so a memory budget cuts down its duration.
+    struct StreamSettings {
+        static constexpr uint8_t DEFAULT_DURATION = 15;
+        // Holds the pre-roll replayed to the keyword detector and the keyword read by a recognize request
+        static constexpr uint8_t MIN_DURATION = 2;
+
+        StreamSettings()
+            : duration(DEFAULT_DURATION)
+            , readers(0)
+            , budget(0)
+            , exportPath()
+        {
+        }
+
+        // Readers of the enabled features: recognize requests, one more while a new request takes over from the
+        // previous one, keyword detection, the Opus encoder and the black box. The voice sources are mixed before the stream.
+        static uint8_t Readers(const bool keywordDetection, const bool opusUplink, const bool blackBox)
+        {
+            return (2 + (keywordDetection == true ? 1 : 0) + (opusUplink == true ? 1 : 0) + (blackBox == true ? 1 : 0));
+        }
+
+        // Samples of audio the stream holds for that many readers, once the budget has cut it down
+        size_t Samples(const uint8_t streamReaders) const
+        {
+            size_t size;
+            return (Samples(streamReaders, size));
+        }
+
+        // Nullptr when the budget does not even hold MIN_DURATION seconds of audio
+        std::shared_ptr<alexaClientSDK::avsCommon::avs::AudioInputStream> Create(const uint8_t streamReaders) const
+        {
+            using alexaClientSDK::avsCommon::avs::AudioInputStream;
+
+            std::shared_ptr<AudioInputStream> result;
+            size_t size;
+            const size_t words = Samples(streamReaders, size);
+
+            if (words < (static_cast<size_t>(MIN_DURATION) * AudioFormatCompatibility::SAMPLE_RATE_HZ)) {
+                TRACE_GLOBAL(AVSClient, (_T("Shared data stream budget of %u kB holds less than %u s of audio"), budget, MIN_DURATION));
+            } else {
+                auto buffer = std::make_shared<AudioInputStream::Buffer>(size);
+                result = AudioInputStream::create(buffer, WORD_SIZE, streamReaders);
+                if (result) {
+                    TRACE_GLOBAL(AVSClient, (_T("Shared data stream: %u ms of audio for %u readers, %u kB"),
+                        static_cast<uint32_t>((words * 1000) / AudioFormatCompatibility::SAMPLE_RATE_HZ), streamReaders, static_cast<uint32_t>(size / 1024)));
+                }
+            }
+
+            return (result);
+        }
+
+    private:
+        static constexpr size_t WORD_SIZE = AudioFormatCompatibility::SAMPLE_SIZE_IN_BITS / 8;
+
+        size_t Samples(const uint8_t streamReaders, size_t& size) const
+        {
+            using alexaClientSDK::avsCommon::avs::AudioInputStream;
+
+            size_t words = static_cast<size_t>(duration) * AudioFormatCompatibility::SAMPLE_RATE_HZ;
+            size = AudioInputStream::calculateBufferSize(words, WORD_SIZE, streamReaders);
+            const size_t overhead = size - (words * WORD_SIZE);
+            const size_t limit = static_cast<size_t>(budget) * 1024;
+
+            if ((limit != 0) && (size > limit)) {
+                words = (limit > overhead ? ((limit - overhead) / WORD_SIZE) : 0);
+                size = overhead + (words * WORD_SIZE);
+            }
+
+            return (words);
+        }
+
+    public:
+        // Seconds of audio the stream holds, unless the budget cuts it down
+        uint8_t duration;
+        // Readers the stream is sized for, 0 to derive them from the enabled features
+        uint8_t readers;
+        // Upper bound of the stream memory in kB, 0 for none
+        uint32_t budget;
+        // Shared memory file the stream is mirrored to for other processes, empty for none
+        string exportPath;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,76 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    /// Raised by the writer of a shared data stream after every write, so its readers can wait for audio without a timeout.
+    /// A blocked read of the stream itself is only woken by a write, so a reader could not be stopped without waiting
+    /// for one. Readers wait on the signal instead, and anyone may raise it to wake them up.
+    class StreamSignal {
+    public:
+        StreamSignal(const StreamSignal&) = delete;
+        StreamSignal& operator=(const StreamSignal&) = delete;
+
+        StreamSignal()
+            : m_lock()
+            , m_raised()
+            , m_count{ 0 }
+        {
+        }
+
+        ~StreamSignal() = default;
+
+    public:
+        void Raise()
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_count++;
+            m_raised.notify_all();
+        }
+
+        // Taken before reading the stream, so a write in between is not missed by the next Wait
+        uint64_t Count() const
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            return (m_count);
+        }
+
+        // Returns the new count once the signal was raised after the given one
+        uint64_t Wait(const uint64_t count) const
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_raised.wait(lock, [this, count]() { return (m_count != count); });
+            return (m_count);
+        }
+
+    private:
+        mutable std::mutex m_lock;
+        mutable std::condition_variable m_raised;
+        uint64_t m_count;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
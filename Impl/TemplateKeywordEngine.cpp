@@ -0,0 +1,509 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TemplateKeywordEngine.h"
+
+#include "Module.h"
+#include "CompatibleAudioFormat.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <complex>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#include <dirent.h>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    constexpr uint32_t TemplateKeywordEngine::WINDOW_SAMPLES;
+    constexpr uint32_t TemplateKeywordEngine::HOP_SAMPLES;
+    constexpr uint8_t TemplateKeywordEngine::COEFFICIENTS;
+
+    // Triangular filters spread evenly on the mel scale over the voice band
+    static constexpr uint8_t MEL_FILTERS = 20;
+    static constexpr double LOWEST_FILTER_HZ = 100.0;
+    static constexpr double HIGHEST_FILTER_HZ = 4000.0;
+    static constexpr uint16_t FFT_SIZE = 512;
+    // Filter energy added before the logarithm, so the spectrum of near silence is flat instead of noisy
+    static constexpr float ENERGY_FLOOR = 1e4f;
+    // Average frame distance along the warping path at which the confidence has dropped to 1/e of the maximum
+    static constexpr float DISTANCE_SCALE = 8.0f;
+    static constexpr int32_t MAX_CONFIDENCE = 1000;
+    // A match is reported once no better one has ended for this many frames, so its end is not cut short
+    static constexpr uint32_t SETTLE_FRAMES = 10;
+    // Recordings and the audio matched to them may differ this much in length
+    static constexpr uint32_t MAX_STRETCH = 2;
+    static constexpr uint32_t MIN_TEMPLATE_FRAMES = 10;
+    // Recordings are trimmed to the frames within this ratio (30 dB) of their loudest frame
+    static constexpr double TRIM_RATIO = 1000.0;
+    // Frames with energy above the noise floor before the VAD reports voice, and without before it reports silence
+    static constexpr uint32_t VOICE_ONSET_FRAMES = 3;
+    static constexpr uint32_t VOICE_HOLD_FRAMES = 30;
+
+    // Mel frequency cepstral coefficients, leaving out the first, so the level of the voice does not matter
+    class FilterBank {
+    public:
+        FilterBank(const FilterBank&) = delete;
+        FilterBank& operator=(const FilterBank&) = delete;
+
+        FilterBank()
+        {
+            const double pi = std::acos(-1.0);
+
+            for (uint32_t index = 0; index < TemplateKeywordEngine::WINDOW_SAMPLES; index++) {
+                _window[index] = static_cast<float>(0.54 - (0.46 * std::cos((2.0 * pi * index) / (TemplateKeywordEngine::WINDOW_SAMPLES - 1))));
+            }
+            for (uint16_t index = 0; index < (FFT_SIZE / 2); index++) {
+                _twiddles[index] = std::complex<float>(static_cast<float>(std::cos((2.0 * pi * index) / FFT_SIZE)), static_cast<float>(-std::sin((2.0 * pi * index) / FFT_SIZE)));
+            }
+
+            // The edges of filter n are the centres of filters n - 1 and n + 1
+            const double lowest = Mel(LOWEST_FILTER_HZ);
+            const double highest = Mel(HIGHEST_FILTER_HZ);
+            double edges[MEL_FILTERS + 2];
+            for (uint8_t index = 0; index < (MEL_FILTERS + 2); index++) {
+                const double mel = lowest + (((highest - lowest) * index) / (MEL_FILTERS + 1));
+                edges[index] = ((700.0 * (std::pow(10.0, mel / 2595.0) - 1.0)) * FFT_SIZE) / AudioFormatCompatibility::SAMPLE_RATE_HZ;
+            }
+            for (uint8_t filter = 0; filter < MEL_FILTERS; filter++) {
+                for (uint16_t bin = 0; bin <= (FFT_SIZE / 2); bin++) {
+                    const double rising = (bin - edges[filter]) / (edges[filter + 1] - edges[filter]);
+                    const double falling = (edges[filter + 2] - bin) / (edges[filter + 2] - edges[filter + 1]);
+                    _filters[filter][bin] = static_cast<float>(std::max(0.0, std::min(rising, falling)));
+                }
+            }
+
+            for (uint8_t coefficient = 0; coefficient < TemplateKeywordEngine::COEFFICIENTS; coefficient++) {
+                for (uint8_t filter = 0; filter < MEL_FILTERS; filter++) {
+                    _cosines[coefficient][filter] = static_cast<float>(std::cos((pi * (coefficient + 1) * (filter + 0.5)) / MEL_FILTERS));
+                }
+            }
+        }
+
+        ~FilterBank() = default;
+
+    public:
+        void Analyze(const int16_t samples[], float features[]) const
+        {
+            std::complex<float> spectrum[FFT_SIZE];
+            for (uint16_t index = 0; index < FFT_SIZE; index++) {
+                spectrum[index] = (index < TemplateKeywordEngine::WINDOW_SAMPLES ? samples[index] * _window[index] : 0.0f);
+            }
+            Transform(spectrum);
+
+            float energies[MEL_FILTERS];
+            for (uint8_t filter = 0; filter < MEL_FILTERS; filter++) {
+                float energy = ENERGY_FLOOR;
+                for (uint16_t bin = 0; bin <= (FFT_SIZE / 2); bin++) {
+                    energy += _filters[filter][bin] * std::norm(spectrum[bin]);
+                }
+                energies[filter] = std::log(energy);
+            }
+
+            for (uint8_t coefficient = 0; coefficient < TemplateKeywordEngine::COEFFICIENTS; coefficient++) {
+                float sum = 0;
+                for (uint8_t filter = 0; filter < MEL_FILTERS; filter++) {
+                    sum += _cosines[coefficient][filter] * energies[filter];
+                }
+                features[coefficient] = sum;
+            }
+        }
+
+    private:
+        static double Mel(const double hz)
+        {
+            return (2595.0 * std::log10(1.0 + (hz / 700.0)));
+        }
+
+        // In place radix-2
+        void Transform(std::complex<float> data[]) const
+        {
+            for (uint16_t index = 1, reversed = 0; index < FFT_SIZE; index++) {
+                uint16_t bit = FFT_SIZE >> 1;
+                for (; (reversed & bit) != 0; bit >>= 1) {
+                    reversed ^= bit;
+                }
+                reversed ^= bit;
+                if (index < reversed) {
+                    std::swap(data[index], data[reversed]);
+                }
+            }
+
+            for (uint16_t length = 2; length <= FFT_SIZE; length <<= 1) {
+                const uint16_t stride = FFT_SIZE / length;
+                for (uint16_t start = 0; start < FFT_SIZE; start += length) {
+                    for (uint16_t index = 0; index < (length / 2); index++) {
+                        const std::complex<float> odd = data[start + index + (length / 2)] * _twiddles[index * stride];
+                        data[start + index + (length / 2)] = data[start + index] - odd;
+                        data[start + index] += odd;
+                    }
+                }
+            }
+        }
+
+        float _window[TemplateKeywordEngine::WINDOW_SAMPLES];
+        std::complex<float> _twiddles[FFT_SIZE / 2];
+        float _filters[MEL_FILTERS][(FFT_SIZE / 2) + 1];
+        float _cosines[TemplateKeywordEngine::COEFFICIENTS][MEL_FILTERS];
+    };
+
+    static const FilterBank& Bank()
+    {
+        static const FilterBank bank;
+        return (bank);
+    }
+
+    static float Distance(const float a[], const float b[])
+    {
+        float sum = 0;
+        for (uint8_t index = 0; index < TemplateKeywordEngine::COEFFICIENTS; index++) {
+            const float difference = a[index] - b[index];
+            sum += difference * difference;
+        }
+        return (std::sqrt(sum));
+    }
+
+    static uint32_t Little(const uint8_t data[], const uint8_t size)
+    {
+        uint32_t value = 0;
+        for (uint8_t index = size; index > 0; index--) {
+            value = (value << 8) | data[index - 1];
+        }
+        return (value);
+    }
+
+    // 16 kHz mono 16-bit PCM only, the recordings are made for the engine
+    static bool ReadWav(const std::string& path, std::vector<int16_t>& samples)
+    {
+        std::ifstream file(path, std::ios::binary);
+        uint8_t header[12];
+        if ((file.read(reinterpret_cast<char*>(header), sizeof(header)).good() == false) || (memcmp(header, "RIFF", 4) != 0) || (memcmp(header + 8, "WAVE", 4) != 0)) {
+            return (false);
+        }
+
+        bool isFormatValid = false;
+        uint8_t chunk[8];
+        while (file.read(reinterpret_cast<char*>(chunk), sizeof(chunk)).good() == true) {
+            const uint32_t size = Little(chunk + 4, 4);
+            if (memcmp(chunk, "fmt ", 4) == 0) {
+                std::vector<uint8_t> format(size);
+                if ((size < 16) || (file.read(reinterpret_cast<char*>(format.data()), size).good() == false)) {
+                    return (false);
+                }
+                isFormatValid = ((Little(&format[0], 2) == 1) && (Little(&format[2], 2) == 1) && (Little(&format[4], 4) == AudioFormatCompatibility::SAMPLE_RATE_HZ) && (Little(&format[14], 2) == 16));
+            } else if (memcmp(chunk, "data", 4) == 0) {
+                if (isFormatValid == false) {
+                    return (false);
+                }
+                std::vector<uint8_t> data(size);
+                file.read(reinterpret_cast<char*>(data.data()), size);
+                samples.resize(static_cast<size_t>(file.gcount()) / 2);
+                for (size_t index = 0; index < samples.size(); index++) {
+                    samples[index] = static_cast<int16_t>(Little(&data[index * 2], 2));
+                }
+                return (true);
+            } else {
+                file.seekg(size + (size & 1), std::ios::cur);
+            }
+        }
+
+        return (false);
+    }
+
+    TemplateKeywordEngine::TemplateKeywordEngine(IObserver& observer, const std::string& locale)
+        : KeywordEngine(observer, locale)
+        , m_templates()
+        , m_threshold{ 0 }
+        , m_thresholds()
+        , m_useVad{ false }
+        , m_window()
+        , m_features(COEFFICIENTS)
+        , m_frame{ 0 }
+        , m_candidate{ nullptr, 0, 0, 0 }
+        , m_previousCost()
+        , m_previousLength()
+        , m_previousStart()
+        , m_gate(AudioFormatCompatibility::SAMPLE_RATE_HZ)
+        , m_voiceFrames{ 0 }
+        , m_silentFrames{ 0 }
+        , m_isVoiceActive{ false }
+    {
+    }
+
+    bool TemplateKeywordEngine::Initialize(const std::string& modelsPath, const uint32_t detectionThreshold, const bool useVad, const bool /* lockModel */)
+    {
+        const std::string model = Model(modelsPath);
+        if (model.empty() == true) {
+            return false;
+        }
+
+        DIR* directory = ::opendir(model.c_str());
+        if (directory == nullptr) {
+            TRACE(AVSClient, (_T("Failed to open template directory %s"), model.c_str()));
+            return false;
+        }
+
+        std::vector<std::string> files;
+        struct dirent* entry;
+        while ((entry = ::readdir(directory)) != nullptr) {
+            const std::string name(entry->d_name);
+            if ((name.length() > 4) && (name.compare(name.length() - 4, 4, ".wav") == 0)) {
+                files.push_back(name);
+            }
+        }
+        ::closedir(directory);
+
+        // The same templates in the same order on every start
+        std::sort(files.begin(), files.end());
+        for (const std::string& name : files) {
+            std::string keyword = name.substr(0, name.find_first_of("-_."));
+            std::transform(keyword.begin(), keyword.end(), keyword.begin(), [](const char c) { return static_cast<char>(::toupper(c)); });
+            if (Load(model + "/" + name, keyword) == false) {
+                TRACE(AVSClient, (_T("Template %s not usable, it is skipped"), name.c_str()));
+            }
+        }
+
+        if (m_templates.empty() == true) {
+            TRACE(AVSClient, (_T("No keyword templates for %s in %s"), Locale().c_str(), model.c_str()));
+            return false;
+        }
+
+        m_threshold = detectionThreshold;
+        m_useVad = useVad;
+        Clear();
+
+        TRACE(AVSClient, (_T("%u keyword template(s) for %s"), static_cast<uint32_t>(m_templates.size()), Locale().c_str()));
+
+        return true;
+    }
+
+    bool TemplateKeywordEngine::Load(const std::string& path, const std::string& keyword)
+    {
+        std::vector<int16_t> samples;
+        if ((keyword.empty() == true) || (ReadWav(path, samples) == false)) {
+            return false;
+        }
+
+        // Silence around the keyword would match any silence in the audio
+        std::vector<uint64_t> energies;
+        for (size_t index = 0; (index + HOP_SAMPLES) <= samples.size(); index += HOP_SAMPLES) {
+            uint64_t energy;
+            uint16_t peak;
+            VoiceEnergy::Measure(&samples[index], HOP_SAMPLES, energy, peak);
+            energies.push_back(energy);
+        }
+        if (energies.empty() == true) {
+            return false;
+        }
+
+        const double loudest = static_cast<double>(*std::max_element(energies.cbegin(), energies.cend()));
+        size_t first = 0;
+        size_t last = energies.size();
+        while ((first < last) && ((energies[first] * TRIM_RATIO) < loudest)) {
+            first++;
+        }
+        while ((last > first) && ((energies[last - 1] * TRIM_RATIO) < loudest)) {
+            last--;
+        }
+
+        Template entry;
+        entry.keyword = keyword;
+        const size_t end = std::min(samples.size(), (last * HOP_SAMPLES) + (WINDOW_SAMPLES - HOP_SAMPLES));
+        Features(&samples[first * HOP_SAMPLES], end - (first * HOP_SAMPLES), entry.features);
+
+        const size_t frames = entry.features.size() / COEFFICIENTS;
+        if (frames < MIN_TEMPLATE_FRAMES) {
+            return false;
+        }
+
+        entry.cost.resize(frames);
+        entry.length.resize(frames);
+        entry.start.resize(frames);
+        m_templates.push_back(std::move(entry));
+
+        return true;
+    }
+
+    /* static */ void TemplateKeywordEngine::Features(const int16_t samples[], const size_t count, std::vector<float>& features)
+    {
+        const FilterBank& bank = Bank();
+
+        features.clear();
+        for (size_t index = 0; (index + WINDOW_SAMPLES) <= count; index += HOP_SAMPLES) {
+            features.resize(features.size() + COEFFICIENTS);
+            bank.Analyze(&samples[index], &features[features.size() - COEFFICIENTS]);
+        }
+    }
+
+    KeywordEngine::Error TemplateKeywordEngine::Threshold(const char keyword[], const uint32_t threshold)
+    {
+        Error result = ERROR_NONE;
+
+        if (keyword == nullptr) {
+            m_threshold = threshold;
+            m_thresholds.clear();
+        } else if (std::find_if(m_templates.cbegin(), m_templates.cend(), [keyword](const Template& entry) { return (entry.keyword == keyword); }) == m_templates.cend()) {
+            result = ERROR_UNKNOWN_KEYWORD;
+        } else {
+            m_thresholds[keyword] = threshold;
+        }
+
+        return (result);
+    }
+
+    uint32_t TemplateKeywordEngine::Threshold(const std::string& keyword) const
+    {
+        auto it = m_thresholds.find(keyword);
+        return (it != m_thresholds.cend() ? it->second : m_threshold);
+    }
+
+    size_t TemplateKeywordEngine::ModelSize() const
+    {
+        size_t result = 0;
+        for (const Template& entry : m_templates) {
+            result += entry.features.size() * sizeof(float);
+        }
+        return (result);
+    }
+
+    KeywordEngine::Error TemplateKeywordEngine::Decode(const int16_t samples[], const size_t count)
+    {
+        size_t index = 0;
+
+        while (index < count) {
+            const size_t take = std::min(count - index, WINDOW_SAMPLES - m_window.size());
+            m_window.insert(m_window.end(), samples + index, samples + index + take);
+            index += take;
+
+            if (m_window.size() == WINDOW_SAMPLES) {
+                Bank().Analyze(m_window.data(), m_features.data());
+                if (m_useVad == true) {
+                    Activity(&m_window[WINDOW_SAMPLES - HOP_SAMPLES]);
+                }
+                Frame(m_features.data());
+                m_window.erase(m_window.begin(), m_window.begin() + HOP_SAMPLES);
+            }
+        }
+
+        return (ERROR_NONE);
+    }
+
+    // One step of subsequence dynamic time warping: a match may start at any frame, and either side may stretch
+    void TemplateKeywordEngine::Frame(const float features[])
+    {
+        for (Template& entry : m_templates) {
+            const size_t frames = entry.cost.size();
+            m_previousCost.assign(entry.cost.cbegin(), entry.cost.cend());
+            m_previousLength.assign(entry.length.cbegin(), entry.length.cend());
+            m_previousStart.assign(entry.start.cbegin(), entry.start.cend());
+
+            for (size_t index = 0; index < frames; index++) {
+                const float distance = Distance(features, &entry.features[index * COEFFICIENTS]);
+
+                if (index == 0) {
+                    entry.cost[0] = 2 * distance;
+                    entry.length[0] = 2;
+                    entry.start[0] = m_frame;
+                } else {
+                    // Symmetric weights, a diagonal step counts twice, so neither side is warped for free. The
+                    // steps are compared by their average distance, so longer paths are not held against
+                    const float costs[] = { m_previousCost[index - 1] + (2 * distance), m_previousCost[index] + distance, entry.cost[index - 1] + distance };
+                    const uint32_t lengths[] = { m_previousLength[index - 1] + 2, m_previousLength[index] + 1, entry.length[index - 1] + 1 };
+                    const uint64_t starts[] = { m_previousStart[index - 1], m_previousStart[index], entry.start[index - 1] };
+
+                    uint8_t best = 0;
+                    for (uint8_t step = 1; step < 3; step++) {
+                        if ((costs[step] / lengths[step]) < (costs[best] / lengths[best])) {
+                            best = step;
+                        }
+                    }
+                    entry.cost[index] = costs[best];
+                    entry.length[index] = lengths[best];
+                    entry.start[index] = starts[best];
+                }
+            }
+
+            const uint64_t matched = (m_frame - entry.start[frames - 1]) + 1;
+            if ((matched * MAX_STRETCH >= frames) && (matched <= (frames * MAX_STRETCH))) {
+                const float average = entry.cost[frames - 1] / entry.length[frames - 1];
+                const int32_t confidence = static_cast<int32_t>(MAX_CONFIDENCE * std::exp(-average / DISTANCE_SCALE));
+
+                if ((confidence >= static_cast<int32_t>(Threshold(entry.keyword))) && ((m_candidate.match == nullptr) || (confidence > m_candidate.confidence))) {
+                    m_candidate = { &entry, confidence, entry.start[frames - 1], m_frame };
+                }
+            }
+        }
+
+        if ((m_candidate.match != nullptr) && ((m_frame - m_candidate.end) >= SETTLE_FRAMES)) {
+            const Candidate detection = m_candidate;
+            // A keyword is reported once, matching starts over after it
+            Clear();
+            m_observer.Detected(*this, detection.match->keyword.c_str(), detection.confidence, detection.start * HOP_SAMPLES, (detection.end * HOP_SAMPLES) + WINDOW_SAMPLES);
+        }
+
+        m_frame++;
+    }
+
+    void TemplateKeywordEngine::Activity(const int16_t samples[])
+    {
+        if (m_gate.IsSilent(samples, HOP_SAMPLES) == false) {
+            m_silentFrames = 0;
+            m_voiceFrames++;
+            if ((m_isVoiceActive == false) && (m_voiceFrames >= VOICE_ONSET_FRAMES)) {
+                m_isVoiceActive = true;
+                m_observer.VoiceActivity(*this, true);
+            }
+        } else {
+            m_voiceFrames = 0;
+            m_silentFrames++;
+            if ((m_isVoiceActive == true) && (m_silentFrames >= VOICE_HOLD_FRAMES)) {
+                m_isVoiceActive = false;
+                m_observer.VoiceActivity(*this, false);
+            }
+        }
+    }
+
+    KeywordEngine::Error TemplateKeywordEngine::Restart()
+    {
+        m_window.clear();
+        m_frame = 0;
+        m_voiceFrames = 0;
+        m_silentFrames = 0;
+        m_isVoiceActive = false;
+        Clear();
+
+        return (ERROR_NONE);
+    }
+
+    void TemplateKeywordEngine::Clear()
+    {
+        for (Template& entry : m_templates) {
+            std::fill(entry.cost.begin(), entry.cost.end(), std::numeric_limits<float>::infinity());
+            std::fill(entry.length.begin(), entry.length.end(), 1);
+            std::fill(entry.start.begin(), entry.start.end(), m_frame);
+        }
+        m_candidate = { nullptr, 0, 0, 0 };
+    }
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,111 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "KeywordEngine.h"
+#include "VoiceEnergy.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    /// Reference keyword engine, without any vendor library: matches the audio against recordings of the keywords
+    /// with dynamic time warping over their mel frequency cepstra.
+    /// The model of a locale is a directory of 16 kHz mono 16-bit WAV files, one utterance of a keyword each, named
+    /// after the keyword (e.g. alexa-1.wav, alexa-2.wav). It is meant for testing and benchmarking the detection
+    /// pipeline on any machine, not for production accuracy.
+    class TemplateKeywordEngine : public KeywordEngine {
+    public:
+        enum error : Error {
+            ERROR_UNKNOWN_KEYWORD = 1
+        };
+
+        // Frames of 20 ms, every 10 ms
+        static constexpr uint32_t WINDOW_SAMPLES = 320;
+        static constexpr uint32_t HOP_SAMPLES = 160;
+        static constexpr uint8_t COEFFICIENTS = 12;
+
+        TemplateKeywordEngine() = delete;
+        TemplateKeywordEngine(const TemplateKeywordEngine&) = delete;
+        TemplateKeywordEngine& operator=(const TemplateKeywordEngine&) = delete;
+
+        TemplateKeywordEngine(IObserver& observer, const std::string& locale);
+        ~TemplateKeywordEngine() override = default;
+
+    public:
+        bool Initialize(const std::string& modelsPath, const uint32_t detectionThreshold, const bool useVad, const bool lockModel) override;
+        Error Threshold(const char keyword[], const uint32_t threshold) override;
+        size_t ModelSize() const override;
+
+        // Features of each complete frame of the samples, COEFFICIENTS values per frame
+        static void Features(const int16_t samples[], const size_t count, std::vector<float>& features);
+
+    protected:
+        Error Decode(const int16_t samples[], const size_t count) override;
+        Error Restart() override;
+
+    private:
+        // One recording of a keyword, with the warping path of its best match ending at the current frame
+        struct Template {
+            std::string keyword;
+            std::vector<float> features;
+            std::vector<float> cost;
+            std::vector<uint32_t> length;
+            std::vector<uint64_t> start;
+        };
+
+        struct Candidate {
+            const Template* match;
+            int32_t confidence;
+            uint64_t start;
+            uint64_t end;
+        };
+
+        bool Load(const std::string& path, const std::string& keyword);
+        void Frame(const float features[]);
+        void Activity(const int16_t samples[]);
+        uint32_t Threshold(const std::string& keyword) const;
+        void Clear();
+
+        std::vector<Template> m_templates;
+        uint32_t m_threshold;
+        std::map<std::string, uint32_t> m_thresholds;
+        bool m_useVad;
+
+        // Samples of the frame under way, the next frame starts HOP_SAMPLES further
+        std::vector<int16_t> m_window;
+        std::vector<float> m_features;
+        uint64_t m_frame;
+        Candidate m_candidate;
+        std::vector<float> m_previousCost;
+        std::vector<uint32_t> m_previousLength;
+        std::vector<uint64_t> m_previousStart;
+
+        VoiceEnergyGate m_gate;
+        uint32_t m_voiceFrames;
+        uint32_t m_silentFrames;
+        bool m_isVoiceActive;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
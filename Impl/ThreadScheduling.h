@@ -0,0 +1,276 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "Module.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    /// Scheduling of an audio-critical thread: its policy, priority and the CPUs it may run on.
+    struct ThreadScheduling {
+        enum policy : uint8_t {
+            DEFAULT,
+            OTHER,
+            FIFO,
+            RR
+        };
+
+        class Config : public Core::JSON::Container {
+        public:
+            Config(const Config&) = delete;
+            Config& operator=(const Config&) = delete;
+
+        public:
+            Config()
+                : Core::JSON::Container()
+                , Policy()
+                , Priority()
+                , Nice()
+                , Cpus()
+            {
+                Add(_T("policy"), &Policy);
+                Add(_T("priority"), &Priority);
+                Add(_T("nice"), &Nice);
+                Add(_T("cpus"), &Cpus);
+            }
+
+            ~Config() = default;
+
+        public:
+            Core::JSON::String Policy;
+            Core::JSON::DecUInt8 Priority;
+            Core::JSON::DecSInt8 Nice;
+            Core::JSON::String Cpus;
+        };
+
+        ThreadScheduling()
+            : schedulingPolicy(DEFAULT)
+            , priority(1)
+            , nice(0)
+            , cpus()
+            , cpuMask(0)
+        {
+        }
+
+        bool Policy(const string& name)
+        {
+            bool result = true;
+            if (name == _T("other")) {
+                schedulingPolicy = OTHER;
+            } else if (name == _T("fifo")) {
+                schedulingPolicy = FIFO;
+            } else if (name == _T("rr")) {
+                schedulingPolicy = RR;
+            } else {
+                result = false;
+            }
+            return result;
+        }
+
+        // A comma separated list of CPUs and ranges of CPUs, e.g. "2-3" or "0,2"
+        bool Cpus(const string& list)
+        {
+            bool result = true;
+            uint64_t mask = 0;
+            size_t start = 0;
+
+            while ((result == true) && (start < list.length())) {
+                size_t end = list.find(',', start);
+                if (end == string::npos) {
+                    end = list.length();
+                }
+
+                unsigned int first = 0;
+                unsigned int last = 0;
+                const string range = list.substr(start, end - start);
+                const int fields = sscanf(range.c_str(), "%u-%u", &first, &last);
+                if (fields == 1) {
+                    last = first;
+                }
+
+                result = (fields >= 1) && (first <= last) && (last < 64);
+                for (unsigned int cpu = first; (result == true) && (cpu <= last); cpu++) {
+                    mask |= (1ULL << cpu);
+                }
+                start = end + 1;
+            }
+
+            if ((result == true) && (mask != 0)) {
+                cpus = list;
+                cpuMask = mask;
+            }
+            return ((result == true) && (mask != 0));
+        }
+
+        // False if a value in the configuration is not understood
+        bool Configure(const Config& config)
+        {
+            bool result = true;
+            if ((config.Policy.IsSet() == true) && (Policy(config.Policy.Value()) == false)) {
+                result = false;
+            }
+            if (config.Priority.IsSet() == true) {
+                priority = config.Priority.Value();
+                result = result && (priority >= 1) && (priority <= 99);
+            }
+            if (config.Nice.IsSet() == true) {
+                nice = config.Nice.Value();
+                result = result && (nice >= -20) && (nice <= 19);
+                // A nice level on its own asks for the other policy, it is not applied under the default one
+                if (config.Policy.IsSet() == false) {
+                    schedulingPolicy = OTHER;
+                }
+            }
+            if ((config.Cpus.IsSet() == true) && (config.Cpus.Value().empty() == false) && (Cpus(config.Cpus.Value()) == false)) {
+                result = false;
+            }
+            return result;
+        }
+
+        // Applies to the calling thread and describes what was applied. A real-time policy that is not permitted
+        // falls back to the nice level, a nice level or CPU set that is not permitted is left to the system.
+        string Apply() const
+        {
+            string applied;
+            bool isNiced = (schedulingPolicy == OTHER);
+
+            if ((schedulingPolicy == FIFO) || (schedulingPolicy == RR)) {
+                const char* name = (schedulingPolicy == FIFO ? _T("SCHED_FIFO") : _T("SCHED_RR"));
+                struct sched_param param;
+                ::memset(&param, 0, sizeof(param));
+                param.sched_priority = priority;
+
+                const int error = ::pthread_setschedparam(::pthread_self(), (schedulingPolicy == FIFO ? SCHED_FIFO : SCHED_RR), &param);
+                if (error == 0) {
+                    applied = string(name) + _T(" priority ") + std::to_string(priority);
+                } else {
+                    applied = string(name) + _T(" not permitted (") + ::strerror(error) + _T("), ");
+                    isNiced = true;
+                }
+            }
+
+            if (isNiced == true) {
+                if (::setpriority(PRIO_PROCESS, static_cast<id_t>(::syscall(SYS_gettid)), nice) == 0) {
+                    applied += _T("nice ") + std::to_string(nice);
+                } else {
+                    applied += _T("nice ") + std::to_string(nice) + _T(" not permitted (") + ::strerror(errno) + _T(")");
+                }
+            } else if (schedulingPolicy == DEFAULT) {
+                applied = _T("default scheduling");
+            }
+
+            if (cpuMask != 0) {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                for (unsigned int cpu = 0; cpu < 64; cpu++) {
+                    if ((cpuMask & (1ULL << cpu)) != 0) {
+                        CPU_SET(cpu, &set);
+                    }
+                }
+
+                const int error = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+                if (error == 0) {
+                    applied += _T(" on CPUs ") + cpus;
+                } else {
+                    applied += _T(", CPUs ") + cpus + _T(" not available (") + ::strerror(error) + _T(")");
+                }
+            }
+
+            return (applied);
+        }
+
+        policy schedulingPolicy;
+        // Real-time priority for FIFO and RR, from 1 to 99
+        uint8_t priority;
+        // Nice level for OTHER, and for FIFO or RR when the real-time policy is not permitted
+        int8_t nice;
+        // The CPUs as configured, and as a mask; empty for all CPUs
+        string cpus;
+        uint64_t cpuMask;
+    };
+
+    /// How late a thread runs after the moment it should have woken up, measured by the thread itself.
+    class SchedulingLatency {
+    public:
+        SchedulingLatency(const SchedulingLatency&) = delete;
+        SchedulingLatency& operator=(const SchedulingLatency&) = delete;
+
+        SchedulingLatency()
+            : m_count(0)
+            , m_totalUs(0)
+            , m_maxUs(0)
+        {
+        }
+
+        ~SchedulingLatency() = default;
+
+    public:
+        void Add(const std::chrono::steady_clock::time_point& due)
+        {
+            const auto late = std::chrono::steady_clock::now() - due;
+            const uint64_t us = (late.count() > 0 ? std::chrono::duration_cast<std::chrono::microseconds>(late).count() : 0);
+
+            m_count++;
+            m_totalUs += us;
+            m_maxUs = std::max(m_maxUs, us);
+        }
+
+        uint32_t Count() const
+        {
+            return (m_count);
+        }
+        uint32_t AverageUs() const
+        {
+            return (m_count != 0 ? static_cast<uint32_t>(m_totalUs / m_count) : 0);
+        }
+        uint32_t MaxUs() const
+        {
+            return (static_cast<uint32_t>(m_maxUs));
+        }
+
+        void Reset()
+        {
+            m_count = 0;
+            m_totalUs = 0;
+            m_maxUs = 0;
+        }
+
+    private:
+        uint32_t m_count;
+        uint64_t m_totalUs;
+        uint64_t m_maxUs;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
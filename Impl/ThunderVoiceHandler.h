@@ -21,7 +21,10 @@
 
 #include "Module.h"
 #include "CompatibleAudioFormat.h"
+#include "StreamExport.h"
+#include "StreamSignal.h"
 #include "TraceCategories.h"
+#include "VoiceSource.h"
 
 #include <WPEFramework/interfaces/IVoiceHandler.h>
 #include <WPEFramework/tracing/tracing.h>
@@ -33,8 +36,15 @@
 #include <SmartScreen/SampleApp/GUI/GUIManager.h>
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <limits>
 #include <mutex>
 #include <thread>
+#include <vector>
 
 namespace WPEFramework {
 namespace Plugin {
@@ -113,40 +123,48 @@ namespace Plugin {
     template <typename MANAGER>
     class ThunderVoiceHandler : public alexaClientSDK::applicationUtilities::resources::audio::MicrophoneInterface {
     public:
-        static std::unique_ptr<ThunderVoiceHandler> create(std::shared_ptr<alexaClientSDK::avsCommon::avs::AudioInputStream> stream, WPEFramework::PluginHost::IShell* service, const string& callsign, std::shared_ptr<InteractionHandler<MANAGER>> interactionHandler, alexaClientSDK::avsCommon::utils::AudioFormat audioFormat)
+        // callsigns lists the voice producers, separated by commas, in order of priority
+        // The stream signal is raised after every write to the stream, which is mirrored to the stream export when there is one
+        static std::unique_ptr<ThunderVoiceHandler> create(std::shared_ptr<alexaClientSDK::avsCommon::avs::AudioInputStream> stream, std::shared_ptr<StreamSignal> streamSignal, std::shared_ptr<StreamExport> streamExport, WPEFramework::PluginHost::IShell* service, const string& callsigns, std::shared_ptr<InteractionHandler<MANAGER>> interactionHandler, alexaClientSDK::avsCommon::utils::AudioFormat audioFormat, const VoiceHandlerSettings& settings = VoiceHandlerSettings())
         {
-            if (!stream) {
-                TRACE_GLOBAL(AVSClient, (_T("Invalid stream")));
-                return nullptr;
-            }
-
             if (!service) {
                 TRACE_GLOBAL(AVSClient, (_T("Invalid service")));
                 return nullptr;
             }
 
-            if (!AudioFormatCompatibility::IsCompatible(audioFormat)) {
-                TRACE_GLOBAL(AVSClient, (_T("Audio Format is not compatible")));
-                return nullptr;
-            }
-
-            std::unique_ptr<ThunderVoiceHandler> thunderVoiceHandler(new ThunderVoiceHandler(stream, service, callsign, interactionHandler));
-            if (!thunderVoiceHandler) {
-                TRACE_GLOBAL(AVSClient, (_T("Failed to create a ThunderVoiceHandler!")));
-                return nullptr;
-            }
-
-            if (!thunderVoiceHandler->Initialize()) {
-                TRACE_GLOBAL(AVSClient, (_T("ThunderVoiceHandler is not initialized.")));
-            }
+            return (Create(stream, streamSignal, streamExport, service, callsigns, interactionHandler, audioFormat, settings));
+        }
 
-            return thunderVoiceHandler;
+        // Without a service no voice producer is looked up, the callbacks of the sources are made through Callback()
+        // instead, to replay recorded voice sessions
+        static std::unique_ptr<ThunderVoiceHandler> create(std::shared_ptr<alexaClientSDK::avsCommon::avs::AudioInputStream> stream, std::shared_ptr<StreamSignal> streamSignal, std::shared_ptr<StreamExport> streamExport, const string& callsigns, std::shared_ptr<InteractionHandler<MANAGER>> interactionHandler, alexaClientSDK::avsCommon::utils::AudioFormat audioFormat, const VoiceHandlerSettings& settings = VoiceHandlerSettings())
+        {
+            return (Create(stream, streamSignal, streamExport, nullptr, callsigns, interactionHandler, audioFormat, settings));
         }
 
         bool stopStreamingMicrophoneData() override
         {
             TRACE_L1(_T("stopStreamingMicrophoneData()"));
 
+            if (m_isStreaming.exchange(false) == true) {
+                const std::lock_guard<std::mutex> lock{ m_mutex };
+
+                for (Input& input : m_inputs) {
+                    // Frames staged before the stop are still written, later ones are dropped in Data().
+                    // Only the COM-RPC thread stages, the pause is passed to the drain thread aside.
+                    input.source->Pause();
+
+                    // Mid-session the producer keeps its callback, it would not see the end of the session otherwise.
+                    // The callback is taken off when the session ends, in Ended().
+                    if ((input.handler->IsStreaming() == false) && (input.isAttached == true)) {
+                        input.producer->Callback(nullptr);
+                        input.isAttached = false;
+                    }
+                }
+
+                Wake();
+            }
+
             return true;
         }
 
@@ -154,50 +172,206 @@ namespace Plugin {
         {
             TRACE_L1(_T("startStreamingMicrophoneData()"));
 
+            if (m_isStreaming.exchange(true) == false) {
+                const std::lock_guard<std::mutex> lock{ m_mutex };
+
+                for (Input& input : m_inputs) {
+                    Attach(input);
+
+                    const uint32_t gated = input.source->TakeGated();
+                    if (gated > 0) {
+                        TRACE(AVSClient, (_T("Microphone resumed, %u frames from %s dropped while stopped"), gated, input.source->Callsign().c_str()));
+                    }
+                }
+            }
+
             return true;
         }
 
-	bool isStreaming() override {
-	    return (true);
-	}
+        bool isStreaming() override
+        {
+            return (m_isStreaming);
+        }
 
-        void stateChange(WPEFramework::PluginHost::IShell* audiosource)
+        // The callback registered with the voice producer of a source, valid as long as the handler is
+        WPEFramework::Exchange::IVoiceHandler* Callback(const string& callsign)
         {
-            if (audiosource->State() == WPEFramework::PluginHost::IShell::ACTIVATED) {
-                bool status = Initialize();
-                if (!status) {
-                    TRACE(AVSClient, (_T("Failed to initialize ThunderVoiceHandlerWraper")));
-                    return;
+            WPEFramework::Exchange::IVoiceHandler* result = nullptr;
+
+            for (Input& input : m_inputs) {
+                if ((result == nullptr) && (input.source->Callsign() == callsign)) {
+                    result = &(*input.handler);
                 }
             }
 
-            if (audiosource->State() == WPEFramework::PluginHost::IShell::DEACTIVATED) {
-                bool status = Deinitialize();
-                if (!status) {
-                    TRACE(AVSClient, (_T("Failed to deinitialize ThunderVoiceHandlerWraper")));
-                    return;
+            return (result);
+        }
+
+        // Frames of all sources over the sessions that have ended
+        VoiceSource::Totals Statistics()
+        {
+            const std::lock_guard<std::mutex> lock{ m_mutex };
+            VoiceSource::Totals totals = {};
+
+            for (const Input& input : m_inputs) {
+                const VoiceSource::Totals& counted = input.source->Counted();
+                totals.sessions += counted.sessions;
+                totals.received += counted.received;
+                totals.lost += counted.lost;
+                totals.late += counted.late;
+                totals.duplicates += counted.duplicates;
+                totals.dropped += counted.dropped;
+            }
+
+            return (totals);
+        }
+
+        void stateChange(WPEFramework::PluginHost::IShell* audiosource)
+        {
+            const std::lock_guard<std::mutex> lock{ m_mutex };
+
+            for (Input& input : m_inputs) {
+                if (input.source->Callsign() == audiosource->Callsign()) {
+                    if (audiosource->State() == WPEFramework::PluginHost::IShell::ACTIVATED) {
+                        if (!InitializeInput(input)) {
+                            TRACE(AVSClient, (_T("Failed to initialize ThunderVoiceHandlerWraper")));
+                        }
+                    }
+
+                    if (audiosource->State() == WPEFramework::PluginHost::IShell::DEACTIVATED) {
+                        DeinitializeInput(input);
+                    }
                 }
             }
         }
 
         ~ThunderVoiceHandler()
         {
+            {
+                std::lock_guard<std::mutex> lock(m_drainMutex);
+                m_isDraining = false;
+            }
+            m_drainSignal.notify_one();
+            if (m_drainThread.joinable()) {
+                m_drainThread.join();
+            }
+
+            for (Input& input : m_inputs) {
+                DeinitializeInput(input);
+            }
+
             if (m_service != nullptr) {
                 m_service->Release();
             }
         }
 
     private:
-        ThunderVoiceHandler(std::shared_ptr<alexaClientSDK::avsCommon::avs::AudioInputStream> stream, WPEFramework::PluginHost::IShell* service, const string& callsign, std::shared_ptr<InteractionHandler<MANAGER>> interactionHandler)
+        class VoiceHandler;
+
+        // A voice producer, the callback it calls and the pipeline its audio goes through
+        struct Input {
+            Input(ThunderVoiceHandler* parent, const string& callsign, const uint8_t priority, const VoiceHandlerSettings& settings)
+                : source(new VoiceSource(callsign, priority, settings))
+                , handler(WPEFramework::Core::ProxyType<VoiceHandler>::Create(parent, source.get()))
+                , producer(nullptr)
+                , isAttached(false)
+            {
+            }
+
+            std::unique_ptr<VoiceSource> source;
+            WPEFramework::Core::ProxyType<VoiceHandler> handler;
+            WPEFramework::Exchange::IVoiceProducer* producer;
+            // The callback is registered with the voice producer
+            bool isAttached;
+        };
+
+        static std::unique_ptr<ThunderVoiceHandler> Create(std::shared_ptr<alexaClientSDK::avsCommon::avs::AudioInputStream> stream, std::shared_ptr<StreamSignal> streamSignal, std::shared_ptr<StreamExport> streamExport, WPEFramework::PluginHost::IShell* service, const string& callsigns, std::shared_ptr<InteractionHandler<MANAGER>> interactionHandler, alexaClientSDK::avsCommon::utils::AudioFormat audioFormat, const VoiceHandlerSettings& settings)
+        {
+            if (!stream) {
+                TRACE_GLOBAL(AVSClient, (_T("Invalid stream")));
+                return nullptr;
+            }
+
+            if (!AudioFormatCompatibility::IsCompatible(audioFormat)) {
+                TRACE_GLOBAL(AVSClient, (_T("Audio Format is not compatible")));
+                return nullptr;
+            }
+
+            const std::vector<string> sources = Callsigns(callsigns);
+            if ((sources.empty() == true) || (sources.size() > MAX_SOURCES)) {
+                TRACE_GLOBAL(AVSClient, (_T("Expected 1 to %u audio sources"), MAX_SOURCES));
+                return nullptr;
+            }
+
+            std::unique_ptr<ThunderVoiceHandler> thunderVoiceHandler(new ThunderVoiceHandler(stream, streamSignal, streamExport, service, sources, interactionHandler, settings));
+            if (!thunderVoiceHandler) {
+                TRACE_GLOBAL(AVSClient, (_T("Failed to create a ThunderVoiceHandler!")));
+                return nullptr;
+            }
+
+            if (!thunderVoiceHandler->Initialize()) {
+                TRACE_GLOBAL(AVSClient, (_T("ThunderVoiceHandler is not initialized.")));
+            }
+
+            return thunderVoiceHandler;
+        }
+
+        ThunderVoiceHandler(std::shared_ptr<alexaClientSDK::avsCommon::avs::AudioInputStream> stream, std::shared_ptr<StreamSignal> streamSignal, std::shared_ptr<StreamExport> streamExport, WPEFramework::PluginHost::IShell* service, const std::vector<string>& callsigns, std::shared_ptr<InteractionHandler<MANAGER>> interactionHandler, const VoiceHandlerSettings& settings)
             : m_audioInputStream{ stream }
-            , m_callsign{ callsign }
+            , m_streamSignal{ streamSignal }
+            , m_streamExport{ streamExport }
             , m_service{ service }
-            , m_voiceProducer{ nullptr }
             , m_isInitialized{ false }
+            , m_isStreaming{ false }
             , m_interactionHandler{ interactionHandler }
-            , m_voiceHandler{ WPEFramework::Core::ProxyType<VoiceHandler>::Create(this) }
+            , m_settings{ settings }
+            , m_inputs()
+            , m_selected{ nullptr }
+            , m_interactionOwner{ nullptr }
+            // Upsampling 8 kHz doubles the amount of data
+            , m_batch(2 * VoiceSource::STAGING_RING_SIZE)
+            , m_batched{ 0 }
+            , m_mix()
+            , m_batchThreshold{ settings.batchDuration * BYTES_PER_MS }
+            , m_batchTimeout{ settings.batchDuration }
+            , m_isBatchPending{ false }
+            , m_isDraining{ true }
+            , m_isDrainIdle{ false }
+            , m_drainSignalled()
+            , m_drainLatency()
+        {
+            if (m_service != nullptr) {
+                m_service->AddRef();
+            }
+
+            m_inputs.reserve(callsigns.size());
+            for (const string& callsign : callsigns) {
+                m_inputs.emplace_back(this, callsign, static_cast<uint8_t>(m_inputs.size()), m_settings);
+            }
+
+            m_drainThread = std::thread(&ThunderVoiceHandler::DrainLoop, this);
+        }
+
+        static std::vector<string> Callsigns(const string& list)
         {
-            m_service->AddRef();
+            std::vector<string> callsigns;
+            size_t start = 0;
+
+            while (start <= list.length()) {
+                size_t end = list.find(',', start);
+                if (end == string::npos) {
+                    end = list.length();
+                }
+
+                const size_t first = list.find_first_not_of(_T(" \t"), start);
+                const size_t last = list.find_last_not_of(_T(" \t"), end - 1);
+                if ((first < end) && (last != string::npos) && (last >= first)) {
+                    callsigns.push_back(list.substr(first, last - first + 1));
+                }
+                start = end + 1;
+            }
+
+            return (callsigns);
         }
 
         /// Initializes ThunderVoiceHandler.
@@ -219,45 +393,380 @@ namespace Plugin {
             }
 
             if (error != true) {
-                m_voiceProducer = m_service->QueryInterfaceByCallsign<WPEFramework::Exchange::IVoiceProducer>(m_callsign);
-                if (m_voiceProducer == nullptr) {
-                    TRACE(AVSClient, (_T("Failed to obtain VoiceProducer interface!")));
-                    error = true;
+                // A producer that is not there yet is picked up when it activates
+                for (Input& input : m_inputs) {
+                    InitializeInput(input);
+                }
+                m_isInitialized = true;
+            }
+
+            return m_isInitialized;
+        }
+
+        // m_mutex must be held
+        bool InitializeInput(Input& input)
+        {
+            if ((input.producer == nullptr) && (m_service != nullptr)) {
+                input.producer = m_service->QueryInterfaceByCallsign<WPEFramework::Exchange::IVoiceProducer>(input.source->Callsign());
+                if (input.producer == nullptr) {
+                    TRACE(AVSClient, (_T("Failed to obtain VoiceProducer interface of %s!"), input.source->Callsign().c_str()));
                 } else {
-                    m_voiceProducer->Callback((&(*m_voiceHandler)));
+                    if (m_settings.voiceTransport == VoiceHandlerSettings::SHARED) {
+                        OpenSharedBuffer(input);
+                    }
+                    if (m_isStreaming == true) {
+                        Attach(input);
+                    }
                 }
             }
 
-            if (error != true) {
-                m_isInitialized = true;
+            return (input.producer != nullptr);
+        }
+
+        // m_mutex must be held
+        void DeinitializeInput(Input& input)
+        {
+            if (input.producer != nullptr) {
+                input.producer->Release();
+                input.producer = nullptr;
             }
 
-            return m_isInitialized;
+            input.source->SharedBuffer().Close();
+            input.isAttached = false;
         }
 
-        bool Deinitialize()
+        // Offers the shared buffer to the voice producer, a producer that refuses keeps calling Data() per frame
+        void OpenSharedBuffer(Input& input)
+        {
+            VoiceSharedBuffer& buffer = input.source->SharedBuffer();
+            // Every producer gets a buffer of its own
+            const string path = ((m_inputs.size() > 1) ? (m_settings.sharedBuffer + '.' + input.source->Callsign()) : m_settings.sharedBuffer);
+
+            if (buffer.Open(path, VoiceSource::STAGING_RING_SIZE) == false) {
+                TRACE(AVSClient, (_T("Failed to create the shared voice buffer %s, using COM-RPC"), path.c_str()));
+            } else {
+                SharedTransport config;
+                config.Transport = _T("shm");
+                config.Buffer = buffer.Path();
+                config.Size = buffer.Size();
+
+                string configuration;
+                config.ToString(configuration);
+
+                const uint32_t result = input.producer->Configure(configuration);
+                if (result != WPEFramework::Core::ERROR_NONE) {
+                    TRACE(AVSClient, (_T("Voice producer %s does not support the shared voice buffer (%u), using COM-RPC"), input.source->Callsign().c_str(), result));
+                    buffer.Close();
+                } else {
+                    TRACE(AVSClient, (_T("Voice frames of %s are passed through %s"), input.source->Callsign().c_str(), buffer.Path().c_str()));
+                }
+            }
+        }
+
+        // Registers the callback with the voice producer, m_mutex must be held
+        void Attach(Input& input)
+        {
+            if ((input.producer != nullptr) && (input.isAttached == false)) {
+                input.producer->Callback((&(*input.handler)));
+                input.isAttached = true;
+            }
+        }
+
+        // Called from the COM-RPC thread, must not block
+        void Stage(VoiceSource& source, const uint8_t tag, const uint32_t sequenceNo, const uint8_t data[], const uint16_t length)
+        {
+            if (source.Stage(tag, sequenceNo, data, length) == true) {
+                Wake();
+            }
+        }
+
+        // Wakes the drain thread up if it waits for something to be staged
+        void Wake()
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (m_isDrainIdle.load(std::memory_order_relaxed) == true) {
+                std::lock_guard<std::mutex> lock(m_drainMutex);
+                m_drainSignalled = std::chrono::steady_clock::now();
+                m_drainSignal.notify_one();
+            }
+        }
+
+        // Called from the COM-RPC thread when a producer starts or stops a session. The interaction
+        // belongs to the highest priority source in a session: a source of higher priority takes it
+        // over without starting a new one, it ends when the source that owns it stops.
+        void Interaction(const VoiceSource& source, const bool isStarted)
+        {
+            bool toggle = false;
+
+            {
+                const std::lock_guard<std::mutex> lock{ m_interactionMutex };
+                if (isStarted == true) {
+                    if (m_interactionOwner == nullptr) {
+                        m_interactionOwner = &source;
+                        toggle = true;
+                    } else if (source.Priority() < m_interactionOwner->Priority()) {
+                        TRACE(AVSClient, (_T("Voice source %s takes over the interaction from %s"), source.Callsign().c_str(), m_interactionOwner->Callsign().c_str()));
+                        m_interactionOwner = &source;
+                    }
+                } else if (m_interactionOwner == &source) {
+                    m_interactionOwner = nullptr;
+                    toggle = true;
+                }
+            }
+
+            if ((toggle == true) && (m_interactionHandler)) {
+                m_interactionHandler->HoldToTalk();
+            }
+        }
+
+        // Called from the COM-RPC thread at the end of a session. A stop of the microphone during the session
+        // left the callback registered, now the session has ended the producer no longer needs to call it.
+        void Ended(const VoiceSource& source)
         {
             const std::lock_guard<std::mutex> lock{ m_mutex };
 
-            if (m_writer) {
-                m_writer.reset();
+            if (m_isStreaming == false) {
+                for (Input& input : m_inputs) {
+                    if ((input.source.get() == &source) && (input.isAttached == true)) {
+                        input.producer->Callback(nullptr);
+                        input.isAttached = false;
+                    }
+                }
             }
+        }
 
-            if (m_voiceProducer) {
-                m_voiceProducer->Release();
+        bool IsStaged() const
+        {
+            bool result = false;
+            for (const Input& input : m_inputs) {
+                result = result || (input.source->IsEmpty() == false);
             }
+            return (result);
+        }
 
-            m_isInitialized = false;
-            return true;
+        void DrainLoop()
+        {
+            TRACE(AVSClient, (_T("Voice drain thread: %s"), m_settings.drainScheduling.Apply().c_str()));
+
+            std::unique_lock<std::mutex> lock(m_drainMutex);
+
+            while (m_isDraining == true) {
+                bool isStaged = true;
+                auto isWoken = [this]() { return ((m_isDraining == false) || (IsStaged() == true)); };
+
+                m_isDrainIdle.store(true, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                const auto timeout = std::chrono::steady_clock::now() + m_batchTimeout;
+                if (m_isBatchPending == true) {
+                    // A partial batch is not held back longer than the batch duration
+                    isStaged = m_drainSignal.wait_for(lock, m_batchTimeout, isWoken);
+                } else {
+                    m_drainSignal.wait(lock, isWoken);
+                }
+                m_isDrainIdle.store(false, std::memory_order_relaxed);
+
+                // Late by the time since the batch timeout expired or since Stage() signalled
+                if (isStaged == false) {
+                    m_drainLatency.Add(timeout);
+                } else if (m_drainSignalled != std::chrono::steady_clock::time_point()) {
+                    m_drainLatency.Add(m_drainSignalled);
+                }
+                m_drainSignalled = std::chrono::steady_clock::time_point();
+
+                lock.unlock();
+                Drain(isStaged == false);
+                lock.lock();
+            }
+        }
+
+        // Moves everything staged so far through the pipelines of the sources into the batch, the batch is
+        // written to the SDS once it holds the batch duration, at the end of a session or when flush is set
+        void Drain(const bool flush)
+        {
+            const std::lock_guard<std::mutex> lock{ m_mutex };
+            SourceSink sink(*this);
+
+            for (Input& input : m_inputs) {
+                input.source->Drain(sink, m_isStreaming);
+            }
+
+            if (m_settings.sourceMixing == VoiceHandlerSettings::MIX) {
+                Mix();
+            }
+
+            if ((flush == true) || (m_batched >= m_batchThreshold)) {
+                WriteBatch();
+            }
+            m_isBatchPending = (m_batched > 0);
+        }
+
+        void Started(VoiceSource& source)
+        {
+            if ((m_selected == nullptr) || (source.Priority() < m_selected->Priority())) {
+                m_selected = &source;
+                TRACE(AVSClient, (_T("Voice source %s selected"), source.Callsign().c_str()));
+            }
+        }
+
+        void Stopped(VoiceSource& source)
+        {
+            if (m_selected == &source) {
+                // Fall back to the highest priority source that is still in a session
+                m_selected = nullptr;
+                for (Input& input : m_inputs) {
+                    if ((m_selected == nullptr) && (input.source->IsActive() == true)) {
+                        m_selected = input.source.get();
+                        TRACE(AVSClient, (_T("Voice source %s selected"), m_selected->Callsign().c_str()));
+                    }
+                }
+            }
+
+            if (m_settings.sourceMixing == VoiceHandlerSettings::MIX) {
+                Mix();
+            }
+            WriteBatch();
+
+            TRACE(AVSClient, (_T("Voice drain thread: wakeup latency %u us average, %u us max over %u wakeups"),
+                m_drainLatency.AverageUs(), m_drainLatency.MaxUs(), m_drainLatency.Count()));
+            m_drainLatency.Reset();
+        }
+
+        void Output(VoiceSource& source, const int16_t samples[], const uint32_t count)
+        {
+            if (m_settings.sourceMixing == VoiceHandlerSettings::MIX) {
+                source.Pending().insert(source.Pending().end(), samples, samples + count);
+            } else if (&source == m_selected) {
+                Append(samples, count);
+            }
+        }
+
+        // Sums what the sources have delivered into the batch. Sources in a session are waited for, but a source
+        // that falls behind by more than MIX_SLACK_SAMPLES is left out until it delivers again.
+        void Mix()
+        {
+            size_t ready = std::numeric_limits<size_t>::max();
+            size_t most = 0;
+
+            for (Input& input : m_inputs) {
+                const size_t pending = input.source->Pending().size();
+                if (input.source->IsActive() == true) {
+                    ready = std::min(ready, pending);
+                }
+                most = std::max(most, pending);
+            }
+
+            if (ready == std::numeric_limits<size_t>::max()) {
+                // No session is running, write out what is left
+                ready = most;
+            } else if (most > (ready + MIX_SLACK_SAMPLES)) {
+                ready = most - MIX_SLACK_SAMPLES;
+            }
+
+            if (ready > 0) {
+                m_mix.assign(ready, 0);
+
+                for (Input& input : m_inputs) {
+                    std::vector<int16_t>& pending = input.source->Pending();
+                    const size_t count = std::min(ready, pending.size());
+                    for (size_t index = 0; index < count; index++) {
+                        m_mix[index] += pending[index];
+                    }
+                    pending.erase(pending.begin(), pending.begin() + count);
+                }
+
+                for (size_t start = 0; start < ready;) {
+                    int16_t samples[256];
+                    const size_t count = std::min<size_t>(ready - start, sizeof(samples) / sizeof(samples[0]));
+                    for (size_t index = 0; index < count; index++) {
+                        samples[index] = static_cast<int16_t>(std::min<int32_t>(std::max<int32_t>(m_mix[start + index], INT16_MIN), INT16_MAX));
+                    }
+                    Append(samples, static_cast<uint32_t>(count));
+                    start += count;
+                }
+            }
+        }
+
+        // Reserves room in the batch for length bytes, returns the number of bytes that may be written
+        size_t Reserve(const size_t length)
+        {
+            const size_t wordSize = (m_writer ? m_writer->getWordSize() : 1);
+            // incoming data length = number of bytes, trailing partial words are not written
+            const size_t usable = (length - (length % wordSize));
+
+            if ((m_batched + usable) > m_batch.size()) {
+                WriteBatch();
+            }
+
+            return usable;
+        }
+
+        void Append(const int16_t samples[], const uint32_t count)
+        {
+            const uint8_t* data = reinterpret_cast<const uint8_t*>(samples);
+            size_t remaining = count * sizeof(int16_t);
+
+            while (remaining > 0) {
+                const size_t usable = Reserve(std::min(remaining, m_batch.size()));
+                ::memcpy(&m_batch[m_batched], data, usable);
+                m_batched += usable;
+                data += usable;
+                remaining -= usable;
+            }
+        }
+
+        void WriteBatch()
+        {
+            if ((m_batched > 0) && (m_writer)) {
+                ssize_t rc = m_writer->write(m_batch.data(), m_batched / m_writer->getWordSize());
+                if (rc <= 0) {
+                    TRACE(AVSClient, (_T("Failed to write to stream with rc = %d"), rc));
+                } else {
+                    if (m_streamExport) {
+                        m_streamExport->Write(m_batch.data(), static_cast<uint64_t>(rc));
+                    }
+                    if (m_streamSignal) {
+                        m_streamSignal->Raise();
+                    }
+                }
+            }
+            m_batched = 0;
         }
 
     private:
+        // Hands the session changes and samples of the sources back to the handler
+        class SourceSink {
+        public:
+            explicit SourceSink(ThunderVoiceHandler& parent)
+                : m_parent(parent)
+            {
+            }
+
+            void Started(VoiceSource& source)
+            {
+                m_parent.Started(source);
+            }
+
+            void Stopped(VoiceSource& source)
+            {
+                m_parent.Stopped(source);
+            }
+
+            void Output(VoiceSource& source, const int16_t samples[], const uint32_t count)
+            {
+                m_parent.Output(source, samples, count);
+            }
+
+        private:
+            ThunderVoiceHandler& m_parent;
+        };
+
         ///  Responsible for getting audio data from Thunder
         class VoiceHandler : public WPEFramework::Exchange::IVoiceHandler {
         public:
-            VoiceHandler(ThunderVoiceHandler* parent)
+            VoiceHandler(ThunderVoiceHandler* parent, VoiceSource* source)
                 : m_profile{ nullptr }
                 , m_parent{ parent }
+                , m_source{ source }
                 , m_isStarted{ false }
             {
             }
@@ -277,8 +786,19 @@ namespace Plugin {
                         m_profile->AddRef();
                     }
 
-                    if (m_parent && m_parent->m_interactionHandler) {
-                        m_parent->m_interactionHandler->HoldToTalk();
+                    if (m_parent) {
+                        // The conversion is selected once per session, from the profile
+                        VoiceSource::SessionFormat session = { AudioFormatCompatibility::SAMPLE_RATE_HZ, AudioFormatCompatibility::NUM_CHANNELS, AudioFormatCompatibility::SAMPLE_SIZE_IN_BITS, WPEFramework::Exchange::IVoiceProducer::IProfile::PCM };
+                        if (m_profile) {
+                            session.sampleRate = m_profile->SampleRate();
+                            session.channels = m_profile->Channels();
+                            session.resolution = m_profile->Resolution();
+                            session.codec = static_cast<uint8_t>(m_profile->Codec());
+                        }
+                        m_source->Recording().Begin();
+                        m_source->Recording().Record(VoiceSource::STAGED_START, 0, reinterpret_cast<const uint8_t*>(&session), sizeof(session));
+                        m_parent->Stage(*m_source, VoiceSource::STAGED_START, 0, reinterpret_cast<const uint8_t*>(&session), sizeof(session));
+                        m_parent->Interaction(*m_source, true);
                     }
                 }
             }
@@ -294,29 +814,44 @@ namespace Plugin {
                     m_profile = nullptr;
                 }
 
-                if (m_parent && m_parent->m_interactionHandler) {
-                    m_parent->m_interactionHandler->HoldToTalk();
+                if (m_parent) {
+                    m_source->Recording().Record(VoiceSource::STAGED_STOP, 0, nullptr, 0);
+                    m_source->Recording().End();
+                    m_parent->Interaction(*m_source, false);
+                    m_parent->Stage(*m_source, VoiceSource::STAGED_STOP, 0, nullptr, 0);
                 }
 
                 m_isStarted = false;
+
+                if (m_parent) {
+                    m_parent->Ended(*m_source);
+                }
             }
 
             void Data(const uint32_t sequenceNo, const uint8_t data[], const uint16_t length) override
             {
                 TRACE_L1(_T("ThunderVoiceHandler::VoiceHandler::Data()"));
 
-                if (m_parent && m_parent->m_writer) {
-                    // incoming data length = number of bytes
-                    size_t nWords = length / m_parent->m_writer->getWordSize();
-                    ssize_t rc = m_parent->m_writer->write(data, nWords);
-                    if (rc <= 0) {
-                        TRACE(AVSClient, (_T("Failed to write to stream with rc = %d"), rc));
+                if (m_parent) {
+                    if (length == 0) {
+                        // Doorbell, the frames are waiting in the shared buffer, which is not recorded
+                        m_parent->Stage(*m_source, VoiceSource::STAGED_DOORBELL, sequenceNo, nullptr, 0);
+                    } else if (m_parent->m_isStreaming.load(std::memory_order_relaxed) == false) {
+                        // The microphone is stopped, the audio is not even staged, nor recorded
+                        m_source->Recording().Record(VoiceSource::RECORDED_GATED, sequenceNo, nullptr, 0);
+                        m_source->Gated();
+                    } else {
+                        m_source->Recording().Record(VoiceSource::STAGED_DATA, sequenceNo, data, length);
+                        // The SDS write is done by the drain thread so a stalled stream does not hold the producer
+                        m_parent->Stage(*m_source, VoiceSource::STAGED_DATA, sequenceNo, data, length);
                     }
                 }
             }
-	    bool IsStreaming() {
-		return (m_isStarted);
-	    }
+
+            bool IsStreaming() const
+            {
+                return (m_isStarted);
+            }
 
             BEGIN_INTERFACE_MAP(VoiceHandler)
             INTERFACE_ENTRY(WPEFramework::Exchange::IVoiceHandler)
@@ -325,21 +860,73 @@ namespace Plugin {
         private:
             const WPEFramework::Exchange::IVoiceProducer::IProfile* m_profile;
             ThunderVoiceHandler* m_parent;
-            bool m_isStarted;
+            VoiceSource* m_source;
+            std::atomic<bool> m_isStarted;
+        };
+
+        // Offered to the voice producer through IVoiceProducer::Configure()
+        class SharedTransport : public WPEFramework::Core::JSON::Container {
+        public:
+            SharedTransport(const SharedTransport&) = delete;
+            SharedTransport& operator=(const SharedTransport&) = delete;
+
+            SharedTransport()
+                : WPEFramework::Core::JSON::Container()
+                , Transport()
+                , Buffer()
+                , Size()
+            {
+                Add(_T("transport"), &Transport);
+                Add(_T("buffer"), &Buffer);
+                Add(_T("size"), &Size);
+            }
+            ~SharedTransport() override = default;
+
+        public:
+            WPEFramework::Core::JSON::String Transport;
+            WPEFramework::Core::JSON::String Buffer;
+            WPEFramework::Core::JSON::DecUInt32 Size;
         };
 
     private:
+        static constexpr uint8_t MAX_SOURCES = 4;
+        // Bytes of SDS audio per millisecond
+        static constexpr uint32_t BYTES_PER_MS = (AudioFormatCompatibility::SAMPLE_RATE_HZ / 1000) * (AudioFormatCompatibility::SAMPLE_SIZE_IN_BITS / 8);
+        // 60 ms of SDS audio
+        static constexpr size_t MIX_SLACK_SAMPLES = (AudioFormatCompatibility::SAMPLE_RATE_HZ / 1000) * 60;
+
         const std::shared_ptr<alexaClientSDK::avsCommon::avs::AudioInputStream> m_audioInputStream;
-        string m_callsign;
+        const std::shared_ptr<StreamSignal> m_streamSignal;
+        const std::shared_ptr<StreamExport> m_streamExport;
         WPEFramework::PluginHost::IShell* m_service;
-        WPEFramework::Exchange::IVoiceProducer* m_voiceProducer;
         bool m_isInitialized;
+        // Gated by start/stopStreamingMicrophoneData()
+        std::atomic<bool> m_isStreaming;
         std::shared_ptr<InteractionHandler<MANAGER>> m_interactionHandler;
         std::shared_ptr<alexaClientSDK::avsCommon::avs::AudioInputStream::Writer> m_writer;
 
-        WPEFramework::Core::ProxyType<VoiceHandler> m_voiceHandler;
-
         std::mutex m_mutex;
+
+        const VoiceHandlerSettings m_settings;
+        std::vector<Input> m_inputs;
+        // The source written to the SDS, owned by the drain thread
+        VoiceSource* m_selected;
+        std::mutex m_interactionMutex;
+        const VoiceSource* m_interactionOwner;
+        std::vector<uint8_t> m_batch;
+        size_t m_batched;
+        std::vector<int32_t> m_mix;
+        const size_t m_batchThreshold;
+        const std::chrono::milliseconds m_batchTimeout;
+        bool m_isBatchPending;
+        std::thread m_drainThread;
+        std::mutex m_drainMutex;
+        std::condition_variable m_drainSignal;
+        bool m_isDraining;
+        std::atomic<bool> m_isDrainIdle;
+        // Set by Stage() when it wakes the drain thread up, under m_drainMutex
+        std::chrono::steady_clock::time_point m_drainSignalled;
+        SchedulingLatency m_drainLatency;
     };
 
 } // namespace Plugin
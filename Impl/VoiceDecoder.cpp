@@ -0,0 +1,298 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "VoiceDecoder.h"
+
+#include "TraceCategories.h"
+
+#include <algorithm>
+
+#if defined(VOICE_CODEC_OPUS)
+#include <opus.h>
+#endif
+#if defined(VOICE_CODEC_MSBC)
+#include <sbc/sbc.h>
+#endif
+
+namespace WPEFramework {
+namespace Plugin {
+
+    using namespace alexaClientSDK::avsCommon::utils;
+
+    // IMA ADPCM blocks start with the first sample and the step index: int16 sample, uint8 index, uint8 reserved
+    static constexpr uint16_t ADPCM_HEADER_SIZE = 4;
+
+    static constexpr int16_t ADPCM_STEPS[89] = {
+        7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+        50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+        337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+        2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+        15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+    };
+
+    static constexpr int8_t ADPCM_INDICES[16] = {
+        -1, -1, -1, -1, 2, 4, 6, 8,
+        -1, -1, -1, -1, 2, 4, 6, 8
+    };
+
+#if defined(VOICE_CODEC_MSBC)
+    static constexpr uint8_t MSBC_SYNCWORD = 0xAD;
+    static constexpr uint16_t MSBC_FRAME_SIZE = 57;
+#endif
+
+#if defined(VOICE_CODEC_OPUS)
+    // Opus decodes straight to the SDS rate, so no resampling is needed afterwards
+    static constexpr uint32_t OPUS_SAMPLE_RATE_HZ = 16000;
+    // 120 ms, the longest Opus frame
+    static constexpr uint32_t OPUS_MAX_FRAME_SAMPLES = (OPUS_SAMPLE_RATE_HZ * 120) / 1000;
+#endif
+
+    static inline int32_t AdpcmNibble(const uint8_t nibble, int32_t& predictor, int32_t& index)
+    {
+        const int32_t step = ADPCM_STEPS[index];
+        int32_t delta = step >> 3;
+        if (nibble & 1) {
+            delta += step >> 2;
+        }
+        if (nibble & 2) {
+            delta += step >> 1;
+        }
+        if (nibble & 4) {
+            delta += step;
+        }
+        predictor = std::min<int32_t>(std::max<int32_t>((nibble & 8) ? (predictor - delta) : (predictor + delta), INT16_MIN), INT16_MAX);
+        index = std::min<int32_t>(std::max<int32_t>(index + ADPCM_INDICES[nibble], 0), 88);
+        return (predictor);
+    }
+
+    VoiceDecoder::VoiceDecoder()
+        : m_decode{ nullptr }
+        , m_buffer()
+        , m_opus{ nullptr }
+        , m_opusSamples{ 0 }
+        , m_sbc{ nullptr }
+    {
+    }
+
+    VoiceDecoder::~VoiceDecoder()
+    {
+        Close();
+    }
+
+    /* static */ const char* VoiceDecoder::Name(const codec type)
+    {
+        switch (type) {
+        case UNDEFINED:
+        case PCM:
+            return ("pcm");
+        case ADPCM:
+            return ("adpcm");
+        case MSBC:
+            return ("msbc");
+        case OPUS:
+            return ("opus");
+        }
+        return ("unknown");
+    }
+
+    bool VoiceDecoder::Configure(const codec type, const AudioFormat& source, AudioFormat& decoded)
+    {
+        bool status = true;
+
+        Close();
+
+        decoded = source;
+        decoded.encoding = AudioFormat::Encoding::LPCM;
+        decoded.endianness = AudioFormat::Endianness::LITTLE;
+        decoded.sampleSizeInBits = 16;
+
+        switch (type) {
+        case UNDEFINED:
+        case PCM:
+            decoded = source;
+            break;
+        case ADPCM:
+            if (source.numChannels != 1) {
+                TRACE(AVSClient, (_T("IMA ADPCM is only supported for mono sources")));
+                status = false;
+            } else {
+                m_decode = &VoiceDecoder::DecodeADPCM;
+            }
+            break;
+        case MSBC:
+#if defined(VOICE_CODEC_MSBC)
+            m_sbc = new sbc_t;
+            if (sbc_init_msbc(m_sbc, 0) != 0) {
+                TRACE(AVSClient, (_T("Failed to initialize the mSBC decoder")));
+                delete m_sbc;
+                m_sbc = nullptr;
+                status = false;
+            } else {
+                m_sbc->endian = SBC_LE;
+                decoded.sampleRateHz = 16000;
+                decoded.numChannels = 1;
+                m_decode = &VoiceDecoder::DecodeMSBC;
+            }
+#else
+            TRACE(AVSClient, (_T("mSBC support is not compiled in")));
+            status = false;
+#endif
+            break;
+        case OPUS:
+#if defined(VOICE_CODEC_OPUS)
+        {
+            int error = OPUS_OK;
+            m_opus = opus_decoder_create(OPUS_SAMPLE_RATE_HZ, 1, &error);
+            if (error != OPUS_OK) {
+                TRACE(AVSClient, (_T("Failed to create the Opus decoder: %s"), opus_strerror(error)));
+                m_opus = nullptr;
+                status = false;
+            } else {
+                decoded.sampleRateHz = OPUS_SAMPLE_RATE_HZ;
+                decoded.numChannels = 1;
+                m_decode = &VoiceDecoder::DecodeOpus;
+            }
+        }
+#else
+            TRACE(AVSClient, (_T("Opus support is not compiled in")));
+            status = false;
+#endif
+            break;
+        default:
+            TRACE(AVSClient, (_T("Unknown voice codec %u"), type));
+            status = false;
+            break;
+        }
+
+        if (status == true) {
+            if (m_decode != nullptr) {
+                m_buffer.resize(MAX_SAMPLES);
+            }
+            TRACE(AVSClient, (_T("Voice codec: %s, decoding to %u Hz/%u channels"), Name(type), decoded.sampleRateHz, decoded.numChannels));
+        } else {
+            Close();
+        }
+
+        return (status);
+    }
+
+    uint16_t VoiceDecoder::Conceal()
+    {
+        uint16_t result = 0;
+#if defined(VOICE_CODEC_OPUS)
+        if ((m_opus != nullptr) && (m_opusSamples > 0)) {
+            const int samples = opus_decode(m_opus, nullptr, 0, m_buffer.data(), m_opusSamples, 0);
+            if (samples > 0) {
+                result = static_cast<uint16_t>(samples * sizeof(int16_t));
+            }
+        }
+#endif
+        return (result);
+    }
+
+    void VoiceDecoder::Close()
+    {
+#if defined(VOICE_CODEC_OPUS)
+        if (m_opus != nullptr) {
+            opus_decoder_destroy(m_opus);
+        }
+#endif
+#if defined(VOICE_CODEC_MSBC)
+        if (m_sbc != nullptr) {
+            sbc_finish(m_sbc);
+            delete m_sbc;
+        }
+#endif
+        m_opus = nullptr;
+        m_opusSamples = 0;
+        m_sbc = nullptr;
+        m_decode = nullptr;
+    }
+
+    // Every frame is a self contained IMA ADPCM block, so a lost frame does not corrupt the next one
+    uint16_t VoiceDecoder::DecodeADPCM(const uint8_t data[], const uint16_t length)
+    {
+        uint32_t produced = 0;
+
+        if (length >= ADPCM_HEADER_SIZE) {
+            int32_t predictor = static_cast<int16_t>(data[0] | (data[1] << 8));
+            int32_t index = std::min<int32_t>(data[2], 88);
+            int16_t* output = m_buffer.data();
+            const uint32_t samples = std::min<uint32_t>(1 + ((length - ADPCM_HEADER_SIZE) * 2), MAX_SAMPLES);
+
+            output[produced++] = static_cast<int16_t>(predictor);
+
+            for (uint16_t offset = ADPCM_HEADER_SIZE; produced < samples; offset++) {
+                output[produced++] = static_cast<int16_t>(AdpcmNibble(data[offset] & 0x0F, predictor, index));
+                if (produced < samples) {
+                    output[produced++] = static_cast<int16_t>(AdpcmNibble(data[offset] >> 4, predictor, index));
+                }
+            }
+        }
+
+        return (static_cast<uint16_t>(produced * sizeof(int16_t)));
+    }
+
+#if defined(VOICE_CODEC_MSBC)
+    // A frame may hold several mSBC frames, each optionally preceded by an H2 header and followed by padding
+    uint16_t VoiceDecoder::DecodeMSBC(const uint8_t data[], const uint16_t length)
+    {
+        uint8_t* output = reinterpret_cast<uint8_t*>(m_buffer.data());
+        const size_t capacity = m_buffer.size() * sizeof(int16_t);
+        size_t produced = 0;
+        uint16_t offset = 0;
+
+        while ((offset + MSBC_FRAME_SIZE) <= length) {
+            if (data[offset] != MSBC_SYNCWORD) {
+                offset++;
+            } else {
+                size_t written = 0;
+                const ssize_t consumed = sbc_decode(m_sbc, &data[offset], length - offset, &output[produced], capacity - produced, &written);
+                if (consumed <= 0) {
+                    offset++;
+                } else {
+                    offset += static_cast<uint16_t>(consumed);
+                    produced += written;
+                }
+            }
+        }
+
+        return (static_cast<uint16_t>(produced));
+    }
+#endif
+
+#if defined(VOICE_CODEC_OPUS)
+    uint16_t VoiceDecoder::DecodeOpus(const uint8_t data[], const uint16_t length)
+    {
+        uint16_t result = 0;
+        const int samples = opus_decode(m_opus, data, length, m_buffer.data(), OPUS_MAX_FRAME_SAMPLES, 0);
+
+        if (samples < 0) {
+            TRACE(AVSClient, (_T("Failed to decode an Opus frame: %s"), opus_strerror(samples)));
+        } else {
+            m_opusSamples = samples;
+            result = static_cast<uint16_t>(samples * sizeof(int16_t));
+        }
+
+        return (result);
+    }
+#endif
+
+} // namespace Plugin
+} // namespace WPEFramework
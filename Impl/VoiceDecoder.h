@@ -0,0 +1,104 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <AVSCommon/Utils/AudioFormat.h>
+
+#include <cstdint>
+#include <vector>
+
+struct OpusDecoder;
+struct sbc_struct;
+
+namespace WPEFramework {
+namespace Plugin {
+
+    /// Decodes the compressed voice frames of a Thunder voice producer into 16-bit LPCM.
+    /// Every call to Decode() takes exactly one frame as delivered through IVoiceHandler::Data().
+    /// All state and the output buffer are allocated in Configure(), never per frame.
+    class VoiceDecoder {
+    public:
+        // The first values match IVoiceProducer::IProfile::codec
+        enum codec : uint8_t {
+            UNDEFINED,
+            PCM,
+            ADPCM,
+            MSBC,
+            OPUS
+        };
+
+        // Size in samples of the output buffer, larger frames are truncated
+        static constexpr uint32_t MAX_SAMPLES = 32 * 1024 - 1;
+
+        VoiceDecoder(const VoiceDecoder&) = delete;
+        VoiceDecoder& operator=(const VoiceDecoder&) = delete;
+
+        VoiceDecoder();
+        ~VoiceDecoder();
+
+    public:
+        // Returns false if the codec is unknown or not compiled in. On success decoded holds the
+        // format of the samples produced by Decode(), which may differ from the source format.
+        bool Configure(const codec type, const alexaClientSDK::avsCommon::utils::AudioFormat& source, alexaClientSDK::avsCommon::utils::AudioFormat& decoded);
+
+        // LPCM frames are used as they are, Decode() must not be called for them
+        bool IsPassThrough() const
+        {
+            return (m_decode == nullptr);
+        }
+
+        // Decodes one frame into Buffer(), returns the number of bytes produced
+        uint16_t Decode(const uint8_t data[], const uint16_t length)
+        {
+            return ((this->*m_decode)(data, length));
+        }
+
+        // Lets the codec fill in a lost frame, returns 0 if it has no concealment of its own
+        uint16_t Conceal();
+
+        const uint8_t* Buffer() const
+        {
+            return (reinterpret_cast<const uint8_t*>(m_buffer.data()));
+        }
+
+        static const char* Name(const codec type);
+
+    private:
+        uint16_t DecodeADPCM(const uint8_t data[], const uint16_t length);
+#if defined(VOICE_CODEC_MSBC)
+        uint16_t DecodeMSBC(const uint8_t data[], const uint16_t length);
+#endif
+#if defined(VOICE_CODEC_OPUS)
+        uint16_t DecodeOpus(const uint8_t data[], const uint16_t length);
+#endif
+
+        void Close();
+
+    private:
+        uint16_t (VoiceDecoder::*m_decode)(const uint8_t data[], const uint16_t length);
+        std::vector<int16_t> m_buffer;
+        OpusDecoder* m_opus;
+        // Samples in the last Opus frame, the length of a concealed frame
+        uint32_t m_opusSamples;
+        sbc_struct* m_sbc;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
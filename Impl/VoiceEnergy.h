@@ -0,0 +1,165 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+namespace WPEFramework {
+namespace Plugin {
+
+    /// Energy of a block of 16-bit mono samples, vectorized with SSE2 or NEON when the target has it.
+    class VoiceEnergy {
+    public:
+        VoiceEnergy() = delete;
+
+        // Sum of the squared samples and the largest absolute sample
+        static void Measure(const int16_t samples[], const size_t count, uint64_t& energy, uint16_t& peak)
+        {
+            size_t index = 0;
+            energy = 0;
+            peak = 0;
+
+#if defined(__SSE2__)
+            const __m128i zero = _mm_setzero_si128();
+            __m128i sum = zero;
+            __m128i maximum = zero;
+
+            for (; (index + 8) <= count; index += 8) {
+                const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + index));
+                // Two squares add up to at most 2^31, which fits the lanes when taken as unsigned
+                const __m128i squares = _mm_madd_epi16(block, block);
+                sum = _mm_add_epi64(sum, _mm_unpacklo_epi32(squares, zero));
+                sum = _mm_add_epi64(sum, _mm_unpackhi_epi32(squares, zero));
+                // Saturated, so -32768 counts as 32767
+                maximum = _mm_max_epi16(maximum, _mm_max_epi16(block, _mm_subs_epi16(zero, block)));
+            }
+
+            uint64_t sums[2];
+            int16_t maxima[8];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(sums), sum);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(maxima), maximum);
+            energy = sums[0] + sums[1];
+            peak = static_cast<uint16_t>(*std::max_element(maxima, maxima + 8));
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+            int64x2_t sum = vdupq_n_s64(0);
+            int16x8_t maximum = vdupq_n_s16(0);
+
+            for (; (index + 8) <= count; index += 8) {
+                const int16x8_t block = vld1q_s16(samples + index);
+                const int16x4_t low = vget_low_s16(block);
+                const int16x4_t high = vget_high_s16(block);
+                sum = vpadalq_s32(sum, vmull_s16(low, low));
+                sum = vpadalq_s32(sum, vmull_s16(high, high));
+                maximum = vmaxq_s16(maximum, vqabsq_s16(block));
+            }
+
+            int64_t sums[2];
+            int16_t maxima[8];
+            vst1q_s64(sums, sum);
+            vst1q_s16(maxima, maximum);
+            energy = static_cast<uint64_t>(sums[0] + sums[1]);
+            peak = static_cast<uint16_t>(*std::max_element(maxima, maxima + 8));
+#endif
+
+            for (; index < count; index++) {
+                const int32_t sample = samples[index];
+                energy += static_cast<uint64_t>(sample * sample);
+                peak = std::max<uint16_t>(peak, static_cast<uint16_t>(std::min(std::abs(sample), 32767)));
+            }
+        }
+    };
+
+    /// Tells blocks that are clearly silent from those that may hold voice.
+    /// The noise floor follows the quietest blocks right away and rises slowly, so ambient noise is gated while
+    /// speech, which keeps well above it, is not. A block is only silent when both its level and its peak stay close
+    /// to the floor, so the short peaks of a soft onset pass even while the block as a whole is still quiet.
+    class VoiceEnergyGate {
+    public:
+        // Mean square of a block, in sample units, where the noise floor starts (about -50 dBFS)
+        static constexpr double INITIAL_FLOOR = 100.0 * 100.0;
+        // A block below this multiple of the noise floor (6 dB) may be silent
+        static constexpr double MARGIN = 4.0;
+        // ... unless its squared peak reaches this multiple of the noise floor (12 dB), above the peaks of the noise
+        // itself, which rarely exceed three times its root mean square
+        static constexpr double PEAK_MARGIN = 16.0;
+        // Blocks peaking at this level or below are digital silence, whatever the noise floor
+        static constexpr uint16_t SILENCE_PEAK = 2;
+
+        VoiceEnergyGate(const VoiceEnergyGate&) = delete;
+        VoiceEnergyGate& operator=(const VoiceEnergyGate&) = delete;
+
+        explicit VoiceEnergyGate(const uint32_t sampleRate)
+            : m_sampleRate(sampleRate)
+            , m_floor(INITIAL_FLOOR)
+        {
+        }
+
+        ~VoiceEnergyGate() = default;
+
+    public:
+        bool IsSilent(const int16_t samples[], const size_t count)
+        {
+            bool result = true;
+
+            if (count > 0) {
+                uint64_t energy;
+                uint16_t peak;
+                VoiceEnergy::Measure(samples, count, energy, peak);
+
+                const double level = static_cast<double>(energy) / count;
+                const double square = static_cast<double>(peak) * peak;
+                result = ((peak <= SILENCE_PEAK) || ((level < (m_floor * MARGIN)) && (square < (m_floor * PEAK_MARGIN))));
+
+                // Digital silence says nothing about the ambient noise
+                if (peak > SILENCE_PEAK) {
+                    if (level < m_floor) {
+                        m_floor = level;
+                    } else {
+                        // Rises by about half (2 dB) per second of audio above the floor
+                        m_floor = std::min(level, m_floor + ((m_floor * count) / (2.0 * m_sampleRate)));
+                    }
+                }
+            }
+
+            return (result);
+        }
+
+        // Root mean square of the noise floor, in sample units
+        uint32_t NoiseFloor() const
+        {
+            return (static_cast<uint32_t>(std::sqrt(m_floor)));
+        }
+
+    private:
+        const uint32_t m_sampleRate;
+        double m_floor;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
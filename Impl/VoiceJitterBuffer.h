@@ -0,0 +1,220 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    /// Restores the order of voice frames using their sequence numbers.
+    /// Frames arriving ahead of a missing one are held back for at most `window` frames; when the window
+    /// is exceeded the missing frame is declared lost. The SINK receives the frames in order through
+    /// Frame(data, length) and every lost frame through Lost(length), so it can conceal the gap.
+    class VoiceJitterBuffer {
+    public:
+        struct Statistics {
+            uint32_t received;
+            uint32_t reordered;
+            uint32_t lost;
+            uint32_t late;
+            uint32_t duplicates;
+            uint32_t resyncs;
+        };
+
+        static constexpr uint8_t MAX_WINDOW = 32;
+        // A larger jump in sequence numbers is treated as a restart of the producer, not as a gap
+        static constexpr uint32_t MAX_CONCEALED_FRAMES = 50;
+        // A power of two, so the slots stay continuous when the sequence number wraps
+        static constexpr uint32_t SLOTS = 128;
+        static_assert(((SLOTS & (SLOTS - 1)) == 0) && (SLOTS > (MAX_WINDOW + MAX_CONCEALED_FRAMES)), "SLOTS must be a power of two covering the window and the concealed frames");
+
+        VoiceJitterBuffer(const VoiceJitterBuffer&) = delete;
+        VoiceJitterBuffer& operator=(const VoiceJitterBuffer&) = delete;
+
+        explicit VoiceJitterBuffer(const uint8_t window)
+            : m_window((window < MAX_WINDOW) ? window : static_cast<uint8_t>(MAX_WINDOW))
+            , m_slots(SLOTS)
+            , m_isSynchronized{ false }
+            , m_expected{ 0 }
+            , m_highest{ 0 }
+            , m_lastLength{ 0 }
+            , m_statistics{}
+        {
+        }
+
+        ~VoiceJitterBuffer() = default;
+
+    public:
+        void Reset()
+        {
+            for (Slot& slot : m_slots) {
+                slot.filled = false;
+            }
+            m_isSynchronized = false;
+            m_lastLength = 0;
+            m_statistics = {};
+        }
+
+        template <typename SINK>
+        void Push(const uint32_t sequenceNo, const uint8_t data[], const uint16_t length, SINK& sink)
+        {
+            if (m_isSynchronized == false) {
+                m_isSynchronized = true;
+                m_expected = sequenceNo;
+                m_highest = sequenceNo;
+            }
+
+            m_statistics.received++;
+
+            if (m_lastLength == 0) {
+                // Until a frame is delivered, losses are concealed with the size of the first one
+                m_lastLength = length;
+            }
+
+            int32_t delta = static_cast<int32_t>(sequenceNo - m_expected);
+
+            if ((delta < -static_cast<int32_t>(MAX_CONCEALED_FRAMES)) || (delta > static_cast<int32_t>(MAX_CONCEALED_FRAMES + m_window))) {
+                // Discontinuity, deliver what is held back and start over from this frame
+                Flush(sink);
+                m_statistics.resyncs++;
+                m_isSynchronized = true;
+                m_expected = sequenceNo;
+                m_highest = sequenceNo;
+                delta = 0;
+            }
+
+            if (delta < 0) {
+                // Already concealed or delivered
+                m_statistics.late++;
+                return;
+            }
+
+            if (static_cast<int32_t>(sequenceNo - m_highest) > 0) {
+                m_highest = sequenceNo;
+            } else if (sequenceNo != m_highest) {
+                m_statistics.reordered++;
+            }
+
+            // Make room: whatever is older than the window is delivered or declared lost, and so are
+            // the frames held back behind it, or the buffer would stay a window behind after a loss
+            while (delta > m_window) {
+                Release(sink);
+                while (m_slots[Index(m_expected)].filled == true) {
+                    Release(sink);
+                }
+                delta = static_cast<int32_t>(sequenceNo - m_expected);
+            }
+
+            if (delta < 0) {
+                // Held back already and delivered while making room
+                m_statistics.duplicates++;
+                return;
+            }
+
+            if (delta == 0) {
+                Deliver(data, length, sink);
+                m_expected++;
+                while (m_slots[Index(m_expected)].filled == true) {
+                    Release(sink);
+                }
+            } else {
+                Slot& slot = m_slots[Index(sequenceNo)];
+                if (slot.filled == true) {
+                    m_statistics.duplicates++;
+                } else {
+                    slot.filled = true;
+                    slot.length = length;
+                    slot.data.assign(data, data + length);
+                }
+            }
+        }
+
+        // Delivers everything held back, concealing the gaps in between
+        template <typename SINK>
+        void Flush(SINK& sink)
+        {
+            if (m_isSynchronized == true) {
+                while (static_cast<int32_t>(m_highest - m_expected) >= 0) {
+                    Release(sink);
+                }
+            }
+            m_isSynchronized = false;
+        }
+
+        const Statistics& Stats() const
+        {
+            return (m_statistics);
+        }
+
+    private:
+        struct Slot {
+            Slot()
+                : filled(false)
+                , length(0)
+                , data()
+            {
+            }
+
+            bool filled;
+            uint16_t length;
+            std::vector<uint8_t> data;
+        };
+
+        uint32_t Index(const uint32_t sequenceNo) const
+        {
+            return (sequenceNo & (SLOTS - 1));
+        }
+
+        template <typename SINK>
+        void Deliver(const uint8_t data[], const uint16_t length, SINK& sink)
+        {
+            m_lastLength = length;
+            sink.Frame(data, length);
+        }
+
+        // Hands over the expected frame, or declares it lost, and moves on to the next one
+        template <typename SINK>
+        void Release(SINK& sink)
+        {
+            Slot& slot = m_slots[Index(m_expected)];
+            if (slot.filled == true) {
+                slot.filled = false;
+                Deliver(slot.data.data(), slot.length, sink);
+            } else {
+                m_statistics.lost++;
+                sink.Lost(m_lastLength);
+            }
+            m_expected++;
+        }
+
+    private:
+        const uint8_t m_window;
+        std::vector<Slot> m_slots;
+        bool m_isSynchronized;
+        uint32_t m_expected;
+        uint32_t m_highest;
+        uint16_t m_lastLength;
+        Statistics m_statistics;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
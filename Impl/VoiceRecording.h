@@ -0,0 +1,326 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "Module.h"
+#include "ThreadScheduling.h"
+#include "TraceCategories.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    /// Voice sessions as a voice producer delivered them, to replay them through the ingestion path offline.
+    /// Every Start(), Data() and Stop() callback of a session is kept with the time it was made, one file per session.
+    /// The callbacks only copy into a buffer allocated up front, the file is written by a low priority thread of its own
+    /// once the session has ended. A session that starts while no buffer is free is not recorded.
+    ///
+    /// A file starts with the magic and the version, both 32 bits, followed by a record per callback:
+    /// the microseconds since the start of the session (64 bits), the sequence number (32 bits), the length (16 bits),
+    /// the kind of callback (8 bits, as staged by VoiceSource) and a reserved byte, followed by the payload.
+    /// The payload of a start record is the VoiceSource::SessionFormat. A frame dropped while the microphone is stopped
+    /// is recorded without its payload, as a gated record. All fields are little-endian.
+    class VoiceRecording {
+    public:
+        static constexpr uint32_t MAGIC = 0x56535641; // "AVSV"
+        static constexpr uint32_t VERSION = 1;
+        static constexpr uint32_t HEADER_SIZE = 8;
+        static constexpr uint32_t RECORD_SIZE = 16;
+        // Callbacks beyond this many bytes of a session are left out of the recording
+        static constexpr uint32_t MAX_SESSION_SIZE = 2 * 1024 * 1024;
+        // One session is recorded while the one before is written
+        static constexpr uint8_t BUFFERS = 2;
+
+        struct Entry {
+            uint64_t time;
+            uint32_t sequenceNo;
+            uint8_t tag;
+            std::vector<uint8_t> data;
+        };
+
+        VoiceRecording(const VoiceRecording&) = delete;
+        VoiceRecording& operator=(const VoiceRecording&) = delete;
+
+        VoiceRecording()
+            : m_directory()
+            , m_callsign()
+            , m_buffers()
+            , m_current(nullptr)
+            , m_start()
+            , m_lock()
+            , m_completed()
+            , m_sessions(0)
+            , m_isShuttingDown(false)
+            , m_skipped(0)
+            , m_writingThread()
+        {
+        }
+
+        ~VoiceRecording()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_isShuttingDown = true;
+                m_completed.notify_all();
+            }
+
+            if (m_writingThread.joinable()) {
+                m_writingThread.join();
+            }
+        }
+
+    public:
+        // An empty directory records nothing, the buffers are allocated here and not on the COM-RPC thread
+        void Configure(const string& directory, const string& callsign)
+        {
+            m_directory = directory;
+            m_callsign = callsign;
+
+            if (IsEnabled() == true) {
+                for (Buffer& buffer : m_buffers) {
+                    buffer.data.resize(MAX_SESSION_SIZE);
+                }
+                m_writingThread = std::thread(&VoiceRecording::WritingLoop, this);
+            }
+        }
+
+        bool IsEnabled() const
+        {
+            return (m_directory.empty() == false);
+        }
+
+        // Called from the COM-RPC thread at the start of a session, before its first record
+        void Begin()
+        {
+            if (IsEnabled() == true) {
+                {
+                    std::lock_guard<std::mutex> lock(m_lock);
+                    m_current = nullptr;
+                    for (Buffer& buffer : m_buffers) {
+                        if ((m_current == nullptr) && (buffer.isFull == false)) {
+                            m_current = &buffer;
+                        }
+                    }
+                }
+
+                if (m_current == nullptr) {
+                    // Both buffers still wait for the writer, counted and traced by it
+                    m_skipped.fetch_add(1, std::memory_order_relaxed);
+                } else {
+                    m_start = std::chrono::steady_clock::now();
+                    m_current->stamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+                    m_current->size = 0;
+                    m_current->isTruncated = false;
+                    Append(MAGIC);
+                    Append(VERSION);
+                }
+            }
+        }
+
+        // Called from the COM-RPC thread, outside of a recorded session nothing is recorded. Takes no lock.
+        void Record(const uint8_t tag, const uint32_t sequenceNo, const uint8_t data[], const uint16_t length)
+        {
+            if (m_current != nullptr) {
+                if ((m_current->size + RECORD_SIZE + length) > MAX_SESSION_SIZE) {
+                    m_current->isTruncated = true;
+                } else {
+                    Append(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count()));
+                    Append(sequenceNo);
+                    Append(length);
+                    m_current->data[m_current->size++] = tag;
+                    m_current->data[m_current->size++] = 0;
+                    if (length > 0) {
+                        ::memcpy(&m_current->data[m_current->size], data, length);
+                        m_current->size += length;
+                    }
+                }
+            }
+        }
+
+        // Called from the COM-RPC thread at the end of a session, after its last record
+        void End()
+        {
+            if (m_current != nullptr) {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_current->isFull = true;
+                m_current->sequence = ++m_sessions;
+                m_current = nullptr;
+                m_completed.notify_one();
+            }
+        }
+
+        // Reads back a recorded session, false if the file is not a recording
+        static bool Load(const string& path, std::vector<Entry>& entries)
+        {
+            FILE* file = fopen(path.c_str(), "rb");
+            uint8_t header[RECORD_SIZE];
+            bool result = false;
+
+            entries.clear();
+
+            if (file != nullptr) {
+                result = ((fread(header, HEADER_SIZE, 1, file) == 1) && (Little(header, 4) == MAGIC) && (Little(&header[4], 4) == VERSION));
+
+                while ((result == true) && (fread(header, RECORD_SIZE, 1, file) == 1)) {
+                    Entry entry;
+                    entry.time = Little(header, 8);
+                    entry.sequenceNo = static_cast<uint32_t>(Little(&header[8], 4));
+                    entry.tag = header[14];
+                    entry.data.resize(static_cast<uint16_t>(Little(&header[12], 2)));
+                    result = ((entry.data.empty() == true) || (fread(entry.data.data(), entry.data.size(), 1, file) == 1));
+                    entries.push_back(std::move(entry));
+                }
+
+                fclose(file);
+            }
+
+            return (result);
+        }
+
+    private:
+        struct Buffer {
+            Buffer()
+                : data()
+                , size(0)
+                , stamp(0)
+                , sequence(0)
+                , isTruncated(false)
+                , isFull(false)
+            {
+            }
+
+            std::vector<uint8_t> data;
+            uint32_t size;
+            uint64_t stamp;
+            // Order in which the sessions ended, the oldest is written first
+            uint32_t sequence;
+            bool isTruncated;
+            // Set by End(), cleared by the writer, under the lock
+            bool isFull;
+        };
+
+        template <typename TYPE>
+        void Append(const TYPE value)
+        {
+            for (uint8_t index = 0; index < sizeof(TYPE); index++) {
+                m_current->data[m_current->size++] = static_cast<uint8_t>((static_cast<uint64_t>(value) >> (8 * index)) & 0xFF);
+            }
+        }
+
+        static uint64_t Little(const uint8_t data[], const uint8_t size)
+        {
+            uint64_t value = 0;
+            for (uint8_t index = size; index > 0; index--) {
+                value = (value << 8) | data[index - 1];
+            }
+            return (value);
+        }
+
+        Buffer* Completed()
+        {
+            Buffer* result = nullptr;
+            for (Buffer& buffer : m_buffers) {
+                if ((buffer.isFull == true) && ((result == nullptr) || (buffer.sequence < result->sequence))) {
+                    result = &buffer;
+                }
+            }
+            return (result);
+        }
+
+        void WritingLoop()
+        {
+            ThreadScheduling scheduling;
+            scheduling.schedulingPolicy = ThreadScheduling::OTHER;
+            scheduling.nice = RECORDING_NICE;
+            const string applied = scheduling.Apply();
+            TRACE(AVSClient, (_T("Voice recording thread of %s: %s"), m_callsign.c_str(), applied.c_str()));
+
+            std::unique_lock<std::mutex> lock(m_lock);
+
+            // The sessions that have ended are still written at shutdown
+            Buffer* buffer = nullptr;
+            do {
+                m_completed.wait(lock, [this]() { return ((Completed() != nullptr) || (m_isShuttingDown == true)); });
+
+                buffer = Completed();
+                if (buffer != nullptr) {
+                    // The COM-RPC thread does not touch a full buffer
+                    lock.unlock();
+                    Save(*buffer);
+                    lock.lock();
+                    buffer->isFull = false;
+                }
+            } while (buffer != nullptr);
+        }
+
+        void Save(const Buffer& buffer)
+        {
+            char name[32];
+            ::snprintf(name, sizeof(name), "voice-%013llu-", static_cast<unsigned long long>(buffer.stamp));
+            const string path = m_directory + '/' + name + m_callsign + _T(".rec");
+
+            FILE* file = ::fopen(path.c_str(), "wb");
+            bool isWritten = (file != nullptr);
+            if (isWritten == true) {
+                isWritten = (::fwrite(buffer.data.data(), 1, buffer.size, file) == buffer.size);
+                isWritten = (::fclose(file) == 0) && (isWritten == true);
+            }
+
+            const uint32_t skipped = m_skipped.exchange(0);
+            if (isWritten == false) {
+                TRACE(AVSClient, (_T("Failed to write the voice recording %s"), path.c_str()));
+                ::remove(path.c_str());
+            } else {
+                TRACE(AVSClient, (_T("Voice session recorded to %s%s"), path.c_str(), (buffer.isTruncated == true ? _T(", truncated") : _T(""))));
+            }
+            if (skipped > 0) {
+                TRACE(AVSClient, (_T("%u voice session(s) of %s not recorded, the recording thread fell behind"), skipped, m_callsign.c_str()));
+            }
+        }
+
+    private:
+        // The writes are done between everything else
+        static constexpr int8_t RECORDING_NICE = 19;
+
+        string m_directory;
+        string m_callsign;
+        Buffer m_buffers[BUFFERS];
+        // The buffer of the session being recorded, COM-RPC thread only
+        Buffer* m_current;
+        std::chrono::steady_clock::time_point m_start;
+        std::mutex m_lock;
+        std::condition_variable m_completed;
+        uint32_t m_sessions;
+        bool m_isShuttingDown;
+        std::atomic<uint32_t> m_skipped;
+        std::thread m_writingThread;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
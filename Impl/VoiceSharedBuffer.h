@@ -0,0 +1,122 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "Module.h"
+
+#include <cstdint>
+#include <memory>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    /// Voice frames passed through a shared Core::CyclicBuffer instead of one COM-RPC Data() call per frame.
+    /// The producer writes every frame as a record, a little-endian header (sequence number and length)
+    /// followed by the payload, in a single CyclicBuffer::Write(). It then rings the doorbell with an empty
+    /// IVoiceHandler::Data() call, once per frame or once per burst of frames.
+    class VoiceSharedBuffer {
+    public:
+        static constexpr uint32_t HEADER_SIZE = sizeof(uint32_t) + sizeof(uint16_t);
+
+        VoiceSharedBuffer(const VoiceSharedBuffer&) = delete;
+        VoiceSharedBuffer& operator=(const VoiceSharedBuffer&) = delete;
+
+        VoiceSharedBuffer()
+            : m_buffer()
+            , m_path()
+        {
+        }
+
+        ~VoiceSharedBuffer() = default;
+
+    public:
+        bool Open(const string& path, const uint32_t size)
+        {
+            m_buffer.reset(new Core::CyclicBuffer(path, Core::File::USER_READ | Core::File::USER_WRITE | Core::File::GROUP_READ | Core::File::GROUP_WRITE | Core::File::SHAREABLE | Core::File::CREATE, size, false));
+            if (m_buffer->IsValid() == false) {
+                m_buffer.reset();
+            } else {
+                m_path = path;
+            }
+            return (IsOpen());
+        }
+
+        void Close()
+        {
+            m_buffer.reset();
+            m_path.clear();
+        }
+
+        bool IsOpen() const
+        {
+            return (m_buffer != nullptr);
+        }
+
+        const string& Path() const
+        {
+            return (m_path);
+        }
+
+        uint32_t Size() const
+        {
+            return (IsOpen() ? m_buffer->Size() : 0);
+        }
+
+        // Takes the next complete record out of the buffer, data must hold up to 64 KiB
+        bool Pop(uint32_t& sequenceNo, uint16_t& length, uint8_t data[])
+        {
+            bool result = false;
+
+            if ((IsOpen() == true) && (m_buffer->Used() >= HEADER_SIZE)) {
+                uint8_t header[HEADER_SIZE];
+                m_buffer->Peek(header, HEADER_SIZE);
+
+                const uint16_t size = static_cast<uint16_t>(header[4] | (header[5] << 8));
+                if (m_buffer->Used() >= (HEADER_SIZE + size)) {
+                    m_buffer->Read(header, HEADER_SIZE);
+                    if ((size == 0) || (m_buffer->Read(data, size) == size)) {
+                        sequenceNo = (header[0] | (header[1] << 8) | (header[2] << 16) | (static_cast<uint32_t>(header[3]) << 24));
+                        length = size;
+                        result = true;
+                    } else {
+                        // Out of step with the producer, nothing after this point can be trusted
+                        m_buffer->Flush();
+                    }
+                }
+            }
+
+            return (result);
+        }
+
+        // Drops everything written so far
+        void Clear()
+        {
+            if (IsOpen() == true) {
+                m_buffer->Flush();
+            }
+        }
+
+    private:
+        std::unique_ptr<Core::CyclicBuffer> m_buffer;
+        string m_path;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
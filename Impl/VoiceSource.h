@@ -0,0 +1,562 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "Module.h"
+#include "AudioFormatConverter.h"
+#include "CompatibleAudioFormat.h"
+#include "ThreadScheduling.h"
+#include "TraceCategories.h"
+#include "VoiceDecoder.h"
+#include "VoiceJitterBuffer.h"
+#include "VoiceRecording.h"
+#include "VoiceSharedBuffer.h"
+#include "VoiceStagingRing.h"
+
+#include <WPEFramework/interfaces/IVoiceHandler.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    /// Tunables of the Thunder voice ingestion path
+    struct VoiceHandlerSettings {
+        enum concealment : uint8_t {
+            SILENCE,
+            REPEAT
+        };
+
+        enum transport : uint8_t {
+            RPC,
+            SHARED
+        };
+
+        enum mixing : uint8_t {
+            SELECT,
+            MIX
+        };
+
+        VoiceHandlerSettings()
+            : jitterWindow(4)
+            , lossConcealment(REPEAT)
+            , codec(VoiceDecoder::UNDEFINED)
+            , batchDuration(10)
+            , voiceTransport(RPC)
+            , sharedBuffer(_T("/tmp/avsvoice"))
+            , sourceMixing(SELECT)
+            , drainScheduling()
+            , recording()
+        {
+        }
+
+        bool Concealment(const string& name)
+        {
+            bool result = true;
+            if (name == _T("silence")) {
+                lossConcealment = SILENCE;
+            } else if (name == _T("repeat")) {
+                lossConcealment = REPEAT;
+            } else {
+                result = false;
+            }
+            return result;
+        }
+
+        bool Codec(const string& name)
+        {
+            bool result = true;
+            if (name == _T("pcm")) {
+                codec = VoiceDecoder::PCM;
+            } else if (name == _T("adpcm")) {
+                codec = VoiceDecoder::ADPCM;
+            } else if (name == _T("msbc")) {
+                codec = VoiceDecoder::MSBC;
+            } else if (name == _T("opus")) {
+                codec = VoiceDecoder::OPUS;
+            } else {
+                result = false;
+            }
+            return result;
+        }
+
+        bool Transport(const string& name)
+        {
+            bool result = true;
+            if (name == _T("rpc")) {
+                voiceTransport = RPC;
+            } else if (name == _T("shm")) {
+                voiceTransport = SHARED;
+            } else {
+                result = false;
+            }
+            return result;
+        }
+
+        bool Mixing(const string& name)
+        {
+            bool result = true;
+            if (name == _T("select")) {
+                sourceMixing = SELECT;
+            } else if (name == _T("mix")) {
+                sourceMixing = MIX;
+            } else {
+                result = false;
+            }
+            return result;
+        }
+
+        // Number of frames held back to wait for a late frame, 0 disables reordering
+        uint8_t jitterWindow;
+        concealment lossConcealment;
+        // UNDEFINED takes the codec from the profile of the voice producer
+        VoiceDecoder::codec codec;
+        // Milliseconds of audio collected before writing to the SDS, 0 writes whatever has arrived
+        uint8_t batchDuration;
+        // SHARED falls back to RPC if the voice producer does not take the shared buffer
+        transport voiceTransport;
+        string sharedBuffer;
+        // With several audio sources, SELECT writes the highest priority source in a session, MIX sums them
+        mixing sourceMixing;
+        // Applied to the thread that drains the sources into the SDS
+        ThreadScheduling drainScheduling;
+        // Directory the voice sessions are recorded to for replaying them offline, empty for none
+        string recording;
+    };
+
+    /// The ingestion pipeline of one Thunder voice producer: staging ring, jitter buffer, decoder and format conversion.
+    /// Frames are staged on the COM-RPC thread and drained on the drain thread of the ThunderVoiceHandler, which
+    /// receives the session changes and the converted SDS samples through the SINK passed to Drain().
+    class VoiceSource {
+    public:
+        // Kinds of records passed from the COM-RPC thread to the drain thread
+        enum staged : uint8_t {
+            STAGED_DATA,
+            STAGED_START,
+            STAGED_STOP,
+            STAGED_DOORBELL,
+            // Only recorded, never staged: a frame dropped while the microphone is stopped, without its audio
+            RECORDED_GATED
+        };
+
+        // Source format of a session, the payload of the STAGED_START record
+        struct SessionFormat {
+            uint32_t sampleRate;
+            uint8_t channels;
+            uint8_t resolution;
+            uint8_t codec;
+        };
+
+        // Counted over the sessions that have ended
+        struct Totals {
+            uint32_t sessions;
+            uint32_t received;
+            uint32_t lost;
+            uint32_t late;
+            uint32_t duplicates;
+            // Frames the staging ring had no room for
+            uint32_t dropped;
+        };
+
+        // Roughly two seconds of 16 kHz/16-bit audio
+        static constexpr uint32_t STAGING_RING_SIZE = 64 * 1024;
+
+        VoiceSource(const VoiceSource&) = delete;
+        VoiceSource& operator=(const VoiceSource&) = delete;
+
+        VoiceSource(const string& callsign, const uint8_t priority, const VoiceHandlerSettings& settings)
+            : m_callsign(callsign)
+            , m_priority(priority)
+            , m_settings(settings)
+            , m_stagingRing{ STAGING_RING_SIZE }
+            , m_frame(std::numeric_limits<uint16_t>::max())
+            , m_jitterBuffer{ settings.jitterWindow }
+            , m_lastFrame()
+            , m_decoder()
+            , m_converter()
+            , m_converted()
+            , m_isConverting{ false }
+            , m_carry()
+            , m_carried{ 0 }
+            , m_output()
+            , m_pending()
+            , m_isActive{ false }
+            , m_sharedBuffer()
+            , m_sharedFrames{ 0 }
+            , m_doorbells{ 0 }
+            , m_gatedFrames{ 0 }
+            , m_pauses{ 0 }
+            , m_pausesDrained{ 0 }
+            , m_recording()
+            , m_totals()
+        {
+            // Upsampling 8 kHz doubles the amount of data
+            m_output.reserve(m_stagingRing.Capacity());
+            m_recording.Configure(settings.recording, callsign);
+        }
+
+        ~VoiceSource() = default;
+
+    public:
+        const string& Callsign() const
+        {
+            return (m_callsign);
+        }
+
+        // 0 is the highest priority
+        uint8_t Priority() const
+        {
+            return (m_priority);
+        }
+
+        // Drain side, a session of this source is running
+        bool IsActive() const
+        {
+            return (m_isActive);
+        }
+
+        // Called from the COM-RPC thread, must not block
+        bool Stage(const uint8_t tag, const uint32_t sequenceNo, const uint8_t data[], const uint16_t length)
+        {
+            return (m_stagingRing.Push(tag, sequenceNo, data, length));
+        }
+
+        // Drain side, nothing is staged and no pause is waiting to be drained
+        bool IsEmpty() const
+        {
+            return ((m_stagingRing.IsEmpty() == true) && (m_pauses.load(std::memory_order_acquire) == m_pausesDrained));
+        }
+
+        // Called when the microphone stops. The staging ring has a single producer, the COM-RPC thread,
+        // so the pause is counted instead of staged and the drain thread picks it up after the staged frames.
+        void Pause()
+        {
+            m_pauses.fetch_add(1, std::memory_order_release);
+        }
+
+        // Frames dropped on the COM-RPC thread while the microphone is stopped
+        void Gated()
+        {
+            m_gatedFrames.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        uint32_t TakeGated()
+        {
+            return (m_gatedFrames.exchange(0));
+        }
+
+        VoiceSharedBuffer& SharedBuffer()
+        {
+            return (m_sharedBuffer);
+        }
+
+        VoiceRecording& Recording()
+        {
+            return (m_recording);
+        }
+
+        // Drain side
+        const Totals& Counted() const
+        {
+            return (m_totals);
+        }
+
+        // Samples waiting to be mixed with the other sources, owned by the drain thread
+        std::vector<int16_t>& Pending()
+        {
+            return (m_pending);
+        }
+
+        // Moves everything staged so far through the jitter buffer, the decoder and the converter. The SINK gets
+        // Started(source) and Stopped(source) at the session boundaries and Output(source, samples, count)
+        // with the SDS samples in between. Audio is dropped if the microphone is not streaming.
+        template <typename SINK>
+        void Drain(SINK& sink, const bool isStreaming)
+        {
+            JitterSink jitterSink(*this);
+            // Frames staged before the pause was counted are drained before it
+            const uint32_t pauses = m_pauses.load(std::memory_order_acquire);
+            uint8_t tag;
+            uint32_t sequenceNo;
+            uint16_t length;
+
+            while (m_stagingRing.Pop(tag, sequenceNo, length, m_frame.data()) == true) {
+                switch (tag) {
+                case STAGED_START:
+                    m_jitterBuffer.Reset();
+                    Configure(m_frame.data(), length);
+                    m_isActive = true;
+                    sink.Started(*this);
+                    break;
+                case STAGED_DATA:
+                    m_jitterBuffer.Push(sequenceNo, m_frame.data(), length, jitterSink);
+                    break;
+                case STAGED_DOORBELL:
+                    m_doorbells++;
+                    ReadShared(isStreaming);
+                    break;
+                case STAGED_STOP:
+                    ReadShared(isStreaming);
+                    m_jitterBuffer.Flush(jitterSink);
+                    Output(sink);
+                    m_isActive = false;
+                    sink.Stopped(*this);
+                    ReportStatistics();
+                    break;
+                default:
+                    break;
+                }
+
+                Output(sink);
+            }
+
+            if (pauses != m_pausesDrained) {
+                // Write out what is in flight, audio after the resume does not continue from it
+                m_pausesDrained = pauses;
+                ReadShared(true);
+                m_jitterBuffer.Flush(jitterSink);
+                m_lastFrame.clear();
+                m_carried = 0;
+                Output(sink);
+            }
+        }
+
+    private:
+        // Hands the frames released by the jitter buffer back to the source
+        class JitterSink {
+        public:
+            explicit JitterSink(VoiceSource& parent)
+                : m_parent(parent)
+            {
+            }
+
+            void Frame(const uint8_t data[], const uint16_t length)
+            {
+                m_parent.Deliver(data, length);
+            }
+
+            void Lost(const uint16_t length)
+            {
+                m_parent.Conceal(length);
+            }
+
+        private:
+            VoiceSource& m_parent;
+        };
+
+        template <typename SINK>
+        void Output(SINK& sink)
+        {
+            if (m_output.empty() == false) {
+                sink.Output(*this, m_output.data(), static_cast<uint32_t>(m_output.size()));
+                m_output.clear();
+            }
+        }
+
+        // Takes the frames the producer has written to the shared buffer so far, in the same
+        // order as the records in the staging ring, as the doorbell is rung after writing
+        void ReadShared(const bool accept)
+        {
+            JitterSink jitterSink(*this);
+            uint32_t sequenceNo;
+            uint16_t length;
+
+            while (m_sharedBuffer.Pop(sequenceNo, length, m_frame.data()) == true) {
+                if (accept == true) {
+                    m_sharedFrames++;
+                    m_jitterBuffer.Push(sequenceNo, m_frame.data(), length, jitterSink);
+                } else {
+                    Gated();
+                }
+            }
+        }
+
+        // Selects the conversion for the source format of the new session
+        void Configure(const uint8_t data[], const uint16_t length)
+        {
+            SessionFormat session = { AudioFormatCompatibility::SAMPLE_RATE_HZ, AudioFormatCompatibility::NUM_CHANNELS, AudioFormatCompatibility::SAMPLE_SIZE_IN_BITS, Exchange::IVoiceProducer::IProfile::PCM };
+            if (length == sizeof(session)) {
+                ::memcpy(&session, data, sizeof(session));
+            }
+
+            // The profile does not carry the endianness, Thunder voice producers deliver little-endian samples.
+            // Fields a producer leaves unset fall back to the SDS format.
+            alexaClientSDK::avsCommon::utils::AudioFormat format;
+            format.encoding = alexaClientSDK::avsCommon::utils::AudioFormat::Encoding::LPCM;
+            format.endianness = alexaClientSDK::avsCommon::utils::AudioFormat::Endianness::LITTLE;
+            format.sampleRateHz = ((session.sampleRate != 0) ? session.sampleRate : AudioFormatCompatibility::SAMPLE_RATE_HZ);
+            format.sampleSizeInBits = ((session.resolution != 0) ? session.resolution : AudioFormatCompatibility::SAMPLE_SIZE_IN_BITS);
+            format.numChannels = ((session.channels != 0) ? session.channels : AudioFormatCompatibility::NUM_CHANNELS);
+
+            // The profile can only tell PCM from ADPCM, other codecs have to be configured
+            VoiceDecoder::codec codec = m_settings.codec;
+            if (codec == VoiceDecoder::UNDEFINED) {
+                codec = ((session.codec == Exchange::IVoiceProducer::IProfile::ADPCM) ? VoiceDecoder::ADPCM : VoiceDecoder::PCM);
+            }
+
+            alexaClientSDK::avsCommon::utils::AudioFormat decoded;
+
+            m_isConverting = false;
+            m_lastFrame.clear();
+            m_carried = 0;
+            m_pending.clear();
+
+            if (m_decoder.Configure(codec, format, decoded) == false) {
+                TRACE(AVSClient, (_T("Unsupported voice codec from %s, dropping the audio of this session"), m_callsign.c_str()));
+            } else if (m_converter.Configure(decoded, std::numeric_limits<uint16_t>::max()) == false) {
+                TRACE(AVSClient, (_T("Unsupported voice profile from %s, dropping the audio of this session"), m_callsign.c_str()));
+            } else {
+                m_converted.resize(m_converter.MaxOutput(std::numeric_limits<uint16_t>::max()));
+                m_carry.resize(m_converter.FrameSize());
+                m_isConverting = true;
+            }
+        }
+
+        // Converts whole source frames into SDS samples
+        void Append(const uint8_t data[], const uint16_t length)
+        {
+            const uint32_t samples = m_converter.Convert(data, length, m_converted.data());
+            m_output.insert(m_output.end(), m_converted.begin(), m_converted.begin() + samples);
+        }
+
+        // Frames may end in the middle of a sample, the partial sample is carried over to the next frame
+        void Emit(const uint8_t data[], const uint16_t length)
+        {
+            const uint16_t frameSize = m_converter.FrameSize();
+            uint16_t offset = 0;
+
+            if (m_carried > 0) {
+                offset = std::min<uint16_t>(frameSize - m_carried, length);
+                ::memcpy(&m_carry[m_carried], data, offset);
+                m_carried += offset;
+                if (m_carried == frameSize) {
+                    Append(m_carry.data(), frameSize);
+                    m_carried = 0;
+                }
+            }
+
+            const uint16_t remaining = length - offset;
+            const uint16_t whole = remaining - (remaining % frameSize);
+            if (whole > 0) {
+                Append(&data[offset], whole);
+            }
+
+            if (whole < remaining) {
+                m_carried = remaining - whole;
+                ::memcpy(m_carry.data(), &data[offset + whole], m_carried);
+            }
+        }
+
+        void Deliver(const uint8_t data[], const uint16_t length)
+        {
+            if (m_isConverting == true) {
+                const uint8_t* samples = data;
+                uint16_t size = length;
+                if (m_decoder.IsPassThrough() == false) {
+                    size = m_decoder.Decode(data, length);
+                    samples = m_decoder.Buffer();
+                }
+                m_lastFrame.assign(samples, samples + size);
+                Emit(samples, size);
+            }
+        }
+
+        // Fills the place of a lost frame so the sample timeline stays continuous
+        void Conceal(const uint16_t length)
+        {
+            if (m_isConverting == true) {
+                // The size of a lost compressed frame says nothing about its decoded size
+                const uint16_t size = (m_decoder.IsPassThrough() ? length : static_cast<uint16_t>(m_lastFrame.size()));
+                const uint16_t concealed = m_decoder.Conceal();
+
+                if (concealed > 0) {
+                    Emit(m_decoder.Buffer(), concealed);
+                } else if ((m_settings.lossConcealment == VoiceHandlerSettings::REPEAT) && (m_lastFrame.size() == size)) {
+                    // Repeat the last frame, halving its amplitude with every consecutive loss
+                    int16_t* samples = reinterpret_cast<int16_t*>(m_lastFrame.data());
+                    for (size_t index = 0; index < (m_lastFrame.size() / sizeof(int16_t)); index++) {
+                        samples[index] = static_cast<int16_t>(samples[index] / 2);
+                    }
+                    Emit(m_lastFrame.data(), size);
+                } else {
+                    m_lastFrame.assign(size, 0);
+                    Emit(m_lastFrame.data(), size);
+                }
+            }
+        }
+
+        void ReportStatistics()
+        {
+            const VoiceJitterBuffer::Statistics& stats = m_jitterBuffer.Stats();
+
+            TRACE(AVSClient, (_T("Voice session of %s: %u frames received, %u lost, %u reordered, %u late, %u duplicates, %u resyncs"),
+                m_callsign.c_str(), stats.received, stats.lost, stats.reordered, stats.late, stats.duplicates, stats.resyncs));
+            TRACE(AVSClient, (_T("Voice staging ring: high-water mark %u of %u bytes, %u frames dropped"),
+                m_stagingRing.HighWaterMark(), m_stagingRing.Capacity(), m_stagingRing.Drops()));
+            if (m_sharedBuffer.IsOpen() == true) {
+                TRACE(AVSClient, (_T("Voice shared buffer: %u frames in %u doorbells"), m_sharedFrames, m_doorbells));
+            }
+            m_totals.sessions++;
+            m_totals.received += stats.received;
+            m_totals.lost += stats.lost;
+            m_totals.late += stats.late;
+            m_totals.duplicates += stats.duplicates;
+            m_totals.dropped += m_stagingRing.Drops();
+
+            m_stagingRing.ResetStatistics();
+            m_sharedFrames = 0;
+            m_doorbells = 0;
+        }
+
+    private:
+        const string m_callsign;
+        const uint8_t m_priority;
+        const VoiceHandlerSettings& m_settings;
+        VoiceStagingRing m_stagingRing;
+        std::vector<uint8_t> m_frame;
+        VoiceJitterBuffer m_jitterBuffer;
+        std::vector<uint8_t> m_lastFrame;
+        VoiceDecoder m_decoder;
+        AudioFormatConverter m_converter;
+        std::vector<int16_t> m_converted;
+        bool m_isConverting;
+        std::vector<uint8_t> m_carry;
+        uint16_t m_carried;
+        // Samples converted from the current record, handed to the SINK once the record is done
+        std::vector<int16_t> m_output;
+        std::vector<int16_t> m_pending;
+        bool m_isActive;
+        VoiceSharedBuffer m_sharedBuffer;
+        uint32_t m_sharedFrames;
+        uint32_t m_doorbells;
+        std::atomic<uint32_t> m_gatedFrames;
+        // Counted by stopStreamingMicrophoneData(), the drain thread keeps up with it
+        std::atomic<uint32_t> m_pauses;
+        uint32_t m_pausesDrained;
+        VoiceRecording m_recording;
+        Totals m_totals;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
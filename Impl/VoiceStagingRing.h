@@ -0,0 +1,176 @@
+ /*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    /// Bounded single-producer/single-consumer ring of voice frames.
+    /// The producer (COM-RPC thread) never blocks or allocates; frames that do not fit are dropped and counted.
+    /// Each frame is stored as a small header (tag, sequence number and length) followed by its payload.
+    /// The tag is opaque to the ring and lets the producer pass control records in-band with the audio.
+    class VoiceStagingRing {
+    public:
+        static constexpr uint32_t HEADER_SIZE = sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint16_t);
+
+        VoiceStagingRing(const VoiceStagingRing&) = delete;
+        VoiceStagingRing& operator=(const VoiceStagingRing&) = delete;
+
+        // Capacity is rounded up to the next power of two
+        explicit VoiceStagingRing(const uint32_t capacity)
+            : m_buffer(RoundUp(capacity))
+            , m_mask(static_cast<uint32_t>(m_buffer.size() - 1))
+            , m_head{ 0 }
+            , m_tail{ 0 }
+            , m_highWaterMark{ 0 }
+            , m_drops{ 0 }
+        {
+        }
+
+        ~VoiceStagingRing() = default;
+
+    public:
+        // Producer side
+        bool Push(const uint8_t tag, const uint32_t sequenceNo, const uint8_t data[], const uint16_t length)
+        {
+            const uint32_t head = m_head.load(std::memory_order_relaxed);
+            const uint32_t tail = m_tail.load(std::memory_order_acquire);
+            const uint32_t used = head - tail;
+            const uint32_t needed = HEADER_SIZE + length;
+
+            if ((Capacity() - used) < needed) {
+                m_drops.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+
+            uint8_t header[HEADER_SIZE];
+            header[0] = tag;
+            ::memcpy(header + sizeof(tag), &sequenceNo, sizeof(sequenceNo));
+            ::memcpy(header + sizeof(tag) + sizeof(sequenceNo), &length, sizeof(length));
+
+            CopyIn(head, header, HEADER_SIZE);
+            if (length > 0) {
+                CopyIn(head + HEADER_SIZE, data, length);
+            }
+
+            m_head.store(head + needed, std::memory_order_release);
+
+            if ((used + needed) > m_highWaterMark.load(std::memory_order_relaxed)) {
+                m_highWaterMark.store(used + needed, std::memory_order_relaxed);
+            }
+
+            return true;
+        }
+
+        // Consumer side, returns false when the ring is empty.
+        // The caller must provide room for at least UINT16_MAX bytes.
+        bool Pop(uint8_t& tag, uint32_t& sequenceNo, uint16_t& length, uint8_t data[])
+        {
+            const uint32_t tail = m_tail.load(std::memory_order_relaxed);
+            const uint32_t head = m_head.load(std::memory_order_acquire);
+
+            if (head == tail) {
+                return false;
+            }
+
+            uint8_t header[HEADER_SIZE];
+            CopyOut(tail, header, HEADER_SIZE);
+            tag = header[0];
+            ::memcpy(&sequenceNo, header + sizeof(tag), sizeof(sequenceNo));
+            ::memcpy(&length, header + sizeof(tag) + sizeof(sequenceNo), sizeof(length));
+
+            CopyOut(tail + HEADER_SIZE, data, length);
+
+            m_tail.store(tail + HEADER_SIZE + length, std::memory_order_release);
+
+            return true;
+        }
+
+        bool IsEmpty() const
+        {
+            return (m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire));
+        }
+
+        uint32_t Capacity() const
+        {
+            return (m_mask + 1);
+        }
+
+        uint32_t HighWaterMark() const
+        {
+            return (m_highWaterMark.load(std::memory_order_relaxed));
+        }
+
+        uint32_t Drops() const
+        {
+            return (m_drops.load(std::memory_order_relaxed));
+        }
+
+        // Not synchronized with the producer, only call between sessions
+        void ResetStatistics()
+        {
+            m_highWaterMark.store(0, std::memory_order_relaxed);
+            m_drops.store(0, std::memory_order_relaxed);
+        }
+
+    private:
+        static uint32_t RoundUp(const uint32_t value)
+        {
+            uint32_t result = 1;
+            while (result < value) {
+                result <<= 1;
+            }
+            return result;
+        }
+
+        void CopyIn(const uint32_t position, const uint8_t data[], const uint32_t length)
+        {
+            const uint32_t offset = position & m_mask;
+            const uint32_t first = std::min(length, Capacity() - offset);
+            ::memcpy(&m_buffer[offset], data, first);
+            ::memcpy(&m_buffer[0], data + first, length - first);
+        }
+
+        void CopyOut(const uint32_t position, uint8_t data[], const uint32_t length) const
+        {
+            const uint32_t offset = position & m_mask;
+            const uint32_t first = std::min(length, Capacity() - offset);
+            ::memcpy(data, &m_buffer[offset], first);
+            ::memcpy(data + first, &m_buffer[0], length - first);
+        }
+
+    private:
+        std::vector<uint8_t> m_buffer;
+        const uint32_t m_mask;
+        // Free running positions, only the producer writes m_head and only the consumer writes m_tail
+        std::atomic<uint32_t> m_head;
+        std::atomic<uint32_t> m_tail;
+        std::atomic<uint32_t> m_highWaterMark;
+        std::atomic<uint32_t> m_drops;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
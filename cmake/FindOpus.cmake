@@ -0,0 +1,40 @@
+# If not stated otherwise in this file or this component's license file the
+# following copyright and licenses apply:
+#
+# Copyright 2020 Metrological
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# - Try to find Opus
+# Once done this will define
+#  OPUS_FOUND - System has Opus
+#  OPUS_INCLUDES - The Opus include directories
+#  OPUS_LIBRARIES - The libraries needed to use Opus
+
+find_package(PkgConfig)
+pkg_check_modules(PC_OPUS opus)
+
+if(PC_OPUS_FOUND)
+    set(OPUS_FOUND ${PC_OPUS_FOUND})
+    set(OPUS_INCLUDES ${PC_OPUS_INCLUDE_DIRS})
+    set(OPUS_LIBRARIES ${PC_OPUS_LIBRARIES})
+
+    if(NOT TARGET Opus::Opus)
+        add_library(Opus::Opus SHARED IMPORTED)
+        set_target_properties(Opus::Opus
+            PROPERTIES
+                INTERFACE_INCLUDE_DIRECTORIES "${PC_OPUS_INCLUDE_DIRS}"
+                IMPORTED_LINK_INTERFACE_LIBRARIES "${PC_OPUS_LIBRARIES}"
+        )
+    endif()
+endif()
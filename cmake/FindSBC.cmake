@@ -0,0 +1,40 @@
+# If not stated otherwise in this file or this component's license file the
+# following copyright and licenses apply:
+#
+# Copyright 2020 Metrological
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# - Try to find SBC
+# Once done this will define
+#  SBC_FOUND - System has SBC
+#  SBC_INCLUDES - The SBC include directories
+#  SBC_LIBRARIES - The libraries needed to use SBC
+
+find_package(PkgConfig)
+pkg_check_modules(PC_SBC sbc)
+
+if(PC_SBC_FOUND)
+    set(SBC_FOUND ${PC_SBC_FOUND})
+    set(SBC_INCLUDES ${PC_SBC_INCLUDE_DIRS})
+    set(SBC_LIBRARIES ${PC_SBC_LIBRARIES})
+
+    if(NOT TARGET SBC::SBC)
+        add_library(SBC::SBC SHARED IMPORTED)
+        set_target_properties(SBC::SBC
+            PROPERTIES
+                INTERFACE_INCLUDE_DIRECTORIES "${PC_SBC_INCLUDE_DIRS}"
+                IMPORTED_LINK_INTERFACE_LIBRARIES "${PC_SBC_LIBRARIES}"
+        )
+    endif()
+endif()